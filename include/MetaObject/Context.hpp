@@ -1,28 +1,51 @@
-#pragma once
-#include "MetaObject/Detail/Export.hpp"
-#include <opencv2/core/cuda.hpp>
-#include <string>
-
-
-namespace mo
-{
-    class Allocator;
-    class MO_EXPORTS Context
-    {
-    public:
-        static Context* GetDefaultThreadContext();
-        static void SetDefaultThreadContext(Context*  ctx);
-        Context(const std::string& name = "");
-        ~Context();
-        cv::cuda::Stream&      GetStream();
-        void                  SetStream(cv::cuda::Stream stream);
-
-        size_t process_id = 0;
-        size_t thread_id = 0;
-        std::string host_name;
-        Allocator* allocator;
-    private:
-        cv::cuda::Stream stream;
-        std::string name;
-    };
-}
+#pragma once
+#include "MetaObject/Detail/Export.hpp"
+#include <opencv2/core/cuda.hpp>
+#include <memory>
+#include <string>
+
+namespace boost { namespace container { namespace pmr { class memory_resource; } } }
+
+namespace mo
+{
+    class Allocator;
+    class Arena;
+    class MemoryBudget;
+    class MO_EXPORTS Context
+    {
+    public:
+        static Context* GetDefaultThreadContext();
+        static void SetDefaultThreadContext(Context*  ctx);
+        Context(const std::string& name = "");
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+        ~Context();
+        cv::cuda::Stream&      GetStream();
+        void                  SetStream(cv::cuda::Stream stream);
+        /*!
+         * \brief SetMemoryBudget limits the memory in use through allocator,
+         *        nullptr removes the limit.  The allocator is shared by the
+         *        contexts of a thread, so the budget applies to all of them
+         *        until it is replaced.  Memory allocated before that is still
+         *        released to the budget it was charged to.
+         */
+        void SetMemoryBudget(std::shared_ptr<MemoryBudget> cpu,
+                             std::shared_ptr<MemoryBudget> gpu = std::shared_ptr<MemoryBudget>());
+        // The budgets the allocator enforces, which another context of the thread may have set
+        std::shared_ptr<MemoryBudget> GetCpuMemoryBudget() const;
+        std::shared_ptr<MemoryBudget> GetGpuMemoryBudget() const;
+
+        size_t process_id = 0;
+        size_t thread_id = 0;
+        std::string host_name;
+        Allocator* allocator;
+        // Scratch memory for the current inner loop iteration, owned by the context
+        Arena* arena;
+        // Used by PolymorphicAllocator and the mo::pmr containers created on this context's thread,
+        // defaults to the thread's CpuMemoryPool
+        boost::container::pmr::memory_resource* memory_resource;
+    private:
+        cv::cuda::Stream stream;
+        std::string name;
+    };
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "Export.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mo
+{
+    /*!
+     * \brief The AllocationHistogram struct is the high water size histogram
+     *        of one device of an allocator: for every request size, the largest
+     *        number of allocations of that size that were alive at once.
+     */
+    struct MO_EXPORTS AllocationHistogram
+    {
+        // request size in bytes -> most allocations of that size alive at the same time
+        std::map<size_t, size_t> peak_counts;
+        // Most bytes alive at the same time, less than the sum over peak_counts
+        // when the peaks of different sizes did not coincide
+        size_t peak_bytes = 0;
+
+        // Keeps the larger count of every size and the larger peak
+        void Merge(const AllocationHistogram& other);
+        // The sizes in [min_size, max_size), the peak is clamped to their sum
+        AllocationHistogram Range(size_t min_size, size_t max_size) const;
+    };
+
+    struct MO_EXPORTS AllocationProfile
+    {
+        std::string name;
+        AllocationHistogram cpu;
+        AllocationHistogram gpu;
+    };
+
+    /*!
+     * \brief The AllocationProfiler class records the high water size histogram
+     *        of every allocator so that the next run can reserve and prefault
+     *        that memory at startup instead of growing its pools one block at a
+     *        time during the first frames.  Profiles are matched by allocator
+     *        name, see Allocator::SetName: an allocator that is named after a
+     *        profile was loaded reserves the memory of the profile with the same
+     *        name.  Unnamed allocators are not saved.
+     *        When the MO_ALLOCATION_PROFILE environment variable is set to a
+     *        path, the profile saved there by the previous run is loaded when
+     *        the library is loaded, recording starts, and the profile of this
+     *        run is written back to the path at exit.
+     */
+    class MO_EXPORTS AllocationProfiler
+    {
+    public:
+        static void Start();
+        static void Stop();
+        static bool IsRecording()
+        {
+            return recording.load(std::memory_order_relaxed);
+        }
+        /*!
+         * \brief Save writes the profiles of the live allocators and of the
+         *        allocators destroyed while recording.  Allocators with the
+         *        same name are merged.
+         */
+        static bool Save(const std::string& path);
+        /*!
+         * \brief Load reads the profiles used by allocators named from now on
+         * \param grace is how long the MemoryTrimmer leaves the reserved memory
+         *        alone, see MemoryTrimmer::Defer
+         */
+        static bool Load(const std::string& path,
+                         std::chrono::milliseconds grace = std::chrono::milliseconds(60000));
+        // Returns false if no profile with the given name was loaded
+        static bool GetProfile(const std::string& name, AllocationProfile& profile);
+        // Called by allocators that are destroyed while recording, does not log
+        static void Retire(const AllocationProfile& profile);
+    private:
+        static std::atomic<bool> recording;
+    };
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "Export.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mo
+{
+    class Allocator;
+
+    /*!
+     * \brief One fixed size record of an allocation trace file.  A name record
+     *        (op == Name_e) is followed by size bytes holding the name of the
+     *        allocator with the given id.
+     */
+    struct AllocationTraceEvent
+    {
+        enum Op
+        {
+            Allocate_e = 0,
+            Free_e = 1,
+            Name_e = 2
+        };
+        enum Device
+        {
+            Cpu_e = 0,
+            Gpu_e = 1
+        };
+        // nanoseconds since the trace was started
+        uint64_t time;
+        uint64_t ptr;
+        uint64_t size;
+        uint32_t thread;
+        uint16_t allocator;
+        uint8_t op;
+        uint8_t device;
+    };
+    static_assert(sizeof(AllocationTraceEvent) == 32, "AllocationTraceEvent is part of the trace file format");
+
+    /*!
+     * \brief The AllocationTrace class records every allocation and free that
+     *        goes through a mo::Allocator to a compact binary file.  Events
+     *        are buffered per thread and appended to the file in batches, so
+     *        the file is ordered by time only within a thread; Read sorts it.
+     *        When the MO_ALLOCATION_TRACE environment variable is set to a
+     *        path, recording starts when the library is loaded and stops at
+     *        exit.  The trace can be replayed against different policy
+     *        settings with the alloc_replay tool.
+     */
+    class MO_EXPORTS AllocationTrace
+    {
+    public:
+        static const uint32_t Version = 1;
+
+        static bool Start(const std::string& path);
+        // Flushes the buffers of all threads and closes the file
+        static void Stop();
+        static bool IsRecording()
+        {
+            return recording.load(std::memory_order_relaxed);
+        }
+        static void Record(AllocationTraceEvent::Op op, AllocationTraceEvent::Device device,
+                           const Allocator* allocator, const void* ptr, size_t size);
+        // Records a new name for an allocator that already appears in the trace
+        static void Rename(const Allocator* allocator, const std::string& name);
+
+        /*!
+         * \brief Read loads a trace file ordered by time
+         * \param names is indexed by allocator id
+         * \return false if the file can not be read or has the wrong version
+         */
+        static bool Read(const std::string& path,
+                         std::vector<AllocationTraceEvent>& events,
+                         std::vector<std::string>* names = nullptr);
+    private:
+        static std::atomic<bool> recording;
+    };
+}
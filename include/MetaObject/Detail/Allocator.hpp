@@ -1,11 +1,20 @@
 #pragma once
 #include "HelperMacros.hpp"
 #include "Export.hpp"
+#include "AllocationProfile.hpp"
 #include "MemoryBlock.h"
+#include "MemoryBudget.hpp"
+#include "MemoryTrimmer.hpp"
+#include "ScopeSampler.hpp"
 #include <opencv2/core/cuda.hpp>
 #include <opencv2/core/cuda/common.hpp>
 #include <boost/thread/mutex.hpp>
+#include <atomic>
 #include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <cuda.h>
 
 namespace mo
@@ -63,6 +72,38 @@ public:
     virtual void free(cv::cuda::GpuMat* mat);
 };
 
+/*!
+ * \brief The PoolTally struct counts, per thread, whether the caching layers
+ *        served a request from cached memory (hit) or had to request new
+ *        memory from the driver or operating system (miss).  Allocators
+ *        attribute the difference over a call to their own counters, which
+ *        works no matter how deeply the policies are nested.
+ */
+struct MO_EXPORTS PoolTally
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    static PoolTally& Thread();
+    static void Hit();
+    static void Miss();
+};
+
+/*!
+ * \brief The AllocatorStatistics struct is a snapshot of an allocator's
+ *        counters.  Sizes are in bytes.
+ */
+struct MO_EXPORTS AllocatorStatistics
+{
+    std::string name;
+    size_t bytes_in_use = 0;  // handed out to mats and stl containers
+    size_t bytes_cached = 0;  // freed memory held by the allocator's own GPU caches
+    size_t peak_bytes = 0;    // high water mark of bytes_in_use
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t pool_hits = 0;     // allocations served from cached memory
+    size_t pool_misses = 0;   // allocations that needed new memory
+};
+
 class MO_EXPORTS Allocator
         : virtual public cv::cuda::GpuMat::Allocator
         , virtual public cv::MatAllocator
@@ -70,6 +111,19 @@ class MO_EXPORTS Allocator
 public:
     static Allocator* GetThreadSafeAllocator();
     static Allocator* GetThreadSpecificAllocator();
+    /*!
+     * \brief GetLiveAllocatorStatistics returns the counters of every
+     *        allocator that currently exists, safe to call from any thread
+     */
+    static std::vector<AllocatorStatistics> GetLiveAllocatorStatistics();
+    /*!
+     * \brief GetLiveAllocationProfiles returns the high water size histograms
+     *        of every allocator that currently exists, see AllocationProfiler
+     */
+    static std::vector<AllocationProfile> GetLiveAllocationProfiles();
+
+    Allocator();
+    virtual ~Allocator();
 
     // Used for stl allocators
     virtual unsigned char* allocateGpu(size_t num_bytes) = 0;
@@ -78,10 +132,49 @@ public:
     virtual unsigned char* allocateCpu(size_t num_bytes) = 0;
     virtual void deallocateCpu(uchar* ptr, size_t numBytes) = 0;
     virtual void Release() {}
-    void SetName(const std::string& name){this->name = name;}
-    const std::string GetName(){return name;}
+    virtual size_t GetCachedBytes() const { return 0; }
+    AllocatorStatistics GetStatistics() const;
+    // Histogram of the allocations made while the AllocationProfiler was recording
+    AllocationProfile GetAllocationProfile() const;
+    /*!
+     * \brief Reserve creates and prefaults the pool blocks and cached stack
+     *        blocks needed to serve the given profile without growing.  CPU
+     *        memory is reserved in the pools of the calling thread.  Called by
+     *        SetName when a profile with the new name was loaded.
+     */
+    virtual void Reserve(const AllocationProfile& profile) {}
+    /*!
+     * \brief SetMemoryBudget limits the CPU and GPU memory this allocator may
+     *        have in use, nullptr removes the limit.  Only allocators built
+     *        with a BudgetPolicy enforce it.
+     */
+    virtual void SetMemoryBudget(const std::shared_ptr<MemoryBudget>& cpu,
+                                 const std::shared_ptr<MemoryBudget>& gpu) {}
+    // The budgets currently enforced, allocations keep the budget they were charged to
+    virtual std::shared_ptr<MemoryBudget> GetCpuMemoryBudget() const { return std::shared_ptr<MemoryBudget>(); }
+    virtual std::shared_ptr<MemoryBudget> GetGpuMemoryBudget() const { return std::shared_ptr<MemoryBudget>(); }
+    // Reserves the memory of the loaded profile with the same name, see AllocationProfiler
+    void SetName(const std::string& name);
+    const std::string GetName() const;
+protected:
+    // Called by implementations around every allocation and free
+    void RecordAllocation(const void* ptr, size_t num_bytes, bool gpu, const PoolTally& before) const;
+    void RecordDeallocation(const void* ptr, size_t num_bytes, bool gpu) const;
+    // Removes this allocator from the live list, must be called by the most
+    // derived class before it starts destroying state used by GetCachedBytes
+    void Unregister();
 private:
+    struct ProfileState;
+    void RecordProfile(size_t num_bytes, bool gpu, bool allocate) const;
+    std::unique_ptr<ProfileState> profile_state;
     std::string name;
+    mutable boost::mutex name_mtx;
+    mutable std::atomic<size_t> bytes_in_use;
+    mutable std::atomic<size_t> peak_bytes;
+    mutable std::atomic<size_t> allocations;
+    mutable std::atomic<size_t> deallocations;
+    mutable std::atomic<size_t> pool_hits;
+    mutable std::atomic<size_t> pool_misses;
 };
 
 /// ========================================================
@@ -130,9 +223,14 @@ public:
      * \return current estimated memory usage
      */
     inline size_t GetMemoryUsage() const;
+    /*!
+     * \brief GetCachedBytes
+     * \return freed memory that the policy holds on to for reuse
+     */
+    virtual size_t GetCachedBytes() const { return 0; }
     virtual void Release() {}
 protected:
-    size_t memoryUsage;
+    std::atomic<size_t> memoryUsage{0};
     /*!
      * \brief current_allocations keeps track of the stacks allocated by allocate(size_t)
      *        since a call to free(unsigned char*) will not return the size of the allocated
@@ -159,6 +257,7 @@ class MO_EXPORTS PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>
         , public virtual PaddingPolicy
 {
 public:
+    typedef cv::cuda::GpuMat MatType;
     PoolPolicy(size_t initialBlockSize = 1e7);
 
     inline bool allocate(cv::cuda::GpuMat* mat, int rows, int cols, size_t elemSize);
@@ -166,9 +265,13 @@ public:
 
     inline unsigned char* allocate(size_t num_bytes);
     inline void deallocate(unsigned char* ptr, size_t num_bytes);
+    size_t GetCachedBytes() const;
     virtual void Release();
+    // Grows the pool to the peak bytes of the histogram
+    void Reserve(const AllocationHistogram& histogram);
 private:
     size_t _initial_block_size;
+    std::atomic<size_t> reservedBytes;
     std::list<std::shared_ptr<GpuMemoryBlock>> blocks;
 };
 
@@ -183,6 +286,7 @@ public:
     uchar* allocate(size_t num_bytes);
     void deallocate(uchar* ptr, size_t num_bytes);
     void Release() {}
+    void Reserve(const AllocationHistogram& histogram);
 };
 
 class MO_EXPORTS mt_CpuPoolPolicy : virtual public CpuPoolPolicy
@@ -194,6 +298,7 @@ public:
     void deallocate(cv::UMatData* data) const;
     uchar* allocate(size_t num_bytes);
     void deallocate(uchar* ptr, size_t num_bytes);
+    void Reserve(const AllocationHistogram& histogram);
 };
 class MO_EXPORTS PinnedAllocator : virtual public cv::MatAllocator
 {
@@ -220,28 +325,39 @@ template<typename PaddingPolicy>
 class MO_EXPORTS StackPolicy<cv::cuda::GpuMat, PaddingPolicy>
         : public virtual AllocationPolicy
         , public virtual PaddingPolicy
+        , public ITrimmable
 {
 public:
     typedef cv::cuda::GpuMat MatType;
     StackPolicy();
+    ~StackPolicy();
     bool allocate(cv::cuda::GpuMat* mat, int rows, int cols, size_t elemSize);
     void free(cv::cuda::GpuMat* mat);
 
     unsigned char* allocate(size_t num_bytes);
     void deallocate(unsigned char* ptr, size_t num_bytes);
     virtual void Release();
+    // Caches the peak count of blocks of every size in the histogram
+    void Reserve(const AllocationHistogram& histogram);
+    // Called by the MemoryTrimmer thread, frees blocks that have not been reused
+    size_t Trim(std::chrono::milliseconds max_age, size_t bytes);
+    size_t GetCachedBytes() const;
 protected:
-    void clear();
+    typedef std::chrono::steady_clock clock_type;
+    void release(const clock_type::time_point& now);
     struct FreeMemory
     {
-        FreeMemory(unsigned char* ptr_, clock_t time_, size_t size_):
+        FreeMemory(unsigned char* ptr_, clock_type::time_point time_, size_t size_):
             ptr(ptr_), free_time(time_), size(size_){}
         unsigned char* ptr;
-        clock_t free_time;
+        clock_type::time_point free_time;
         size_t size;
     };
+    // Guards deallocateList against the trimmer thread
+    mutable boost::mutex list_mtx;
     std::list<FreeMemory> deallocateList;
-    size_t deallocateDelay; // ms
+    size_t cachedBytes;
+    int device;
 };
 
 
@@ -259,6 +375,7 @@ public:
     void deallocate(cv::UMatData* data) const;
     void deallocate(uchar* ptr, size_t total);
     void Release(){}
+    void Reserve(const AllocationHistogram& histogram);
 };
 
 class MO_EXPORTS mt_CpuStackPolicy: virtual public CpuStackPolicy
@@ -271,6 +388,7 @@ public:
     uchar* allocate(size_t total);
     bool deallocate(uchar* ptr, size_t total);
     void deallocate(cv::UMatData* data) const;
+    void Reserve(const AllocationHistogram& histogram);
 };
 
 
@@ -291,6 +409,8 @@ public:
     void free(cv::cuda::GpuMat* mat);
     unsigned char* allocate(size_t num_bytes);
     void deallocate(unsigned char* ptr, size_t num_bytes);
+    // Nothing is cached, so there is nothing to reserve
+    void Reserve(const AllocationHistogram& histogram) {}
 };
 
 template<class Allocator, class MatType>
@@ -306,6 +426,7 @@ public:
 
     inline unsigned char* allocate(size_t num_bytes);
     inline void deallocate(unsigned char* ptr, size_t num_bytes);
+    inline void Reserve(const AllocationHistogram& histogram);
 private:
     boost::mutex mtx;
 };
@@ -321,6 +442,7 @@ public:
     void deallocate(cv::UMatData* data) const;
     inline unsigned char* allocate(size_t num_bytes);
     inline void deallocate(unsigned char* ptr, size_t num_bytes);
+    inline void Reserve(const AllocationHistogram& histogram);
 private:
     boost::mutex mtx;
 };
@@ -368,15 +490,70 @@ private:
     int ref_count = 0;
 };
 
+/*!
+ * \brief The CpuMemoryPoolStatistics struct reports how requests to a
+ *        CpuMemoryPool were served.  Requests served from a thread's cache
+ *        never take the pool lock, everything else goes to the shared pool.
+ */
+struct MO_EXPORTS CpuMemoryPoolStatistics
+{
+    size_t cache_hits = 0;       // allocations served from a thread cache
+    size_t cache_refills = 0;    // batched trips to the shared pool to refill a thread cache
+    size_t cache_flushes = 0;    // batched trips to the shared pool to return cached blocks
+    size_t pool_allocations = 0; // allocations too large to be cached
+    size_t pool_deallocations = 0;
+    size_t remote_deallocations = 0; // frees from other threads queued for a thread pool
+    size_t remote_drains = 0;        // times the owning thread returned queued frees to its blocks
+};
+
 class MO_EXPORTS CpuMemoryPool
 {
 public:
     virtual ~CpuMemoryPool() {}
     static CpuMemoryPool* GlobalInstance();
+    /*!
+     * \brief ThreadInstance returns the calling thread's pool.  Memory from it
+     *        may be freed on any thread: frees from other threads are pushed on
+     *        a lock free list that the owner drains on its next allocation.
+     *        The pool outlives its thread until all of its memory is freed.
+     */
     static CpuMemoryPool* ThreadInstance();
+    /*!
+     * \brief NodeInstance returns a thread safe pool whose blocks are placed on
+     *        the given NUMA node, see SetThreadNumaNode.  Returns the global
+     *        instance for a negative node or a machine without NUMA.
+     */
+    static CpuMemoryPool* NodeInstance(int node);
+    /*!
+     * \brief FindNodeInstance returns the node pool that ptr was allocated from,
+     *        or nullptr if it was not allocated from a node pool.  Lock free.
+     */
+    static CpuMemoryPool* FindNodeInstance(const void* ptr);
+    /*!
+     * \brief FindInstance returns the pool that ptr was allocated from, or
+     *        nullptr if it was not allocated from a CpuMemoryPool.  Lock free.
+     */
+    static CpuMemoryPool* FindInstance(const void* ptr);
     virtual bool allocate(void** ptr, size_t total, size_t elemSize) = 0;
     virtual uchar* allocate(size_t total) = 0;
     virtual bool deallocate(void* ptr, size_t total) = 0;
+    // Grows the pool to at least bytes of prefaulted blocks
+    virtual void Reserve(size_t bytes) {}
+    virtual CpuMemoryPoolStatistics GetStatistics() const { return CpuMemoryPoolStatistics(); }
+};
+
+/*!
+ * \brief The CpuMemoryStackStatistics struct reports how often a CpuMemoryStack
+ *        was able to reuse a cached block instead of allocating a new one.
+ */
+struct MO_EXPORTS CpuMemoryStackStatistics
+{
+    size_t reused = 0;       // allocations served from a size class free stack
+    size_t allocated = 0;    // allocations that required a new block from the host backend
+    size_t released = 0;     // cached blocks returned to the host backend
+    size_t reserved = 0;     // blocks created ahead of time by Reserve
+    size_t cached_bytes = 0; // bytes currently held on free stacks
+    size_t remote_deallocations = 0; // blocks freed on another thread and returned to this stack
 };
 
 class MO_EXPORTS CpuMemoryStack
@@ -388,6 +565,51 @@ public:
     virtual bool allocate(void** ptr, size_t total, size_t elemSize) = 0;
     virtual uchar* allocate(size_t total) = 0;
     virtual bool deallocate(void* ptr, size_t total) = 0;
+    /*!
+     * \brief SetMaxWaste sets how much larger than the request a reused block
+     *        may be, ie 0.125 allows a block of up to 1.125 * total bytes to
+     *        serve a request.  Smaller values create more size classes.
+     */
+    virtual void SetMaxWaste(double ratio) = 0;
+    /*!
+     * \brief Reserve caches prefaulted blocks until count blocks that can serve
+     *        a request of total bytes exist, counting the ones in use
+     */
+    virtual void Reserve(size_t total, size_t count) = 0;
+    /*!
+     * \brief Evict releases the least recently used cached blocks until at
+     *        least bytes were released or the stack is empty
+     * \return number of bytes released
+     */
+    virtual size_t Evict(size_t bytes) = 0;
+    virtual CpuMemoryStackStatistics GetStatistics() const = 0;
+};
+
+/*!
+ * \brief The MatHeaderPoolStatistics struct reports how many cv::UMatData
+ *        headers were recycled instead of going through the general heap.
+ */
+struct MO_EXPORTS MatHeaderPoolStatistics
+{
+    size_t allocations = 0;        // headers handed out to mat allocators
+    size_t deallocations = 0;      // headers returned by mat allocators
+    size_t heap_allocations = 0;   // headers that had to be created with operator new
+    size_t heap_deallocations = 0; // headers deleted because the shared depot was full
+    size_t cached = 0;             // headers held by the shared depot
+};
+
+/*!
+ * \brief The MatHeaderPool class recycles the cv::UMatData headers created by
+ *        the mo CPU mat allocators.  Each thread keeps a small cache of
+ *        headers and exchanges batches with a shared depot, so a header can be
+ *        freed on a different thread than the one it was allocated on.
+ */
+class MO_EXPORTS MatHeaderPool
+{
+public:
+    static cv::UMatData* Allocate(const cv::MatAllocator* allocator);
+    static void Deallocate(cv::UMatData* u);
+    static MatHeaderPoolStatistics GetStatistics();
 };
 
 
@@ -416,6 +638,114 @@ public:
     }
 };
 
+/*!
+ * \brief The BudgetPolicyBase class holds the budget of a BudgetPolicy, the
+ *        budget may be replaced while other threads allocate.  Every charged
+ *        allocation remembers its budget, so that freeing it after the budget
+ *        was replaced still releases the budget it was charged to.
+ */
+class MO_EXPORTS BudgetPolicyBase
+{
+public:
+    BudgetPolicyBase(): num_charges(0){}
+    void SetMemoryBudget(const std::shared_ptr<MemoryBudget>& budget_)
+    {
+        std::atomic_store(&budget, budget_);
+    }
+    std::shared_ptr<MemoryBudget> GetMemoryBudget() const
+    {
+        return std::atomic_load(&budget);
+    }
+protected:
+    // Remembers that the allocation at ptr holds num_bytes of budget_
+    void RecordCharge(const void* ptr, const std::shared_ptr<MemoryBudget>& budget_, size_t num_bytes) const;
+    // Releases the budget the allocation at ptr was charged to, if any
+    void ReleaseCharge(const void* ptr) const;
+private:
+    struct Charge
+    {
+        std::shared_ptr<MemoryBudget> budget;
+        size_t num_bytes;
+    };
+    std::shared_ptr<MemoryBudget> budget;
+    mutable boost::mutex charge_mtx;
+    mutable std::unordered_map<const void*, Charge> charges;
+    // Lets frees skip the lock while nothing is charged
+    mutable std::atomic<size_t> num_charges;
+};
+
+// Sets the budget of allocators built with a BudgetPolicy, ignored by the others
+template<class T>
+void SetPolicyMemoryBudget(T* allocator, const std::shared_ptr<MemoryBudget>& budget,
+                           typename std::enable_if<std::is_base_of<BudgetPolicyBase, T>::value, void>::type* = 0)
+{
+    static_cast<BudgetPolicyBase*>(allocator)->SetMemoryBudget(budget);
+}
+template<class T>
+void SetPolicyMemoryBudget(T* allocator, const std::shared_ptr<MemoryBudget>& budget,
+                           typename std::enable_if<!std::is_base_of<BudgetPolicyBase, T>::value, void>::type* = 0)
+{
+}
+template<class T>
+std::shared_ptr<MemoryBudget> GetPolicyMemoryBudget(const T* allocator,
+                           typename std::enable_if<std::is_base_of<BudgetPolicyBase, T>::value, void>::type* = 0)
+{
+    return static_cast<const BudgetPolicyBase*>(allocator)->GetMemoryBudget();
+}
+template<class T>
+std::shared_ptr<MemoryBudget> GetPolicyMemoryBudget(const T* allocator,
+                           typename std::enable_if<!std::is_base_of<BudgetPolicyBase, T>::value, void>::type* = 0)
+{
+    return std::shared_ptr<MemoryBudget>();
+}
+
+template<class Allocator, class MatType>
+class BudgetPolicyImpl: public Allocator{};
+
+template<class Allocator>
+class BudgetPolicyImpl<Allocator, cv::cuda::GpuMat>: public Allocator, public BudgetPolicyBase
+{
+public:
+    typedef cv::cuda::GpuMat MatType;
+    inline bool allocate(cv::cuda::GpuMat* mat, int rows, int cols, size_t elemSize);
+    inline void free(cv::cuda::GpuMat* mat);
+
+    inline unsigned char* allocate(size_t num_bytes);
+    inline void deallocate(unsigned char* ptr, size_t num_bytes);
+private:
+    // Releases cached blocks of the wrapped allocator
+    size_t Evict(size_t bytes);
+};
+
+template<class Allocator>
+class BudgetPolicyImpl<Allocator, cv::Mat>: public Allocator, public BudgetPolicyBase
+{
+public:
+    typedef cv::Mat MatType;
+    cv::UMatData* allocate(int dims, const int* sizes, int type,
+        void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const;
+    bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const;
+    void deallocate(cv::UMatData* data) const;
+    inline unsigned char* allocate(size_t num_bytes);
+    inline void deallocate(unsigned char* ptr, size_t num_bytes);
+private:
+    // Releases cached blocks of the calling thread's CpuMemoryStack, then of the global one
+    static size_t Evict(size_t bytes);
+};
+
+/*!
+ * \brief The BudgetPolicy class charges every allocation of the given
+ *        allocator to a MemoryBudget, see MemoryBudget for what happens when
+ *        the budget is exceeded.  Without a budget it only forwards.  Place it
+ *        outside of a LockPolicy so that an allocation blocked on the budget
+ *        does not hold the lock the frees it waits for need.
+ */
+template<class Allocator>
+class MO_EXPORTS BudgetPolicy
+        : public BudgetPolicyImpl<Allocator, typename Allocator::MatType>
+{
+};
+
 template<class SmallAllocator, class LargeAllocator, class MatType>
 class MO_EXPORTS CombinedPolicyImpl
         : virtual public SmallAllocator
@@ -436,7 +766,10 @@ public:
 
     inline unsigned char* allocate(size_t num_bytes);
     inline void deallocate(unsigned char* ptr, size_t num_bytes);
+    size_t GetCachedBytes() const;
     void Release();
+    // Splits the histogram at the threshold
+    void Reserve(const AllocationHistogram& histogram);
 private:
     size_t threshold;
 };
@@ -457,6 +790,7 @@ public:
     inline unsigned char* allocate(size_t num_bytes);
     inline void deallocate(unsigned char* ptr, size_t num_bytes);
     void Release();
+    void Reserve(const AllocationHistogram& histogram);
 private:
     size_t threshold;
 };
@@ -471,11 +805,27 @@ public:
 };
 
 /*!
- * \brief The ScopeDebugPolicy class
+ * \brief The ScopeDebugPolicy class attributes allocations to the scope set
+ *        with SetScopeName.  The GpuMat version tracks every allocation, the
+ *        Mat version only the allocations picked by the ScopeSampler, so it is
+ *        cheap enough to leave on in production.
  */
 template<class Allocator, class MatType>
 class MO_EXPORTS ScopeDebugPolicy: public virtual Allocator{};
 
+template<class Allocator>
+class MO_EXPORTS ScopeDebugPolicy<Allocator, cv::Mat>: public virtual Allocator
+{
+public:
+    typedef cv::Mat MatType;
+    cv::UMatData* allocate(int dims, const int* sizes, int type,
+        void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const;
+    bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const;
+    void deallocate(cv::UMatData* data) const;
+    inline unsigned char* allocate(size_t num_bytes);
+    inline void deallocate(unsigned char* ptr, size_t num_bytes);
+};
+
 template<class Allocator>
 class MO_EXPORTS ScopeDebugPolicy<Allocator, cv::cuda::GpuMat>: public virtual Allocator
 {
@@ -511,7 +861,7 @@ public:
     pointer allocate(size_type n)
     {
         pointer output = nullptr;
-        cudaSafeCall(cudaMallocHost(&output, n*sizeof(pointer)));
+        cudaSafeCall(cudaMallocHost(&output, n*sizeof(T)));
         return output;
     }
 
@@ -522,13 +872,14 @@ public:
 };
 
 
+// Stateless, memory from any instance can be freed by any other
 template<class T> bool operator==(const PinnedStlAllocator<T>& lhs, const PinnedStlAllocator<T>& rhs)
 {
-    return &lhs == &rhs;
+    return true;
 }
 template<class T> bool operator!=(const PinnedStlAllocator<T>& lhs, const PinnedStlAllocator<T>& rhs)
 {
-    return &lhs != &rhs;
+    return false;
 }
 
 // Share pinned pool with CpuPoolPolicy
@@ -557,7 +908,9 @@ public:
 
     void deallocate(pointer ptr, size_type n)
     {
-        CpuMemoryPool::ThreadInstance()->deallocate(ptr, n*sizeof(T));
+        // May be freed on another thread than the one it was allocated on
+        CpuMemoryPool* pool = CpuMemoryPool::FindInstance(ptr);
+        (pool ? pool : CpuMemoryPool::ThreadInstance())->deallocate(ptr, n*sizeof(T));
     }
 };
 
@@ -581,7 +934,7 @@ public:
     pointer allocate(size_type n)
     {
         pointer ptr = nullptr;
-        CpuMemoryPool::GlobalInstance()->allocate(&ptr, n*sizeof(T), sizeof(T));
+        CpuMemoryPool::GlobalInstance()->allocate((void**)&ptr, n*sizeof(T), sizeof(T));
         return ptr;
     }
 
@@ -6,6 +6,7 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/tss.hpp>
 #include <cuda_runtime.h>
+#include <limits>
 namespace mo
 {
 
@@ -65,11 +66,19 @@ void ContinuousPolicy::SizeNeeded(int rows, int cols, int elemSize, size_t& size
     sizeNeeded = stride * rows;
 }
 
+/// ==========================================================
+/// AllocationPolicy
+size_t AllocationPolicy::GetMemoryUsage() const
+{
+    return memoryUsage;
+}
+
 /// ==========================================================
 /// PoolPolicy
 template<typename PaddingPolicy>
 PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>::PoolPolicy(size_t initialBlockSize):
-    _initial_block_size(initialBlockSize)
+    _initial_block_size(initialBlockSize),
+    reservedBytes(initialBlockSize)
 {
     blocks.push_back(std::shared_ptr<GpuMemoryBlock>(new GpuMemoryBlock(_initial_block_size)));
 }
@@ -89,6 +98,7 @@ bool PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(cv::cuda::GpuMat* mat
             mat->step = stride;
             mat->refcount = (int*)cv::fastMalloc(sizeof(int));
             memoryUsage += mat->step*rows;
+            PoolTally::Hit();
             LOG(trace) << "[GPU] Reusing block of size (" << rows << "," << cols << ") "
                        << mat->step * rows / (1024 * 1024) << " MB from memory block. Total usage: "
                        << memoryUsage / (1024 * 1024) << " MB";
@@ -99,6 +109,8 @@ bool PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(cv::cuda::GpuMat* mat
     blocks.push_back(std::shared_ptr<GpuMemoryBlock>(
                          new GpuMemoryBlock(
                              std::max(_initial_block_size / 2, sizeNeeded))));
+    reservedBytes += blocks.back()->Size();
+    PoolTally::Miss();
     LOG(trace) << "[GPU] Expanding memory pool by " <<
                   std::max(_initial_block_size / 2, sizeNeeded) / (1024 * 1024)
                << " MB";
@@ -142,12 +154,14 @@ unsigned char* PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(size_t size
         if (ptr)
         {
             memoryUsage += sizeNeeded;
-
+            PoolTally::Hit();
             return ptr;
         }
     }
     // If we get to this point, then no memory was found, need to allocate new memory
     blocks.push_back(std::shared_ptr<GpuMemoryBlock>(new GpuMemoryBlock(std::max(_initial_block_size / 2, sizeNeeded))));
+    reservedBytes += blocks.back()->Size();
+    PoolTally::Miss();
     LOG(trace) << "[GPU] Expanding memory pool by "
                << std::max(_initial_block_size / 2, sizeNeeded) / (1024 * 1024)
                << " MB";
@@ -167,28 +181,55 @@ void PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>::deallocate(unsigned char* ptr,
     {
         if (itr->deAllocate(ptr))
         {
+            memoryUsage -= num_bytes;
             return;
         }
     }
 }
 
+template<typename PaddingPolicy>
+size_t PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>::GetCachedBytes() const
+{
+    // Read without the pool lock, so clamp the estimate
+    const size_t reserved = reservedBytes;
+    const size_t used = memoryUsage;
+    return reserved > used ? reserved - used : 0;
+}
+
 template<typename PaddingPolicy>
 void PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>::Release()
 {
     blocks.clear();
+    reservedBytes = 0;
+}
+
+template<typename PaddingPolicy>
+void PoolPolicy<cv::cuda::GpuMat, PaddingPolicy>::Reserve(const AllocationHistogram& histogram)
+{
+    if(histogram.peak_bytes <= reservedBytes)
+        return;
+    const size_t size = histogram.peak_bytes - reservedBytes;
+    blocks.push_back(std::shared_ptr<GpuMemoryBlock>(new GpuMemoryBlock(size)));
+    reservedBytes += blocks.back()->Size();
+    LOG(debug) << "[GPU] Reserved " << size / (1024 * 1024) << " MB from the allocation profile";
 }
 
 
 /// ==========================================================
 /// StackPolicy
 template<typename PaddingPolicy>
-StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::StackPolicy()
+StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::StackPolicy():
+    cachedBytes(0),
+    device(0)
 {
-#ifdef _MSC_VER
-    deallocateDelay = 1000;
-#else
-    deallocateDelay = 1000*1000;
-#endif
+    cudaGetDevice(&device);
+    MemoryTrimmer::Instance()->Register(this);
+}
+
+template<typename PaddingPolicy>
+StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::~StackPolicy()
+{
+    MemoryTrimmer::Instance()->Unregister(this);
 }
 
 template<typename PaddingPolicy>
@@ -197,19 +238,25 @@ bool StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(
 {
     size_t sizeNeeded, stride;
     PaddingPolicy::SizeNeeded(rows, cols, elemSize, sizeNeeded, stride);
-    for (auto itr = deallocateList.begin(); itr != deallocateList.end(); ++itr)
     {
-        if(itr->size == sizeNeeded)
+        boost::mutex::scoped_lock lock(list_mtx);
+        for (auto itr = deallocateList.begin(); itr != deallocateList.end(); ++itr)
         {
-            mat->data = itr->ptr;
-            mat->step = stride;
-            mat->refcount = (int*)cv::fastMalloc(sizeof(int));
-            deallocateList.erase(itr);
-            LOG(trace) << "[GPU] Reusing block of size (" << rows << "," << cols << ") "
-                       << mat->step * rows / (1024 * 1024) << " MB. total usage: " << memoryUsage / (1024 * 1024) << " MB";
-            return true;
+            if(itr->size == sizeNeeded)
+            {
+                mat->data = itr->ptr;
+                mat->step = stride;
+                mat->refcount = (int*)cv::fastMalloc(sizeof(int));
+                cachedBytes -= itr->size;
+                deallocateList.erase(itr);
+                PoolTally::Hit();
+                LOG(trace) << "[GPU] Reusing block of size (" << rows << "," << cols << ") "
+                           << mat->step * rows / (1024 * 1024) << " MB. total usage: " << memoryUsage / (1024 * 1024) << " MB";
+                return true;
+            }
         }
     }
+    PoolTally::Miss();
     if (rows > 1 && cols > 1)
     {
         CV_CUDEV_SAFE_CALL(cudaMallocPitch(&mat->data, &mat->step, elemSize * cols, rows));
@@ -233,26 +280,35 @@ void StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::free(cv::cuda::GpuMat* mat)
     this->memoryUsage -= mat->rows*mat->step;
     LOG(trace) << "[GPU] Releasing mat of size (" << mat->rows << ","
                << mat->cols << ") " << (mat->dataend - mat->datastart)/(1024*1024) << " MB to the memory pool";
-    deallocateList.emplace_back(mat->data, clock(), mat->dataend - mat->datastart);
+    {
+        boost::mutex::scoped_lock lock(list_mtx);
+        deallocateList.emplace_back(mat->data, clock_type::now(), mat->dataend - mat->datastart);
+        cachedBytes += mat->dataend - mat->datastart;
+    }
     cv::fastFree(mat->refcount);
-    clear();
 }
 
 template<typename PaddingPolicy>
 unsigned char* StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(size_t sizeNeeded)
 {
     unsigned char* ptr = nullptr;
-    for (auto itr = deallocateList.begin(); itr != deallocateList.end(); ++itr)
     {
-        if (itr->size == sizeNeeded)
+        boost::mutex::scoped_lock lock(list_mtx);
+        for (auto itr = deallocateList.begin(); itr != deallocateList.end(); ++itr)
         {
-            ptr = itr->ptr;
-            deallocateList.erase(itr);
-            memoryUsage += sizeNeeded;
-            current_allocations[ptr] = sizeNeeded;
-            return ptr;
+            if (itr->size == sizeNeeded)
+            {
+                ptr = itr->ptr;
+                cachedBytes -= itr->size;
+                deallocateList.erase(itr);
+                memoryUsage += sizeNeeded;
+                current_allocations[ptr] = sizeNeeded;
+                PoolTally::Hit();
+                return ptr;
+            }
         }
     }
+    PoolTally::Miss();
     CV_CUDEV_SAFE_CALL(cudaMalloc(&ptr, sizeNeeded));
     this->memoryUsage += sizeNeeded;
     current_allocations[ptr] = sizeNeeded;
@@ -265,38 +321,98 @@ void StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::deallocate(unsigned char* ptr
     auto itr = current_allocations.find(ptr);
     if(itr != current_allocations.end())
     {
+        const size_t size = itr->second;
         current_allocations.erase(itr);
-        deallocateList.emplace_back(ptr, clock(), current_allocations[ptr]);
+        this->memoryUsage -= size;
+        boost::mutex::scoped_lock lock(list_mtx);
+        deallocateList.emplace_back(ptr, clock_type::now(), size);
+        cachedBytes += size;
+    }
+}
+
+template<typename PaddingPolicy>
+size_t StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::Trim(std::chrono::milliseconds max_age, size_t bytes)
+{
+    boost::mutex::scoped_lock lock(list_mtx);
+    const auto now = clock_type::now();
+    size_t released = 0;
+    // The list is in release order, so the front is the least recently used block
+    while(!deallocateList.empty() &&
+          (now - deallocateList.front().free_time > max_age || released < bytes))
+    {
+        if(released == 0)
+        {
+            // The trimmer thread does not inherit the device of the allocating thread
+            CV_CUDEV_SAFE_CALL(cudaSetDevice(device));
+        }
+        released += deallocateList.front().size;
+        release(now);
     }
+    return released;
+}
 
-    clear();
+template<typename PaddingPolicy>
+size_t StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::GetCachedBytes() const
+{
+    boost::mutex::scoped_lock lock(list_mtx);
+    return cachedBytes;
+}
+
+template<typename PaddingPolicy>
+void StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::release(const clock_type::time_point& now)
+{
+    const FreeMemory& block = deallocateList.front();
+    LOG(trace) << "[GPU] Deallocating block of size " << block.size /(1024*1024)
+               << "MB. Which was stale for "
+               << std::chrono::duration_cast<std::chrono::milliseconds>(now - block.free_time).count() << " ms";
+    CV_CUDEV_SAFE_CALL(cudaFree(block.ptr));
+    cachedBytes -= block.size;
+    deallocateList.pop_front();
 }
 
 template<typename PaddingPolicy>
-void StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::clear()
+void StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::Reserve(const AllocationHistogram& histogram)
 {
-    auto time = clock();
-    for (auto itr = deallocateList.begin(); itr != deallocateList.end(); ++itr)
+    size_t reserved = 0;
+    for(const auto& count : histogram.peak_counts)
     {
-        if((time - itr->free_time) > deallocateDelay)
+        size_t existing = 0;
+        for(const auto& itr : current_allocations)
         {
-            memoryUsage -= itr->size;
-            LOG(trace) << "[GPU] Deallocating block of size " << itr->size /(1024*1024)
-                       << "MB. Which was stale for " << time - itr->free_time << " ms";
-            CV_CUDEV_SAFE_CALL(cudaFree(itr->ptr));
-            itr = deallocateList.erase(itr);
+            if(itr.second == count.first)
+                ++existing;
         }
+        boost::mutex::scoped_lock lock(list_mtx);
+        for(const auto& itr : deallocateList)
+        {
+            if(itr.size == count.first)
+                ++existing;
+        }
+        for(; existing < count.second; ++existing)
+        {
+            unsigned char* ptr = nullptr;
+            CV_CUDEV_SAFE_CALL(cudaMalloc(&ptr, count.first));
+            deallocateList.emplace_back(ptr, clock_type::now(), count.first);
+            cachedBytes += count.first;
+            reserved += count.first;
+        }
+    }
+    if(reserved)
+    {
+        LOG(debug) << "[GPU] Reserved " << reserved / (1024 * 1024) << " MB of blocks from the allocation profile";
     }
 }
 
 template<typename PaddingPolicy>
 void StackPolicy<cv::cuda::GpuMat, PaddingPolicy>::Release()
 {
+    boost::mutex::scoped_lock lock(list_mtx);
     for(auto& itr : deallocateList)
     {
         CV_CUDEV_SAFE_CALL(cudaFree(itr.ptr));
     }
     deallocateList.clear();
+    cachedBytes = 0;
 }
 
 /// ==========================================================
@@ -307,6 +423,7 @@ bool NonCachingPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(
 {
     size_t size_needed, stride;
     PaddingPolicy::SizeNeeded(rows, cols, elemSize, size_needed, stride);
+    PoolTally::Miss();
     if (rows > 1 && cols > 1)
     {
         CV_CUDEV_SAFE_CALL(cudaMallocPitch(&mat->data, &mat->step, elemSize * cols, rows));
@@ -331,6 +448,7 @@ bool NonCachingPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(
 template<typename PaddingPolicy>
 void NonCachingPolicy<cv::cuda::GpuMat, PaddingPolicy>::free(cv::cuda::GpuMat* mat)
 {
+    memoryUsage -= mat->step*mat->rows;
     CV_CUDEV_SAFE_CALL(cudaFree(mat->data));
     cv::fastFree(mat->refcount);
 }
@@ -339,6 +457,7 @@ template<typename PaddingPolicy>
 unsigned char* NonCachingPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(size_t num_bytes)
 {
     unsigned char* ptr = nullptr;
+    PoolTally::Miss();
     CV_CUDEV_SAFE_CALL(cudaMalloc(&ptr, num_bytes));
     memoryUsage += num_bytes;
     return ptr;
@@ -347,6 +466,7 @@ unsigned char* NonCachingPolicy<cv::cuda::GpuMat, PaddingPolicy>::allocate(size_
 template<typename PaddingPolicy>
 void NonCachingPolicy<cv::cuda::GpuMat, PaddingPolicy>::deallocate(unsigned char* ptr, size_t num_bytes)
 {
+    memoryUsage -= num_bytes;
     CV_CUDEV_SAFE_CALL(cudaFree(ptr));
 }
 
@@ -381,6 +501,13 @@ void LockPolicyImpl<Allocator, cv::cuda::GpuMat>::deallocate(unsigned char* ptr,
     return Allocator::deallocate(ptr, num_bytes);
 }
 
+template<class Allocator>
+void LockPolicyImpl<Allocator, cv::cuda::GpuMat>::Reserve(const AllocationHistogram& histogram)
+{
+    boost::mutex::scoped_lock lock(mtx);
+    Allocator::Reserve(histogram);
+}
+
 template<class Allocator>
 cv::UMatData* LockPolicyImpl<Allocator, cv::Mat>::allocate(int dims, const int* sizes, int type,
     void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
@@ -413,6 +540,186 @@ void LockPolicyImpl<Allocator, cv::Mat>::deallocate(unsigned char* ptr, size_t n
     boost::mutex::scoped_lock lock(mtx);
     return Allocator::deallocate(ptr, num_bytes);
 }
+
+template<class Allocator>
+void LockPolicyImpl<Allocator, cv::Mat>::Reserve(const AllocationHistogram& histogram)
+{
+    boost::mutex::scoped_lock lock(mtx);
+    Allocator::Reserve(histogram);
+}
+/// ==========================================================
+/// BudgetPolicy
+template<class T>
+size_t EvictCachedBlocks(T* allocator, size_t bytes,
+                         typename std::enable_if<std::is_base_of<ITrimmable, T>::value, void>::type* = 0)
+{
+    // Only blocks unused for a day go by age, the rest least recently used first
+    return static_cast<ITrimmable*>(allocator)->Trim(std::chrono::hours(24), bytes);
+}
+template<class T>
+size_t EvictCachedBlocks(T* allocator, size_t bytes,
+                         typename std::enable_if<!std::is_base_of<ITrimmable, T>::value, void>::type* = 0)
+{
+    return 0;
+}
+
+template<class Allocator>
+bool BudgetPolicyImpl<Allocator, cv::cuda::GpuMat>::allocate(cv::cuda::GpuMat* mat, int rows, int cols, size_t elemSize)
+{
+    std::shared_ptr<MemoryBudget> budget = GetMemoryBudget();
+    if(!budget)
+        return Allocator::allocate(mat, rows, cols, elemSize);
+    // The pitch is only known after allocating, the padding is charged afterwards
+    const size_t requested = rows * cols * elemSize;
+    budget->Acquire(requested, [this](size_t bytes) { return Evict(bytes); });
+    bool allocated = false;
+    try
+    {
+        allocated = Allocator::allocate(mat, rows, cols, elemSize);
+    }catch(...)
+    {
+        budget->Release(requested);
+        throw;
+    }
+    if(!allocated)
+    {
+        budget->Release(requested);
+        return false;
+    }
+    const size_t size = mat->step * rows;
+    if(size > requested)
+        budget->Charge(size - requested);
+    else
+        budget->Release(requested - size);
+    RecordCharge(mat->datastart, budget, size);
+    return true;
+}
+
+template<class Allocator>
+void BudgetPolicyImpl<Allocator, cv::cuda::GpuMat>::free(cv::cuda::GpuMat* mat)
+{
+    ReleaseCharge(mat->datastart);
+    Allocator::free(mat);
+}
+
+template<class Allocator>
+unsigned char* BudgetPolicyImpl<Allocator, cv::cuda::GpuMat>::allocate(size_t num_bytes)
+{
+    std::shared_ptr<MemoryBudget> budget = GetMemoryBudget();
+    if(!budget)
+        return Allocator::allocate(num_bytes);
+    budget->Acquire(num_bytes, [this](size_t bytes) { return Evict(bytes); });
+    unsigned char* ptr = nullptr;
+    try
+    {
+        ptr = Allocator::allocate(num_bytes);
+    }catch(...)
+    {
+        budget->Release(num_bytes);
+        throw;
+    }
+    if(ptr == nullptr)
+        budget->Release(num_bytes);
+    else
+        RecordCharge(ptr, budget, num_bytes);
+    return ptr;
+}
+
+template<class Allocator>
+void BudgetPolicyImpl<Allocator, cv::cuda::GpuMat>::deallocate(unsigned char* ptr, size_t num_bytes)
+{
+    ReleaseCharge(ptr);
+    Allocator::deallocate(ptr, num_bytes);
+}
+
+template<class Allocator>
+size_t BudgetPolicyImpl<Allocator, cv::cuda::GpuMat>::Evict(size_t bytes)
+{
+    return EvictCachedBlocks(static_cast<Allocator*>(this), bytes);
+}
+
+template<class Allocator>
+cv::UMatData* BudgetPolicyImpl<Allocator, cv::Mat>::allocate(int dims, const int* sizes, int type,
+    void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
+{
+    std::shared_ptr<MemoryBudget> budget = GetMemoryBudget();
+    // User data is not allocated by us, so it is not charged
+    if(!budget || data)
+        return Allocator::allocate(dims, sizes, type, data, step, flags, usageFlags);
+    size_t total = CV_ELEM_SIZE(type);
+    for(int i = 0; i < dims; ++i)
+        total *= sizes[i];
+    budget->Acquire(total, &BudgetPolicyImpl::Evict);
+    cv::UMatData* u = nullptr;
+    try
+    {
+        u = Allocator::allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }catch(...)
+    {
+        budget->Release(total);
+        throw;
+    }
+    if(u == nullptr)
+        budget->Release(total);
+    else
+        RecordCharge(u, budget, total);
+    return u;
+}
+
+template<class Allocator>
+bool BudgetPolicyImpl<Allocator, cv::Mat>::allocate(cv::UMatData* data, int accessflags,
+                                                    cv::UMatUsageFlags usageFlags) const
+{
+    return Allocator::allocate(data, accessflags, usageFlags);
+}
+
+template<class Allocator>
+void BudgetPolicyImpl<Allocator, cv::Mat>::deallocate(cv::UMatData* data) const
+{
+    if(data && data->refcount == 0 && !(data->flags & cv::UMatData::USER_ALLOCATED))
+        ReleaseCharge(data);
+    Allocator::deallocate(data);
+}
+
+template<class Allocator>
+unsigned char* BudgetPolicyImpl<Allocator, cv::Mat>::allocate(size_t num_bytes)
+{
+    std::shared_ptr<MemoryBudget> budget = GetMemoryBudget();
+    if(!budget)
+        return Allocator::allocate(num_bytes);
+    budget->Acquire(num_bytes, &BudgetPolicyImpl::Evict);
+    unsigned char* ptr = nullptr;
+    try
+    {
+        ptr = Allocator::allocate(num_bytes);
+    }catch(...)
+    {
+        budget->Release(num_bytes);
+        throw;
+    }
+    if(ptr == nullptr)
+        budget->Release(num_bytes);
+    else
+        RecordCharge(ptr, budget, num_bytes);
+    return ptr;
+}
+
+template<class Allocator>
+void BudgetPolicyImpl<Allocator, cv::Mat>::deallocate(unsigned char* ptr, size_t num_bytes)
+{
+    ReleaseCharge(ptr);
+    Allocator::deallocate(ptr, num_bytes);
+}
+
+template<class Allocator>
+size_t BudgetPolicyImpl<Allocator, cv::Mat>::Evict(size_t bytes)
+{
+    size_t evicted = CpuMemoryStack::ThreadInstance()->Evict(bytes);
+    if(evicted < bytes)
+        evicted += CpuMemoryStack::GlobalInstance()->Evict(bytes - evicted);
+    return evicted;
+}
+
 /// ==========================================================
 /// RefCountPolicy
 
@@ -559,6 +866,50 @@ void ScopeDebugPolicy<Allocator, cv::cuda::GpuMat>::deallocate(unsigned char* pt
     }
 }
 
+template<class Allocator>
+cv::UMatData* ScopeDebugPolicy<Allocator, cv::Mat>::allocate(int dims, const int* sizes, int type,
+    void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
+{
+    cv::UMatData* u = Allocator::allocate(dims, sizes, type, data, step, flags, usageFlags);
+    // The sample rides along in the header, so unsampled frees need no lookup
+    if(u && !(u->flags & cv::UMatData::USER_ALLOCATED))
+        u->userdata = ScopeSampler::Sample(u->size);
+    return u;
+}
+
+template<class Allocator>
+bool ScopeDebugPolicy<Allocator, cv::Mat>::allocate(cv::UMatData* data, int accessflags,
+                                                    cv::UMatUsageFlags usageFlags) const
+{
+    return Allocator::allocate(data, accessflags, usageFlags);
+}
+
+template<class Allocator>
+void ScopeDebugPolicy<Allocator, cv::Mat>::deallocate(cv::UMatData* data) const
+{
+    if(data && data->refcount == 0 && data->userdata)
+    {
+        ScopeSampler::Release(data->userdata);
+        data->userdata = nullptr;
+    }
+    Allocator::deallocate(data);
+}
+
+template<class Allocator>
+unsigned char* ScopeDebugPolicy<Allocator, cv::Mat>::allocate(size_t num_bytes)
+{
+    unsigned char* ptr = Allocator::allocate(num_bytes);
+    ScopeSampler::SamplePointer(ptr, num_bytes);
+    return ptr;
+}
+
+template<class Allocator>
+void ScopeDebugPolicy<Allocator, cv::Mat>::deallocate(unsigned char* ptr, size_t num_bytes)
+{
+    ScopeSampler::ReleasePointer(ptr);
+    Allocator::deallocate(ptr, num_bytes);
+}
+
 template<class SmallAllocator, class LargeAllocator>
 CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::cuda::GpuMat>::CombinedPolicyImpl(size_t threshold_)
     : threshold(threshold_)
@@ -604,6 +955,12 @@ void CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::cuda::GpuMat>::deall
     return SmallAllocator::deallocate(ptr, num_bytes);
 }
 
+template<class SmallAllocator, class LargeAllocator>
+size_t CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::cuda::GpuMat>::GetCachedBytes() const
+{
+    return SmallAllocator::GetCachedBytes() + LargeAllocator::GetCachedBytes();
+}
+
 template<class SmallAllocator, class LargeAllocator>
 void CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::cuda::GpuMat>::Release()
 {
@@ -611,6 +968,13 @@ void CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::cuda::GpuMat>::Relea
     LargeAllocator::Release();
 }
 
+template<class SmallAllocator, class LargeAllocator>
+void CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::cuda::GpuMat>::Reserve(const AllocationHistogram& histogram)
+{
+    SmallAllocator::Reserve(histogram.Range(0, threshold));
+    LargeAllocator::Reserve(histogram.Range(threshold, std::numeric_limits<size_t>::max()));
+}
+
 template<class SmallAllocator, class LargeAllocator>
 CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::Mat>::CombinedPolicyImpl(size_t threshold_):
     threshold(threshold_)
@@ -702,6 +1066,13 @@ void CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::Mat>::Release()
     LargeAllocator::Release();
 }
 
+template<class SmallAllocator, class LargeAllocator>
+void CombinedPolicyImpl<SmallAllocator, LargeAllocator, cv::Mat>::Reserve(const AllocationHistogram& histogram)
+{
+    SmallAllocator::Reserve(histogram.Range(0, threshold));
+    LargeAllocator::Reserve(histogram.Range(threshold, std::numeric_limits<size_t>::max()));
+}
+
 template<class SmallAllocator, class LargeAllocator>
 CombinedPolicy<SmallAllocator, LargeAllocator>::CombinedPolicy(size_t threshold)
     :CombinedPolicyImpl<SmallAllocator, LargeAllocator, typename LargeAllocator::MatType>(threshold)
@@ -716,35 +1087,57 @@ class ConcreteAllocator
         , virtual public mo::Allocator
 {
 public:
+    ~ConcreteAllocator()
+    {
+        Unregister();
+    }
+
     // GpuMat allocate
     bool allocate(cv::cuda::GpuMat* mat, int rows, int cols, size_t elemSize)
     {
-        return GPUAllocator::allocate(mat, rows, cols, elemSize);
+        const PoolTally before = PoolTally::Thread();
+        if(GPUAllocator::allocate(mat, rows, cols, elemSize))
+        {
+            RecordAllocation(mat->data, mat->step * rows, true, before);
+            return true;
+        }
+        return false;
     }
 
     void free(cv::cuda::GpuMat* mat)
     {
+        RecordDeallocation(mat->data, mat->step * mat->rows, true);
         return GPUAllocator::free(mat);
     }
 
     // Thrust allocate
     unsigned char* allocateGpu(size_t num_bytes)
     {
-        return GPUAllocator::allocate(num_bytes);
+        const PoolTally before = PoolTally::Thread();
+        unsigned char* ptr = GPUAllocator::allocate(num_bytes);
+        if(ptr)
+            RecordAllocation(ptr, num_bytes, true, before);
+        return ptr;
     }
 
     void deallocateGpu(unsigned char* ptr, size_t num_bytes)
     {
+        RecordDeallocation(ptr, num_bytes, true);
         return GPUAllocator::deallocate(ptr, num_bytes);
     }
 
     unsigned char* allocateCpu(size_t num_bytes)
     {
-        return CPUAllocator::allocate(num_bytes);
+        const PoolTally before = PoolTally::Thread();
+        unsigned char* ptr = CPUAllocator::allocate(num_bytes);
+        if(ptr)
+            RecordAllocation(ptr, num_bytes, false, before);
+        return ptr;
     }
 
     void deallocateCpu(unsigned char* ptr, size_t num_bytes)
     {
+        RecordDeallocation(ptr, num_bytes, false);
         CPUAllocator::deallocate(ptr, num_bytes);
     }
 
@@ -752,8 +1145,12 @@ public:
     cv::UMatData* allocate(int dims, const int* sizes, int type,
         void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
     {
-        return CPUAllocator::allocate(dims, sizes, type, data,
-                                      step, flags, usageFlags);
+        const PoolTally before = PoolTally::Thread();
+        cv::UMatData* u = CPUAllocator::allocate(dims, sizes, type, data,
+                                                 step, flags, usageFlags);
+        if(u && !(u->flags & cv::UMatData::USER_ALLOCATED))
+            RecordAllocation(u->origdata, u->size, false, before);
+        return u;
     }
 
     bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const
@@ -763,14 +1160,47 @@ public:
 
     void deallocate(cv::UMatData* data) const
     {
+        // The policies only release the data once the last reference is gone
+        if(data && data->refcount == 0 && !(data->flags & cv::UMatData::USER_ALLOCATED))
+            RecordDeallocation(data->origdata, data->size, false);
         CPUAllocator::deallocate(data);
     }
 
+    // CPU memory is cached by the per thread and global stacks and pools
+    // that are shared between allocators, so only GPU caches are reported
+    size_t GetCachedBytes() const
+    {
+        return GPUAllocator::GetCachedBytes();
+    }
+
     void Release()
     {
         CPUAllocator::Release();
         GPUAllocator::Release();
     }
+
+    void Reserve(const AllocationProfile& profile)
+    {
+        CPUAllocator::Reserve(profile.cpu);
+        GPUAllocator::Reserve(profile.gpu);
+    }
+
+    void SetMemoryBudget(const std::shared_ptr<MemoryBudget>& cpu,
+                         const std::shared_ptr<MemoryBudget>& gpu)
+    {
+        SetPolicyMemoryBudget(static_cast<CPUAllocator*>(this), cpu);
+        SetPolicyMemoryBudget(static_cast<GPUAllocator*>(this), gpu);
+    }
+
+    std::shared_ptr<MemoryBudget> GetCpuMemoryBudget() const
+    {
+        return GetPolicyMemoryBudget(static_cast<const CPUAllocator*>(this));
+    }
+
+    std::shared_ptr<MemoryBudget> GetGpuMemoryBudget() const
+    {
+        return GetPolicyMemoryBudget(static_cast<const GPUAllocator*>(this));
+    }
 };
 
 typedef PoolPolicy<cv::cuda::GpuMat, PitchedPolicy>   d_TensorPoolAllocator_t;
@@ -788,14 +1218,17 @@ typedef CpuStackPolicy h_StackAllocator_t;
 typedef mt_CpuPoolPolicy                    h_mt_PoolAllocator_t;
 typedef mt_CpuStackPolicy                   h_mt_StackAllocator_t;
 #ifdef NDEBUG
-typedef CombinedPolicy<d_TensorPoolAllocator_t, d_TextureAllocator_t> d_UniversalAllocator_t;
-typedef LockPolicy<d_UniversalAllocator_t> d_mt_UniversalAllocator_t;
+typedef CombinedPolicy<d_TensorPoolAllocator_t, d_TextureAllocator_t> d_CombinedAllocator_t;
 #else
-typedef RefCountPolicy<CombinedPolicy<d_TensorPoolAllocator_t, d_TextureAllocator_t>> d_UniversalAllocator_t;
-typedef RefCountPolicy<LockPolicy<d_UniversalAllocator_t>> d_mt_UniversalAllocator_t;
+typedef RefCountPolicy<CombinedPolicy<d_TensorPoolAllocator_t, d_TextureAllocator_t>> d_CombinedAllocator_t;
 #endif
-typedef CombinedPolicy<h_PoolAllocator_t, h_StackAllocator_t> h_UniversalAllocator_t;
-typedef LockPolicy<h_UniversalAllocator_t> h_mt_UniversalAllocator_t;
+// The budget is checked outside of the lock, see BudgetPolicy
+typedef BudgetPolicy<d_CombinedAllocator_t> d_UniversalAllocator_t;
+typedef BudgetPolicy<LockPolicy<d_CombinedAllocator_t>> d_mt_UniversalAllocator_t;
+// Sampling is off until ScopeSampler::SetSampleInterval is called
+typedef CombinedPolicy<h_PoolAllocator_t, h_StackAllocator_t> h_CombinedAllocator_t;
+typedef ScopeDebugPolicy<BudgetPolicy<h_CombinedAllocator_t>, cv::Mat> h_UniversalAllocator_t;
+typedef ScopeDebugPolicy<BudgetPolicy<LockPolicy<h_CombinedAllocator_t>>, cv::Mat> h_mt_UniversalAllocator_t;
 
 
 typedef ConcreteAllocator<h_mt_PoolAllocator_t, d_mt_TensorPoolAllocator_t> mt_TensorAllocator_t;
@@ -0,0 +1,136 @@
+#pragma once
+#include "Export.hpp"
+#include <opencv2/core/mat.hpp>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mo
+{
+    class HostMemoryBackend;
+    /*!
+     * \brief The Arena class is a bump allocator for data that only lives for a
+     *        single iteration of a Thread's inner loop.  Allocation advances a
+     *        cursor in the current chunk, deallocation is a no-op and Reset
+     *        rewinds every chunk at once.  When an iteration spilled into more
+     *        than one chunk, Reset replaces them by a single chunk large enough
+     *        for the whole iteration so that steady state work runs out of one
+     *        contiguous block.
+     *        An arena belongs to one mo::Context and is not thread safe.
+     *        Anything allocated from it, including cv::Mat data allocated
+     *        through the cv::MatAllocator interface, must not be used after the
+     *        next Reset.
+     */
+    class MO_EXPORTS Arena : public cv::MatAllocator
+    {
+    public:
+        /*!
+         * \brief Current returns the arena of the default context of the
+         *        calling thread
+         */
+        static Arena* Current();
+
+        Arena(size_t chunk_size = 1 << 20, HostMemoryBackend* backend = nullptr);
+        ~Arena();
+
+        unsigned char* allocate(size_t num_bytes, size_t alignment = 16);
+        void deallocate(unsigned char* ptr, size_t num_bytes) {}
+
+        /*!
+         * \brief Reset releases everything allocated since the last reset.
+         *        Called by Thread::Main after every inner loop iteration.
+         */
+        void Reset();
+
+        size_t GetUsedBytes() const;
+        size_t GetCapacity() const;
+        // largest number of bytes used by a single iteration
+        size_t GetPeakBytes() const;
+        size_t GetResetCount() const;
+        // number of cv::Mat buffers from this arena that have not been released
+        size_t GetLiveMatCount() const;
+
+        // cv::MatAllocator interface
+        cv::UMatData* allocate(int dims, const int* sizes, int type,
+            void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const;
+        bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const;
+        void deallocate(cv::UMatData* data) const;
+    private:
+        struct Chunk
+        {
+            unsigned char* begin;
+            size_t size;
+        };
+        void addChunk(size_t min_size);
+        void releaseChunks();
+
+        HostMemoryBackend* backend;
+        size_t chunk_size;
+        std::vector<Chunk> chunks;
+        size_t current_chunk = 0;
+        size_t offset = 0;
+        // bytes used in chunks before current_chunk, including alignment padding
+        size_t used_before = 0;
+        size_t peak = 0;
+        size_t resets = 0;
+        mutable std::atomic<size_t> live_mats{0};
+    };
+
+    /*!
+     * \brief STL allocator over an Arena, defaults to the arena of the calling
+     *        thread's context.  Containers using it must not outlive the
+     *        current iteration.
+     */
+    template<class T> class ArenaStlAllocator
+    {
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+        template< class U > struct rebind { typedef ArenaStlAllocator<U> other; };
+
+        ArenaStlAllocator(Arena* arena_ = Arena::Current()) : arena(arena_) {}
+        template<class U> ArenaStlAllocator(const ArenaStlAllocator<U>& other) : arena(other.arena) {}
+
+        pointer allocate(size_type n, std::allocator<void>::const_pointer hint)
+        {
+            return allocate(n);
+        }
+
+        pointer allocate(size_type n)
+        {
+            return reinterpret_cast<pointer>(arena->allocate(n * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+        }
+
+        void deallocate(pointer ptr, size_type n)
+        {
+        }
+
+        template<class U, class... Args> void construct(U* ptr, Args&&... args)
+        {
+            ::new((void*)ptr) U(std::forward<Args>(args)...);
+        }
+
+        template<class U> void destroy(U* ptr)
+        {
+            ptr->~U();
+        }
+
+        Arena* arena;
+    };
+
+    template<class T, class U> bool operator==(const ArenaStlAllocator<T>& lhs, const ArenaStlAllocator<U>& rhs)
+    {
+        return lhs.arena == rhs.arena;
+    }
+    template<class T, class U> bool operator!=(const ArenaStlAllocator<T>& lhs, const ArenaStlAllocator<U>& rhs)
+    {
+        return lhs.arena != rhs.arena;
+    }
+}
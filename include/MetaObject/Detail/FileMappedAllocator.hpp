@@ -0,0 +1,70 @@
+#pragma once
+#include "Export.hpp"
+#include <opencv2/core/mat.hpp>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace mo
+{
+    /*!
+     * \brief The FileMappedAllocator class backs mats with memory mapped
+     *        temporary files so that long histories of large frames page
+     *        through the OS file cache instead of being held resident.  Mats
+     *        are carved from a few large sparse chunk files, each mapped once,
+     *        so a history of thousands of frames needs a handful of files and
+     *        mappings instead of one per frame.  Freed ranges give their disk
+     *        blocks back to the file system.  Chunk files are unlinked as soon
+     *        as they are mapped so they disappear with the mapping even if the
+     *        process crashes.  Mappings are advised for sequential access.
+     *        Select it per buffer with IBuffer::SetMatAllocator.  The default
+     *        instance creates its files in the directory named by the
+     *        MO_MAPPED_FILE_DIR environment variable, or the temp directory.
+     *        A directory on tmpfs is memory backed, which defeats paging out,
+     *        so a warning is logged for it.
+     */
+    class MO_EXPORTS FileMappedAllocator : virtual public cv::MatAllocator
+    {
+    public:
+        static FileMappedAllocator* Instance();
+        // Size of the chunk files mats are carved from, larger mats get a file of their own
+        static const size_t ChunkSize = size_t(1) << 30;
+        // An empty directory uses the temp directory
+        FileMappedAllocator(const std::string& directory = "");
+        ~FileMappedAllocator();
+
+        cv::UMatData* allocate(int dims, const int* sizes, int type,
+            void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const;
+        bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const;
+        void deallocate(cv::UMatData* data) const;
+
+        /*!
+         * \brief PageOut drops the resident pages of a mat allocated by a
+         *        FileMappedAllocator (MADV_DONTNEED), the data is read back from
+         *        the file cache or the file on the next access.  Call it once a
+         *        mat is written and will not be read for a while.  Does nothing
+         *        for other mats.
+         */
+        static void PageOut(const cv::Mat& mat);
+        // Bytes of the mats currently allocated by this allocator, not all of them are resident
+        size_t GetMappedBytes() const;
+        // Number of chunk files currently mapped
+        size_t GetChunkCount() const;
+        const std::string& GetDirectory() const;
+    private:
+        struct Chunk;
+        unsigned char* map(size_t size) const;
+        void unmap(unsigned char* ptr, size_t size) const;
+        Chunk* createChunk(size_t size) const;
+        void destroyChunk(Chunk* chunk) const;
+
+        std::string directory;
+        size_t page_size;
+        mutable std::atomic<size_t> mapped_bytes;
+        mutable boost::mutex mtx;
+        // Chunks by the address they are mapped at
+        mutable std::map<unsigned char*, std::unique_ptr<Chunk>> chunks;
+    };
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "Export.hpp"
+#include <cstddef>
+
+namespace mo
+{
+    /*!
+     * \brief The HostMemoryBackend class provides the raw host memory that
+     *        CpuMemoryBlock and the CpuMemoryStack pools sub allocate from.
+     *        The backend is chosen at runtime so that CPU only deployments
+     *        do not need a CUDA device:
+     *        - Pinned_e uses cudaMallocHost, page locked memory for asynchronous transfers
+     *        - Mapped_e uses anonymous page aligned mmap / VirtualAlloc
+     *        - HugePage_e is Mapped_e backed by huge pages, either reserved (MAP_HUGETLB)
+     *          or transparent (madvise MADV_HUGEPAGE) if none are reserved
+     *        The default is read from the MO_HOST_MEMORY environment variable
+     *        ("pinned", "mapped" or "hugepage").  Without it the default is
+     *        pinned if a CUDA device is present and mapped otherwise.
+     */
+    class MO_EXPORTS HostMemoryBackend
+    {
+    public:
+        enum Type
+        {
+            Pinned_e = 0,
+            Mapped_e,
+            HugePage_e
+        };
+        static HostMemoryBackend* Get(Type type);
+        // Backend used by pools created from now on, existing pools keep the backend they were created with
+        static HostMemoryBackend* GetDefault();
+        static void SetDefault(Type type);
+        /*!
+         * \brief Prefault touches every page of [ptr, ptr + size) so that the
+         *        page faults are taken now instead of on first use.  Only call
+         *        it on memory that holds no data.
+         */
+        static void Prefault(unsigned char* ptr, size_t size);
+
+        virtual ~HostMemoryBackend() {}
+        virtual unsigned char* allocate(size_t size) = 0;
+        // Places the memory on the given NUMA node, a negative node is the same as allocate(size)
+        virtual unsigned char* allocateOnNode(size_t size, int node) { return allocate(size); }
+        virtual void deallocate(unsigned char* ptr, size_t size) = 0;
+        virtual Type GetType() const = 0;
+    };
+}
@@ -1,27 +1,40 @@
 #pragma once
 #include "Export.hpp"
+#include <cstddef>
 #include <map>
 
 namespace mo
 {
+    class HostMemoryBackend;
     class MO_EXPORTS GPUMemory
     {
     protected:
         inline void _allocate(unsigned char** data, size_t size);
-        inline void _deallocate(unsigned char* data);
+        inline void _deallocate(unsigned char* data, size_t size);
     };
 
     class MO_EXPORTS CPUMemory
     {
     protected:
         inline void _allocate(unsigned char** data, size_t size);
-        inline void _deallocate(unsigned char* data);
+        inline void _allocate(unsigned char** data, size_t size, int numa_node);
+        inline void _deallocate(unsigned char* data, size_t size);
+        // Backend the block was allocated from, see HostMemoryBackend::GetDefault
+        HostMemoryBackend* backend = nullptr;
     };
 
+    /*!
+     * \brief The MemoryBlock class sub allocates from one large allocation.
+     *        Free space is indexed both by address and by size so that an
+     *        allocation is a best fit lookup in O(log n) and a deallocation
+     *        merges the released range with its free neighbours in O(log n).
+     */
     template<class XPU> class MO_EXPORTS MemoryBlock: public XPU
     {
     public:
         MemoryBlock(size_t size_);
+        // Places the block on a NUMA node, only defined for CpuMemoryBlock
+        MemoryBlock(size_t size_, int numa_node);
         ~MemoryBlock();
         
         unsigned char* allocate(size_t size_, size_t elemSize_);
@@ -29,11 +42,31 @@ namespace mo
         unsigned char* Begin() const;
         unsigned char* End() const;
         size_t Size() const;
+        // Number of bytes not currently handed out
+        size_t FreeBytes() const;
+        // Size of the largest allocation that can currently be served without alignment padding
+        size_t LargestFreeRange() const;
+        /*!
+         * \brief Fragmentation
+         * \return 1 - LargestFreeRange / FreeBytes, 0 when all free memory is
+         *         contiguous and approaching 1 as free memory is split into
+         *         many small ranges
+         */
+        double Fragmentation() const;
     protected:
+        void insertFreeRange(unsigned char* ptr, size_t size);
+        void eraseFreeRange(std::map<unsigned char*, size_t>::iterator itr);
+
         unsigned char* begin;
         unsigned char* end;
         size_t size;
+        size_t free_bytes;
+        // start of allocation -> end of allocation
         std::map<unsigned char*, unsigned char*> allocatedBlocks;
+        // start of free range -> size of free range
+        std::map<unsigned char*, size_t> freeRanges;
+        // size of free range -> start of free range
+        std::multimap<size_t, unsigned char*> freeSizes;
     };
     typedef MemoryBlock<GPUMemory> GpuMemoryBlock;
     typedef MemoryBlock<CPUMemory> CpuMemoryBlock;
@@ -0,0 +1,91 @@
+#pragma once
+#include "Export.hpp"
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace mo
+{
+    /*!
+     * \brief The MemoryBudgetStatistics struct is a snapshot of the counters
+     *        of a MemoryBudget.  Sizes are in bytes.
+     */
+    struct MO_EXPORTS MemoryBudgetStatistics
+    {
+        std::string name;
+        size_t limit = 0;
+        size_t bytes_in_use = 0;  // charged by allocations that were not freed yet
+        size_t peak_bytes = 0;
+        size_t admitted = 0;      // allocations charged to the budget
+        size_t rejected = 0;      // allocations that threw because they did not fit
+        size_t blocked = 0;       // allocations that had to wait for memory to be freed
+        size_t evicted_bytes = 0; // cached memory released to admit allocations over the limit
+    };
+
+    /*!
+     * \brief The MemoryBudget class limits the bytes a context may have in use
+     *        at once, see Context::SetMemoryBudget and BudgetPolicy.  An
+     *        allocation that does not fit is handled according to the action:
+     *        - FailFast_e throws right away
+     *        - Block_e waits up to the timeout for memory charged to the budget
+     *          to be freed, then throws
+     *        - Evict_e releases at least the overshoot from cached stack blocks
+     *          and admits the allocation, so the memory held by the process does
+     *          not grow.  Throws if the caches do not hold enough.
+     *        A budget can be shared by several allocators and is thread safe,
+     *        admissions that fit only touch an atomic counter.
+     */
+    class MO_EXPORTS MemoryBudget
+    {
+    public:
+        enum Action
+        {
+            FailFast_e = 0,
+            Block_e,
+            Evict_e
+        };
+        MemoryBudget(size_t limit, Action action = FailFast_e,
+                     std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                     const std::string& name = "");
+
+        // Lowering the limit below the usage only affects new allocations
+        void SetLimit(size_t bytes);
+        size_t GetLimit() const;
+        Action GetAction() const;
+        size_t GetUsage() const;
+        MemoryBudgetStatistics GetStatistics() const;
+
+        /*!
+         * \brief Acquire charges num_bytes to the budget or throws if they do
+         *        not fit after applying the action
+         * \param evict is called by Evict_e with the overshoot and returns the
+         *        number of cached bytes it released
+         */
+        void Acquire(size_t num_bytes, const std::function<size_t(size_t)>& evict = std::function<size_t(size_t)>());
+        // Charges without admission control, ie for padding only known after allocating
+        void Charge(size_t num_bytes);
+        // Never drops below zero, so memory allocated before the budget was set may be freed
+        void Release(size_t num_bytes);
+    private:
+        bool TryAcquire(size_t num_bytes);
+
+        std::string name;
+        Action action;
+        std::chrono::milliseconds timeout;
+        std::atomic<size_t> limit;
+        std::atomic<size_t> in_use;
+        std::atomic<size_t> peak_bytes;
+        std::atomic<size_t> admitted;
+        std::atomic<size_t> rejected;
+        std::atomic<size_t> blocked;
+        std::atomic<size_t> evicted_bytes;
+        // Frees only take the lock when an allocation is waiting
+        std::atomic<int> waiters;
+        boost::mutex mtx;
+        boost::condition_variable cv;
+    };
+}
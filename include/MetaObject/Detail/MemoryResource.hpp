@@ -0,0 +1,133 @@
+#pragma once
+#include "Export.hpp"
+#include <boost/container/pmr/memory_resource.hpp>
+#include <boost/container/pmr/polymorphic_allocator.hpp>
+#include <string>
+#include <vector>
+
+namespace mo
+{
+    class Arena;
+    class CpuMemoryPool;
+    class CpuMemoryStack;
+
+    /*!
+     * \brief The PoolMemoryResource class allocates from a CpuMemoryPool.
+     *        Memory is returned to the pool it came from, so it may be freed
+     *        on any thread.
+     */
+    class MO_EXPORTS PoolMemoryResource : public boost::container::pmr::memory_resource
+    {
+    public:
+        static PoolMemoryResource* GlobalInstance();
+        // Allocates from the calling thread's pool, see CpuMemoryPool::ThreadInstance
+        static PoolMemoryResource* ThreadInstance();
+
+        // A null pool allocates from the calling thread's pool
+        PoolMemoryResource(CpuMemoryPool* pool = nullptr);
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment);
+        void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment);
+        bool do_is_equal(const boost::container::pmr::memory_resource& other) const BOOST_NOEXCEPT;
+    private:
+        CpuMemoryPool* pool;
+    };
+
+    /*!
+     * \brief The StackMemoryResource class allocates from a CpuMemoryStack,
+     *        which suits large buffers that are repeatedly created with the
+     *        same size.
+     */
+    class MO_EXPORTS StackMemoryResource : public boost::container::pmr::memory_resource
+    {
+    public:
+        static StackMemoryResource* GlobalInstance();
+        // Allocates from the calling thread's stack, see CpuMemoryStack::ThreadInstance
+        static StackMemoryResource* ThreadInstance();
+
+        // A null stack allocates from the calling thread's stack
+        StackMemoryResource(CpuMemoryStack* stack = nullptr);
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment);
+        void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment);
+        bool do_is_equal(const boost::container::pmr::memory_resource& other) const BOOST_NOEXCEPT;
+    private:
+        CpuMemoryStack* stack;
+    };
+
+    /*!
+     * \brief The ArenaMemoryResource class allocates from an Arena, so the
+     *        memory is released by the arena's next Reset rather than by
+     *        deallocate.
+     */
+    class MO_EXPORTS ArenaMemoryResource : public boost::container::pmr::memory_resource
+    {
+    public:
+        // Allocates from the arena of the calling thread's context, see Arena::Current
+        static ArenaMemoryResource* ThreadInstance();
+
+        // A null arena allocates from the arena of the calling thread's context
+        ArenaMemoryResource(Arena* arena = nullptr);
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment);
+        void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment);
+        bool do_is_equal(const boost::container::pmr::memory_resource& other) const BOOST_NOEXCEPT;
+    private:
+        Arena* arena;
+    };
+
+    /*!
+     * \brief GetThreadMemoryResource returns the memory resource selected by
+     *        the calling thread's default context, see Context::memory_resource
+     */
+    MO_EXPORTS boost::container::pmr::memory_resource* GetThreadMemoryResource();
+
+    /*!
+     * \brief The PolymorphicAllocator class is a polymorphic allocator that
+     *        defaults to the memory resource of the calling thread's context
+     *        instead of the process wide default resource, including when a
+     *        container is copied.
+     */
+    template<class T> class PolymorphicAllocator : public boost::container::pmr::polymorphic_allocator<T>
+    {
+    public:
+        typedef boost::container::pmr::polymorphic_allocator<T> Base;
+        template< class U > struct rebind { typedef PolymorphicAllocator<U> other; };
+
+        PolymorphicAllocator():
+            Base(GetThreadMemoryResource())
+        {
+        }
+
+        PolymorphicAllocator(boost::container::pmr::memory_resource* resource):
+            Base(resource)
+        {
+        }
+
+        template<class U> PolymorphicAllocator(const PolymorphicAllocator<U>& other):
+            Base(other.resource())
+        {
+        }
+
+        PolymorphicAllocator select_on_container_copy_construction() const
+        {
+            return PolymorphicAllocator();
+        }
+    };
+
+    template<class T, class U> bool operator==(const PolymorphicAllocator<T>& lhs, const PolymorphicAllocator<U>& rhs)
+    {
+        return *lhs.resource() == *rhs.resource();
+    }
+    template<class T, class U> bool operator!=(const PolymorphicAllocator<T>& lhs, const PolymorphicAllocator<U>& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+    namespace pmr
+    {
+        // Containers that allocate from the memory resource of the context they are created on
+        template<class T> using vector = std::vector<T, PolymorphicAllocator<T>>;
+        typedef std::basic_string<char, std::char_traits<char>, PolymorphicAllocator<char>> string;
+    }
+}
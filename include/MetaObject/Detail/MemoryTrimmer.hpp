@@ -0,0 +1,68 @@
+#pragma once
+#include "Export.hpp"
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+namespace mo
+{
+    /*!
+     * \brief The ITrimmable class is implemented by pools that lazily hold on to
+     *        freed memory.  Implementations must be safe to trim from the
+     *        MemoryTrimmer thread while their owning thread allocates.
+     */
+    class MO_EXPORTS ITrimmable
+    {
+    public:
+        virtual ~ITrimmable() {}
+        /*!
+         * \brief Trim releases cached memory that has not been reused for
+         *        longer than max_age, then keeps releasing the least recently
+         *        used cached memory until at least bytes bytes were released.
+         * \return number of bytes released
+         */
+        virtual size_t Trim(std::chrono::milliseconds max_age, size_t bytes) = 0;
+        virtual size_t GetCachedBytes() const = 0;
+    };
+
+    /*!
+     * \brief The MemoryTrimmer class releases memory cached by registered pools
+     *        on a background thread so that deallocation on the hot path only
+     *        pushes onto a free list.  Each pass releases everything older than
+     *        the maximum age, and if the total cached memory is still above the
+     *        high watermark it releases the least recently used memory until the
+     *        total is below the low watermark.  The thread is started on the
+     *        first registration.
+     */
+    class MO_EXPORTS MemoryTrimmer
+    {
+    public:
+        static MemoryTrimmer* Instance();
+
+        void Register(ITrimmable* obj);
+        // Must be called before the registered object starts destroying its state
+        void Unregister(ITrimmable* obj);
+
+        void SetWatermarks(size_t low_bytes, size_t high_bytes);
+        void SetMaxAge(std::chrono::milliseconds max_age);
+        void SetPeriod(std::chrono::milliseconds period);
+        /*!
+         * \brief Defer skips the background trimming passes for the given
+         *        duration, so that memory reserved ahead of time at startup is
+         *        not released before the workload gets around to using it.
+         *        Explicit calls to Trim are not affected.
+         */
+        void Defer(std::chrono::milliseconds duration);
+        size_t GetCachedBytes() const;
+
+        // Run one trimming pass on the calling thread, returns released bytes
+        size_t Trim();
+        void Start();
+        void Stop();
+    private:
+        MemoryTrimmer();
+        ~MemoryTrimmer();
+        struct impl;
+        std::unique_ptr<impl> _pimpl;
+    };
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "Export.hpp"
+#include <cstddef>
+
+namespace mo
+{
+    /*!
+     * \brief GetNumaNodeCount
+     * \return number of NUMA nodes, 1 on machines or platforms without NUMA
+     */
+    MO_EXPORTS int GetNumaNodeCount();
+    /*!
+     * \brief GetCurrentNumaNode
+     * \return the node the calling thread is pinned to, or the node of the
+     *         CPU it is currently running on if it is not pinned
+     */
+    MO_EXPORTS int GetCurrentNumaNode();
+    /*!
+     * \brief SetThreadNumaNode pins the calling thread to the CPUs of a node.
+     *        Pools created or refilled by a pinned thread place their memory
+     *        on that node.  Passing -1 removes the pin.
+     * \return false if the node does not exist or the affinity could not be set
+     */
+    MO_EXPORTS bool SetThreadNumaNode(int node);
+    /*!
+     * \brief GetThreadNumaNode
+     * \return the node the calling thread is pinned to, -1 if it is not pinned
+     */
+    MO_EXPORTS int GetThreadNumaNode();
+    /*!
+     * \brief BindToNumaNode sets the memory policy of a range that has not been
+     *        touched yet so that its pages are faulted in on the given node.
+     * \return false if the policy could not be set, the memory is still usable
+     */
+    MO_EXPORTS bool BindToNumaNode(void* ptr, size_t size, int node);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "Export.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mo
+{
+    /*!
+     * \brief The ScopeAllocationStatistics struct is one row of the per thread
+     *        scope tables of the ScopeSampler.  Byte counts are estimates
+     *        scaled up from the sampled allocations.
+     */
+    struct MO_EXPORTS ScopeAllocationStatistics
+    {
+        std::string scope;          // see SetScopeName
+        size_t thread = 0;          // thread that made the allocations, see GetThisThread
+        size_t samples = 0;         // sampled allocations
+        size_t allocated_bytes = 0; // allocated in the scope since sampling was enabled
+        size_t live_bytes = 0;      // allocated in the scope and not yet freed
+    };
+
+    /*!
+     * \brief The ScopeSampler class attributes a random sample of CPU
+     *        allocations to the scope of the allocating thread, see
+     *        SetScopeName, so that the node that is bloating memory can be
+     *        found in production.  On average one allocation is sampled per
+     *        sample interval bytes, an allocation of size bytes is sampled with
+     *        probability 1 - exp(-size / interval) and counted with the inverse
+     *        weight, so large allocations are always seen.  Unsampled
+     *        allocations only decrement a thread local counter.
+     *        Sampling is disabled by default, the MO_SCOPE_SAMPLE_INTERVAL
+     *        environment variable sets the initial interval in bytes.
+     */
+    class MO_EXPORTS ScopeSampler
+    {
+    public:
+        // 0 disables sampling, allocations sampled before keep being tracked until they are freed
+        static void SetSampleInterval(size_t bytes);
+        static size_t GetSampleInterval();
+        // One row per thread and scope, the tables of exited threads are kept
+        static std::vector<ScopeAllocationStatistics> GetStatistics();
+        // Same as GetStatistics but summed over threads, largest live bytes first
+        static std::vector<ScopeAllocationStatistics> GetScopeTotals();
+
+        /*!
+         * \brief Sample decides if an allocation of num_bytes is sampled
+         * \return the sample to pass to Release when the allocation is freed,
+         *         nullptr if it was not sampled
+         */
+        static void* Sample(size_t num_bytes);
+        static void Release(void* sample);
+        // Variants for allocations without a header to store the sample in, keyed by pointer
+        static void SamplePointer(const void* ptr, size_t num_bytes);
+        static void ReleasePointer(const void* ptr);
+    };
+}
@@ -1,6 +1,12 @@
 #pragma once
 #include "MetaObject/Detail/Export.hpp"
 
+namespace cv
+{
+    class Mat;
+    class MatAllocator;
+}
+
 namespace mo
 {
     namespace Buffer
@@ -13,6 +19,23 @@ namespace mo
             // These are not const accessors because I may need to lock a mutex inside of them.
             virtual long long GetSize() = 0;
             virtual void GetTimestampRange(long long& start, long long& end) = 0;
+            /*!
+             * \brief SetMatAllocator selects the allocator that cv::Mat values are
+             *        deep copied into when they are stored in the buffer, ie
+             *        FileMappedAllocator::Instance() to keep long histories out of
+             *        core.  nullptr (the default) stores a shallow copy.
+             */
+            void SetMatAllocator(cv::MatAllocator* allocator) { mat_allocator = allocator; }
+            cv::MatAllocator* GetMatAllocator() const { return mat_allocator; }
+        protected:
+            cv::MatAllocator* mat_allocator = nullptr;
         };
+
+        // Stores src into a buffer entry, see IBuffer::SetMatAllocator
+        template<class T> void StoreBufferValue(T& dst, const T& src, cv::MatAllocator* allocator)
+        {
+            dst = src;
+        }
+        MO_EXPORTS void StoreBufferValue(cv::Mat& dst, const cv::Mat& src, cv::MatAllocator* allocator);
     }
 }
\ No newline at end of file
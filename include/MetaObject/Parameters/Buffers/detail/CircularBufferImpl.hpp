@@ -70,7 +70,8 @@ namespace mo
         template<class T> ITypedParameter<T>* CircularBuffer<T>::UpdateData(T& data_, long long ts, Context* ctx)
         {
             boost::recursive_mutex::scoped_lock lock(IParameter::mtx());
-            _data_buffer.push_back(std::pair<long long, T>(ts, data_));
+            _data_buffer.push_back(std::pair<long long, T>(ts, T()));
+            StoreBufferValue(_data_buffer.back().second, data_, this->mat_allocator);
             IParameter::modified = true;
             IParameter::OnUpdate(ctx);
             return this;
@@ -79,7 +80,8 @@ namespace mo
         template<class T> ITypedParameter<T>* CircularBuffer<T>::UpdateData(const T& data_, long long ts, Context* ctx)
         {
             boost::recursive_mutex::scoped_lock lock(IParameter::mtx());
-            _data_buffer.push_back(std::pair<long long, T>(ts, data_));
+            _data_buffer.push_back(std::pair<long long, T>(ts, T()));
+            StoreBufferValue(_data_buffer.back().second, data_, this->mat_allocator);
             IParameter::modified = true;
             IParameter::OnUpdate(ctx);
             return this;
@@ -88,7 +90,8 @@ namespace mo
         template<class T> ITypedParameter<T>* CircularBuffer<T>::UpdateData(T* data_, long long ts, Context* ctx)
         {
             boost::recursive_mutex::scoped_lock lock(IParameter::mtx());
-            _data_buffer.push_back(std::pair<long long, T>(ts, *data_));
+            _data_buffer.push_back(std::pair<long long, T>(ts, T()));
+            StoreBufferValue(_data_buffer.back().second, *data_, this->mat_allocator);
             IParameter::modified = true;
             IParameter::OnUpdate(ctx);
             return this;
@@ -103,7 +106,8 @@ namespace mo
                 if (typedParameter->GetData(data))
                 {
                     boost::recursive_mutex::scoped_lock lock(IParameter::mtx());
-                    _data_buffer.push_back(std::pair<long long, T>(typedParameter->GetTimestamp(), data));
+                    _data_buffer.push_back(std::pair<long long, T>(typedParameter->GetTimestamp(), T()));
+                    StoreBufferValue(_data_buffer.back().second, data, this->mat_allocator);
                     IParameter::modified = true;
                     IParameter::OnUpdate(ctx);
                 }
@@ -63,7 +63,7 @@ namespace mo
         template<class T> ITypedParameter<T>* Map<T>::UpdateData(T& data_, long long ts, Context* ctx)
         {
             boost::recursive_mutex::scoped_lock lock(IParameter::mtx());
-            _data_buffer[ts] = data_;
+            StoreBufferValue(_data_buffer[ts], data_, this->mat_allocator);
             IParameter::modified = true;
             IParameter::OnUpdate(ctx);
             return this;
@@ -71,7 +71,7 @@ namespace mo
         template<class T> ITypedParameter<T>* Map<T>::UpdateData(const T& data_, long long ts, Context* ctx)
         {
             boost::recursive_mutex::scoped_lock lock(IParameter::mtx());
-            _data_buffer[ts] = data_;
+            StoreBufferValue(_data_buffer[ts], data_, this->mat_allocator);
             IParameter::modified = true;
             IParameter::OnUpdate(ctx);
             return this;
@@ -79,7 +79,7 @@ namespace mo
         template<class T> ITypedParameter<T>* Map<T>::UpdateData(T* data_, long long ts, Context* ctx)
         {
             boost::recursive_mutex::scoped_lock lock(IParameter::mtx());
-            _data_buffer[ts] = *data_;
+            StoreBufferValue(_data_buffer[ts], *data_, this->mat_allocator);
             IParameter::modified = true;
             this->_timestamp = ts;
             IParameter::OnUpdate(ctx);
@@ -95,7 +95,7 @@ namespace mo
                 if (ptr)
                 {
                     boost::recursive_mutex::scoped_lock lock(IParameter::mtx());
-                    _data_buffer[typedParameter->GetTimeIndex()] = *ptr;
+                    StoreBufferValue(_data_buffer[typedParameter->GetTimeIndex()], *ptr, this->mat_allocator);
                     IParameter::modified = true;
                     IParameter::OnUpdate(ctx);
                 }
@@ -87,7 +87,7 @@ namespace mo
                 LOG(trace) << "Pushing to " << this->GetTreeName() << " waiting on read";
                 _cv.wait(lock);
             }
-            this->_data_buffer[ts] = data_;
+            StoreBufferValue(this->_data_buffer[ts], data_, this->mat_allocator);
             IParameter::modified = true;
             this->_timestamp = ts;
             IParameter::OnUpdate(ctx);
@@ -103,7 +103,7 @@ namespace mo
                 LOG(trace) << "Pushing to " << this->GetTreeName() << " waiting on read";
                 _cv.wait(lock);
             }
-            this->_data_buffer[ts] = data_;
+            StoreBufferValue(this->_data_buffer[ts], data_, this->mat_allocator);
             IParameter::modified = true;
             this->_timestamp = ts;
             IParameter::OnUpdate(ctx);
@@ -119,7 +119,7 @@ namespace mo
                 LOG(trace) << "Pushing to " << this->GetTreeName() << " waiting on read";
                 _cv.wait(lock);
             }
-            this->_data_buffer[ts] = *data_;
+            StoreBufferValue(this->_data_buffer[ts], *data_, this->mat_allocator);
             IParameter::modified = true;
             this->_timestamp = ts;
             IParameter::OnUpdate(ctx);
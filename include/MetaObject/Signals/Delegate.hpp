@@ -0,0 +1,272 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mo
+{
+    template<class Sig> class Delegate;
+
+    /*!
+     * \brief The Delegate class is a callable wrapper like std::function that
+     *        stores member function plus object bindings, std::bind
+     *        expressions of them and small lambdas inline.  Only callables
+     *        larger than InlineSize or that may throw when moved are heap
+     *        allocated, and a call is a single indirect call through the
+     *        stored invoker.
+     */
+    template<class R, class... T>
+    class Delegate<R(T...)>
+    {
+    public:
+        // Fits a member function pointer with its object and a few bound values
+        static const size_t InlineSize = 6 * sizeof(void*);
+
+        Delegate():
+            _ops(nullptr)
+        {
+        }
+
+        Delegate(std::nullptr_t):
+            _ops(nullptr)
+        {
+        }
+
+        template<class F, class = typename std::enable_if<
+            !std::is_base_of<Delegate, typename std::decay<F>::type>::value>::type>
+        Delegate(F&& f):
+            _ops(nullptr)
+        {
+            Assign(std::forward<F>(f));
+        }
+
+        // Calls method on obj, always stored inline
+        template<class C>
+        Delegate(C* obj, R(C::*method)(T...)):
+            _ops(nullptr)
+        {
+            Assign(MemberCall<C, R(C::*)(T...)>{obj, method});
+        }
+
+        template<class C>
+        Delegate(const C* obj, R(C::*method)(T...) const):
+            _ops(nullptr)
+        {
+            Assign(MemberCall<const C, R(C::*)(T...) const>{obj, method});
+        }
+
+        Delegate(const Delegate& other):
+            _ops(nullptr)
+        {
+            if(other._ops)
+            {
+                other._ops->copy(&_storage, &other._storage);
+                _ops = other._ops;
+            }
+        }
+
+        Delegate(Delegate&& other):
+            _ops(nullptr)
+        {
+            if(other._ops)
+            {
+                other._ops->move(&_storage, &other._storage);
+                _ops = other._ops;
+                other.Reset();
+            }
+        }
+
+        ~Delegate()
+        {
+            Reset();
+        }
+
+        Delegate& operator=(const Delegate& other)
+        {
+            if(this != &other)
+            {
+                Delegate copy(other);
+                *this = std::move(copy);
+            }
+            return *this;
+        }
+
+        Delegate& operator=(Delegate&& other)
+        {
+            if(this != &other)
+            {
+                Reset();
+                if(other._ops)
+                {
+                    other._ops->move(&_storage, &other._storage);
+                    _ops = other._ops;
+                    other.Reset();
+                }
+            }
+            return *this;
+        }
+
+        Delegate& operator=(std::nullptr_t)
+        {
+            Reset();
+            return *this;
+        }
+
+        template<class F, class = typename std::enable_if<
+            !std::is_base_of<Delegate, typename std::decay<F>::type>::value>::type>
+        Delegate& operator=(F&& f)
+        {
+            Delegate delegate(std::forward<F>(f));
+            *this = std::move(delegate);
+            return *this;
+        }
+
+        R operator()(T... args) const
+        {
+            if(_ops == nullptr)
+                throw std::bad_function_call();
+            return _ops->invoke(const_cast<Storage*>(&_storage), std::forward<T>(args)...);
+        }
+
+        explicit operator bool() const
+        {
+            return _ops != nullptr;
+        }
+
+        // True if the callable is stored in the delegate rather than on the heap
+        bool IsInline() const
+        {
+            return _ops != nullptr && _ops->is_inline;
+        }
+
+    private:
+        typedef typename std::aligned_storage<InlineSize, alignof(std::max_align_t)>::type Storage;
+
+        struct Ops
+        {
+            R(*invoke)(void* storage, T&&... args);
+            void(*copy)(void* dst, const void* src);
+            void(*move)(void* dst, void* src);
+            void(*destroy)(void* storage);
+            bool is_inline;
+        };
+
+        template<class C, class M>
+        struct MemberCall
+        {
+            C* obj;
+            M method;
+            R operator()(T&&... args) const
+            {
+                return static_cast<R>((obj->*method)(std::forward<T>(args)...));
+            }
+        };
+
+        template<class F>
+        struct InlineOps
+        {
+            static R Invoke(void* storage, T&&... args)
+            {
+                return static_cast<R>((*static_cast<F*>(storage))(std::forward<T>(args)...));
+            }
+            static void Copy(void* dst, const void* src)
+            {
+                new(dst) F(*static_cast<const F*>(src));
+            }
+            static void Move(void* dst, void* src)
+            {
+                new(dst) F(std::move(*static_cast<F*>(src)));
+            }
+            static void Destroy(void* storage)
+            {
+                static_cast<F*>(storage)->~F();
+            }
+            static const Ops* Get()
+            {
+                static const Ops ops = {&Invoke, &Copy, &Move, &Destroy, true};
+                return &ops;
+            }
+        };
+
+        template<class F>
+        struct HeapOps
+        {
+            static F* Target(void* storage)
+            {
+                return *static_cast<F**>(storage);
+            }
+            static R Invoke(void* storage, T&&... args)
+            {
+                return static_cast<R>((*Target(storage))(std::forward<T>(args)...));
+            }
+            static void Copy(void* dst, const void* src)
+            {
+                *static_cast<F**>(dst) = new F(**static_cast<F* const*>(src));
+            }
+            static void Move(void* dst, void* src)
+            {
+                *static_cast<F**>(dst) = Target(src);
+                *static_cast<F**>(src) = nullptr;
+            }
+            static void Destroy(void* storage)
+            {
+                delete Target(storage);
+            }
+            static const Ops* Get()
+            {
+                static const Ops ops = {&Invoke, &Copy, &Move, &Destroy, false};
+                return &ops;
+            }
+        };
+
+        // Empty std::function objects and null pointers produce an empty delegate
+        template<class F>
+        static bool IsNull(const F&) { return false; }
+        template<class S>
+        static bool IsNull(const std::function<S>& f) { return !f; }
+        template<class S>
+        static bool IsNull(S* f) { return f == nullptr; }
+        template<class C, class M>
+        static bool IsNull(M C::* f) { return f == nullptr; }
+
+        template<class F>
+        void Assign(F&& f)
+        {
+            typedef typename std::decay<F>::type Functor;
+            if(IsNull(f))
+                return;
+            typedef std::integral_constant<bool, sizeof(Functor) <= sizeof(Storage) &&
+                alignof(Functor) <= alignof(Storage) &&
+                std::is_nothrow_move_constructible<Functor>::value> Fits;
+            Emplace<Functor>(std::forward<F>(f), Fits());
+        }
+
+        template<class Functor, class F>
+        void Emplace(F&& f, std::true_type)
+        {
+            new(&_storage) Functor(std::forward<F>(f));
+            _ops = InlineOps<Functor>::Get();
+        }
+
+        template<class Functor, class F>
+        void Emplace(F&& f, std::false_type)
+        {
+            *reinterpret_cast<Functor**>(&_storage) = new Functor(std::forward<F>(f));
+            _ops = HeapOps<Functor>::Get();
+        }
+
+        void Reset()
+        {
+            if(_ops)
+            {
+                _ops->destroy(&_storage);
+                _ops = nullptr;
+            }
+        }
+
+        Storage _storage;
+        const Ops* _ops;
+    };
+}
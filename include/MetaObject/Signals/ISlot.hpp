@@ -1,6 +1,7 @@
 #pragma once
 #include "MetaObject/Detail/Export.hpp"
 #include "MetaObject/Detail/TypeInfo.h"
+#include "MetaObject/Thread/InterThread.hpp"
 #include <memory>
 namespace mo
 {
@@ -9,6 +10,17 @@ namespace mo
     class Connection;
     class IMetaObject;
 	class ISignalRelay;
+    /*!
+     * \brief DeliveryPolicy controls how emissions from another thread are
+     *        queued to a slot.  Slots on the emitting thread are always called
+     *        directly.
+     */
+    enum DeliveryPolicy
+    {
+        QueueAll_e = 0,     // Every emission is queued and delivered in order
+        Latest_e,           // Emissions while a call is queued replace its arguments
+        DropWhenBusy_e      // Emissions while a call is queued or running are dropped
+    };
     class MO_EXPORTS ISlot
     {
     public:
@@ -20,10 +32,25 @@ namespace mo
 		IMetaObject* GetParent() const;
         const Context* GetContext() const;
         void SetContext(Context* ctx);
+        DeliveryPolicy GetDeliveryPolicy() const;
+        void SetDeliveryPolicy(DeliveryPolicy policy);
+        // Lane of the queue of the slot's thread that calls from other threads are pushed to
+        QueuePriority GetQueuePriority() const;
+        void SetQueuePriority(QueuePriority priority);
+        /*!
+         * \brief GetContextGeneration changes whenever the context of any slot
+         *        may have changed, relays that cache slot contexts compare it
+         *        to know when to refresh them
+         */
+        static size_t GetContextGeneration();
 	protected:
 		friend class IMetaObject;
 		void SetParent(IMetaObject* parent);
+		// Called when the context of slots may have changed, ie by IMetaObject::SetContext
+		static void InvalidateContexts();
 		IMetaObject* _parent = nullptr;
         Context* _ctx = nullptr;
+        DeliveryPolicy _delivery_policy = QueueAll_e;
+        QueuePriority _queue_priority = NormalPriority_e;
     };
 }
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+#include "MetaObject/Detail/Export.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mo
+{
+    /*!
+     * \brief The SignalDispatch class marks a snapshot as being emitted to by
+     *        the calling thread for its lifetime.  A slot that disconnects
+     *        itself, or another slot of the relay it was called from, does not
+     *        wait for its own emission to finish.
+     */
+    class MO_EXPORTS SignalDispatch
+    {
+    public:
+        SignalDispatch(const void* snapshot);
+        ~SignalDispatch();
+        // Number of emissions of snapshot in progress on the calling thread
+        static long Count(const void* snapshot);
+    private:
+        SignalDispatch(const SignalDispatch&);
+        SignalDispatch& operator=(const SignalDispatch&);
+        // Frames form a stack through the enclosing emissions of the thread
+        const void* snapshot;
+        SignalDispatch* previous;
+    };
+
+    /*!
+     * \brief The SnapshotList class is the copy on write list of relays and
+     *        slots behind a signal.  Emitters take an immutable snapshot with
+     *        an atomic load and keep it alive while they call into it, so no
+     *        lock is held during dispatch and an emission may reenter the
+     *        signal.  Writers copy the list under a mutex that only other
+     *        writers take, and atomically publish the copy.
+     *        Removing with wait set returns once no other thread is emitting
+     *        to a snapshot that still holds the removed element, so a slot
+     *        may be destroyed right after it is disconnected.
+     */
+    template<class T>
+    class SnapshotList
+    {
+    public:
+        typedef std::vector<T> List;
+        typedef std::shared_ptr<const List> Snapshot;
+
+        SnapshotList():
+            current(std::make_shared<List>())
+        {
+        }
+
+        Snapshot Get() const
+        {
+            return std::atomic_load(&current);
+        }
+
+        bool Empty() const
+        {
+            return Get()->empty();
+        }
+
+        // Returns false if value is already in the list
+        bool Insert(const T& value)
+        {
+            return Update([&value](List& list)
+            {
+                if(std::find(list.begin(), list.end(), value) != list.end())
+                    return false;
+                list.push_back(value);
+                return true;
+            }, false);
+        }
+
+        // Returns false if value is not in the list
+        bool Remove(const T& value, bool wait)
+        {
+            return Update([&value](List& list)
+            {
+                auto itr = std::find(list.begin(), list.end(), value);
+                if(itr == list.end())
+                    return false;
+                list.erase(itr);
+                return true;
+            }, wait);
+        }
+
+        /*!
+         * \brief Update publishes a modified copy of the list
+         * \param modify is called with the copy under the writer lock and
+         *        returns false if it did not change it
+         * \param wait for emissions on other threads that use the replaced snapshots
+         */
+        template<class F>
+        bool Update(F modify, bool wait)
+        {
+            // Replaced snapshots that are still in use, with the emissions of this thread that use them.
+            // The waiter does not own them, otherwise concurrent waiters would wait on each other
+            std::vector<std::pair<std::weak_ptr<const List>, long>> readers;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                Snapshot previous = std::atomic_load(&current);
+                std::shared_ptr<List> list = std::make_shared<List>(*previous);
+                if(!modify(*list))
+                    return false;
+                std::atomic_store(&current, Snapshot(std::move(list)));
+                retired.erase(std::remove_if(retired.begin(), retired.end(),
+                    [](const std::weak_ptr<const List>& snapshot)
+                {
+                    return snapshot.expired();
+                }), retired.end());
+                retired.push_back(previous);
+                previous.reset();
+                if(wait)
+                {
+                    for(const std::weak_ptr<const List>& snapshot : retired)
+                    {
+                        Snapshot reader = snapshot.lock();
+                        if(reader)
+                            readers.emplace_back(snapshot, SignalDispatch::Count(reader.get()));
+                    }
+                }
+            }
+            // Waiting outside of the lock lets the emissions we wait for connect and disconnect
+            for(const std::pair<std::weak_ptr<const List>, long>& reader : readers)
+            {
+                // The list no longer holds the snapshot, only emitters do
+                while(reader.first.use_count() > reader.second)
+                    std::this_thread::yield();
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+            return true;
+        }
+    private:
+        Snapshot current;
+        std::mutex mtx;
+        // Replaced snapshots that may still be in use by an emission
+        std::vector<std::weak_ptr<const List>> retired;
+    };
+}
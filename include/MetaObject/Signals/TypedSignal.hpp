@@ -2,6 +2,8 @@
 #include "MetaObject/Detail/Export.hpp"
 #include "MetaObject/Detail/TypeInfo.h"
 #include "MetaObject/Signals/ISignal.hpp"
+#include "MetaObject/Signals/SnapshotList.hpp"
+#include <future>
 #include <mutex>
 #include <memory>
 #include <vector>
@@ -28,8 +30,9 @@ namespace mo
 		bool Disconnect(ISlot* slot);
 		bool Disconnect(std::weak_ptr<ISignalRelay> relay);
 	protected:
-        std::mutex mtx;
-		std::vector<std::shared_ptr<TypedSignalRelay<void(T...)>>> _typed_relays;
+		void Emit(const Context* ctx, T&... args);
+		// Emission works on a snapshot, see SnapshotList
+		SnapshotList<std::shared_ptr<TypedSignalRelay<void(T...)>>> _typed_relays;
 	};
 
 	template<class R, class...T> class MO_EXPORTS TypedSignal<R(T...)> : public ISignal
@@ -38,6 +41,22 @@ namespace mo
 		TypedSignal();
 		R operator()(T... args);
         R operator()(Context* ctx, T... args);
+		/*!
+		 * \brief AsyncCall calls the slot on the thread of its context instead
+		 *        of the calling thread, see TypedSignalRelay::AsyncCall.  The
+		 *        calling thread is the thread of ctx, or of this signal's
+		 *        context if ctx is not passed.
+		 */
+		std::future<R> AsyncCall(T... args);
+		std::future<R> AsyncCall(Context* ctx, T... args);
+		/*!
+		 * \brief AsyncCallAll calls the slots of signals with the same
+		 *        arguments.  The calls to each thread are queued together and
+		 *        share one copy of the arguments.  Throws before any slot is
+		 *        called if a signal has no slot.
+		 */
+		static std::vector<std::future<R>> AsyncCallAll(const std::vector<TypedSignal<R(T...)>*>& signals,
+		                                                Context* ctx, T... args);
 		TypeInfo GetSignature() const;
 
 		std::shared_ptr<Connection> Connect(ISlot* slot);
@@ -48,6 +67,7 @@ namespace mo
 		bool Disconnect(ISlot* slot);
 		bool Disconnect(std::weak_ptr<ISignalRelay> relay);
 	protected:
+        // Serializes connect and disconnect, emission loads _typed_relay atomically
         std::mutex mtx;
 		std::shared_ptr<TypedSignalRelay<R(T...)>> _typed_relay;
     };
@@ -1,7 +1,9 @@
 #pragma once
 #include "ISignalRelay.hpp"
-#include <set>
-#include <mutex>
+#include "SnapshotList.hpp"
+#include "MetaObject/Thread/InterThread.hpp"
+#include <functional>
+#include <future>
 namespace mo
 {
 	template<class Sig> class TypedSlot;
@@ -11,6 +13,7 @@ namespace mo
 	template<class...T> class TypedSignalRelay<void(T...)>: public ISignalRelay
 	{
 	public:
+		TypedSignalRelay();
 		void operator()(TypedSignal<void(T...)>* sig, T&... args);
 		void operator()(T&... args);
         void operator()(Context* ctx, T&... args);
@@ -28,9 +31,53 @@ namespace mo
 
 		bool Disconnect(ISlot* slot);
 		bool Disconnect(ISignal* signal);
-		
-		std::set<TypedSlot<void(T...)>*> _slots;
-        std::mutex mtx;
+
+		// The arguments of an emission, bound once for all of its queued calls
+		typedef std::function<void(TypedSlot<void(T...)>*)> Payload;
+		// Call of a slot pending on its thread, for slots that do not queue every emission
+		struct Mailbox
+		{
+			Mailbox(): queued(false) {}
+			std::shared_ptr<Payload> payload; // Accessed with atomic_load and atomic_store
+			std::atomic<bool> queued;
+		};
+		// Slots are stored contiguously with their context so that emission
+		// does not chase each slot to decide if it needs to be queued
+		struct SlotRecord
+		{
+			TypedSlot<void(T...)>* slot;
+			const Context* ctx;
+			std::shared_ptr<Mailbox> mailbox;
+			bool operator==(const SlotRecord& other) const { return slot == other.slot; }
+		};
+		typedef typename SnapshotList<SlotRecord>::Snapshot Snapshot;
+		// Returns the current snapshot, refreshing the cached contexts if any slot context changed
+		Snapshot GetSlots();
+		// Slots of one relay that an emission calls on another thread
+		struct QueuedSlots
+		{
+			std::shared_ptr<SnapshotList<SlotRecord>> list;
+			// The mailbox is null for slots that queue every emission
+			std::vector<std::pair<TypedSlot<void(T...)>*, std::shared_ptr<Mailbox>>> slots;
+		};
+		// Slots an emission calls through one lane of the queue of another thread
+		struct RemoteThread
+		{
+			size_t thread;
+			QueuePriority priority;
+			std::vector<QueuedSlots> calls;
+		};
+		typedef std::vector<RemoteThread> RemoteCalls;
+		// Calls slots of the thread of ctx directly and adds the others to remote
+		void Dispatch(const Context* ctx, RemoteCalls& remote, T&... args);
+		// Queues one call per thread and lane, the calls share a single copy of the arguments
+		static void Queue(RemoteCalls& remote, T&... args);
+
+		// Emission works on a snapshot, see SnapshotList.  Shared with the
+		// calls queued to other threads, which skip slots disconnected since
+		std::shared_ptr<SnapshotList<SlotRecord>> _slots;
+		// ISlot::GetContextGeneration when the cached contexts were last refreshed
+		std::atomic<size_t> _generation;
 	};
 	// Specialization for return value
 	template<class R, class...T> class TypedSignalRelay<R(T...)>: public ISignalRelay
@@ -40,6 +87,15 @@ namespace mo
 		R operator()(TypedSignal<R(T...)>* sig, T&... args);
 		R operator()(T&... args);
         R operator()(Context* ctx, T&... args);
+		/*!
+		 * \brief AsyncCall calls the slot on the thread of its context and
+		 *        returns the result through the future.  The slot is called
+		 *        before this returns if it has no context or is on the thread
+		 *        of ctx, or of the caller if ctx is null.  If the slot is
+		 *        disconnected before the queued call runs, the future reports
+		 *        a broken promise.
+		 */
+		std::future<R> AsyncCall(const Context* ctx, T&... args);
 		TypeInfo GetSignature() const;
 		bool HasSlots() const;
 	protected:
@@ -55,8 +111,32 @@ namespace mo
 		bool Disconnect(ISlot* slot);
 		bool Disconnect(ISignal* signal);
 		
-		TypedSlot<R(T...)>* _slot;
-        std::mutex mtx;
+		typedef typename SnapshotList<TypedSlot<R(T...)>*>::Snapshot Snapshot;
+		// The arguments of a call, bound once for all of the calls queued with them
+		typedef std::function<R(TypedSlot<R(T...)>*)> Payload;
+		// Call of a slot pending on its thread
+		struct PendingCall
+		{
+			std::shared_ptr<SnapshotList<TypedSlot<R(T...)>*>> list;
+			TypedSlot<R(T...)>* slot;
+			std::shared_ptr<std::promise<R>> promise;
+		};
+		// Calls pending in one lane of the queue of another thread
+		struct RemoteThread
+		{
+			size_t thread;
+			QueuePriority priority;
+			std::vector<PendingCall> calls;
+		};
+		typedef std::vector<RemoteThread> RemoteCalls;
+		// Calls the slot of snapshot if it is on the calling thread and otherwise adds it to remote
+		std::future<R> Dispatch(const Context* ctx, const Snapshot& slot, RemoteCalls& remote, T&... args);
+		// Queues one call per thread and lane, the calls share a single copy of the arguments
+		static void Queue(RemoteCalls& remote, T&... args);
+
+		// Holds at most one slot.  Shared with the calls queued to other
+		// threads, which skip the slot if it was disconnected since
+		std::shared_ptr<SnapshotList<TypedSlot<R(T...)>*>> _slot;
 	};
 }
 #include "detail/TypedSignalRelayImpl.hpp"
\ No newline at end of file
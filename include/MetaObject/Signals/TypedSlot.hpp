@@ -3,6 +3,7 @@
 #include "TypedSignal.hpp"
 #include "MetaObject/Context.hpp"
 #include "TypedSignalRelay.hpp"
+#include "Delegate.hpp"
 #include <functional>
 #include <future>
 namespace mo
@@ -10,16 +11,40 @@ namespace mo
     template<typename Sig> class TypedSlot{};
 	template<typename Sig> class TypedSignalRelay;
 
-    template<typename R, typename... T> class TypedSlot<R(T...)>: public std::function<R(T...)>, public ISlot
+    /*!
+     * \brief The TypedSlot class is a slot that calls a Delegate, member
+     *        function bindings and small lambdas are stored inline.
+     */
+    template<typename R, typename... T> class TypedSlot<R(T...)>: public Delegate<R(T...)>, public ISlot
     {
     public:
 		TypedSlot();
 		TypedSlot(const std::function<R(T...)>& other);
         TypedSlot(std::function<R(T...)>&& other);
+        template<class F, class = typename std::enable_if<
+            !std::is_base_of<ISlot, typename std::decay<F>::type>::value>::type>
+        TypedSlot(F&& other):
+            Delegate<R(T...)>(std::forward<F>(other))
+        {
+        }
+        // Calls method on obj
+        template<class C>
+        TypedSlot(C* obj, R(C::*method)(T...)):
+            Delegate<R(T...)>(obj, method)
+        {
+        }
 		~TypedSlot();
 
 		TypedSlot& operator=(const std::function<R(T...)>& other);
+		TypedSlot& operator=(const Delegate<R(T...)>& other);
 		TypedSlot& operator=(const TypedSlot& other);
+        template<class F, class = typename std::enable_if<
+            !std::is_base_of<Delegate<R(T...)>, typename std::decay<F>::type>::value>::type>
+        TypedSlot& operator=(F&& other)
+        {
+            Delegate<R(T...)>::operator=(std::forward<F>(other));
+            return *this;
+        }
 
 		std::shared_ptr<Connection> Connect(ISignal* sig);
 		std::shared_ptr<Connection> Connect(TypedSignal<R(T...)>* signal);
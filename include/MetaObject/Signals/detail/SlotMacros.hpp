@@ -15,7 +15,7 @@
     mo::TypedSlot<RETURN(__VA_ARGS__)> COMBINE(_slot_##NAME##_, N); \
     void bind_slots_(bool firstInit, mo::_counter_<N> dummy) \
     { \
-        COMBINE(_slot_##NAME##_, N) = my_bind((RETURN(THIS_CLASS::*)(__VA_ARGS__))&THIS_CLASS::NAME, this, make_int_sequence<BOOST_PP_VARIADIC_SIZE(__VA_ARGS__)>{} ); \
+        COMBINE(_slot_##NAME##_, N) = mo::Delegate<RETURN(__VA_ARGS__)>(this, (RETURN(THIS_CLASS::*)(__VA_ARGS__))&THIS_CLASS::NAME); \
         AddSlot(&COMBINE(_slot_##NAME##_, N), #NAME); \
 		bind_slots_(firstInit, --dummy); \
     } \
@@ -17,10 +17,10 @@ namespace mo
     template<class R, class...T> 
 	R TypedSignal<R(T...)>::operator()(T... args)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-		if (_typed_relay)
+        auto relay = std::atomic_load(&_typed_relay);
+		if (relay)
 		{
-			return (*_typed_relay)(this, args...);
+			return (*relay)(this, args...);
 		}
 		THROW(debug) << "Not connected to a signal relay";
         return R();
@@ -29,15 +29,71 @@ namespace mo
     template<class R, class...T>
     R TypedSignal<R(T...)>::operator()(Context* ctx, T... args)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (_typed_relay)
+        auto relay = std::atomic_load(&_typed_relay);
+        if (relay)
         {
-            return (*_typed_relay)(ctx, args...);
+            return (*relay)(ctx, args...);
         }
         THROW(debug) << "Not connected to a signal relay";
         return R();
     }
 
+    template<class R, class...T>
+    std::future<R> TypedSignal<R(T...)>::AsyncCall(T... args)
+    {
+        auto relay = std::atomic_load(&_typed_relay);
+        if (relay)
+        {
+            return relay->AsyncCall(GetContext(), args...);
+        }
+        THROW(debug) << "Not connected to a signal relay";
+        return std::future<R>();
+    }
+
+    template<class R, class...T>
+    std::future<R> TypedSignal<R(T...)>::AsyncCall(Context* ctx, T... args)
+    {
+        auto relay = std::atomic_load(&_typed_relay);
+        if (relay)
+        {
+            return relay->AsyncCall(ctx, args...);
+        }
+        THROW(debug) << "Not connected to a signal relay";
+        return std::future<R>();
+    }
+
+    template<class R, class...T>
+    std::vector<std::future<R>> TypedSignal<R(T...)>::AsyncCallAll(const std::vector<TypedSignal<R(T...)>*>& signals,
+                                                                    Context* ctx, T... args)
+    {
+        typedef TypedSignalRelay<R(T...)> Relay;
+        // Every signal is checked before any slot is called
+        std::vector<std::pair<std::shared_ptr<Relay>, typename Relay::Snapshot>> slots;
+        slots.reserve(signals.size());
+        for (TypedSignal<R(T...)>* signal : signals)
+        {
+            auto relay = std::atomic_load(&signal->_typed_relay);
+            if (!relay)
+            {
+                THROW(debug) << "Not connected to a signal relay";
+            }
+            auto slot = relay->_slot->Get();
+            if (slot->empty())
+            {
+                THROW(debug) << "Slot not connected";
+            }
+            slots.emplace_back(relay, slot);
+        }
+        std::vector<std::future<R>> output;
+        output.reserve(slots.size());
+        typename Relay::RemoteCalls remote;
+        for (auto& slot : slots)
+            output.push_back(slot.first->Dispatch(ctx, slot.second, remote, args...));
+        if (!remote.empty())
+            Relay::Queue(remote, args...);
+        return output;
+    }
+
     template<class R, class...T> 
 	TypeInfo TypedSignal<R(T...)>::GetSignature() const
     {
@@ -73,7 +129,7 @@ namespace mo
         std::lock_guard<std::mutex> lock(mtx);
 		if (relay != _typed_relay)
 		{
-			_typed_relay = relay;
+			std::atomic_store(&_typed_relay, relay);
 			return std::shared_ptr<Connection>(new SignalConnection(this, relay));
 		}
 		return std::shared_ptr<Connection>();
@@ -86,7 +142,7 @@ namespace mo
         std::lock_guard<std::mutex> lock(mtx);
 		if (_typed_relay)
 		{
-			_typed_relay.reset();
+			std::atomic_store(&_typed_relay, std::shared_ptr<TypedSignalRelay<R(T...)>>());
 			return true;
 		}
 		return false;
@@ -98,9 +154,10 @@ namespace mo
         std::lock_guard<std::mutex> lock(mtx);
 		if (_typed_relay)
 		{
-			if (_typed_relay->_slot == slot)
+			auto slots = _typed_relay->_slot->Get();
+			if (!slots->empty() && slots->front() == slot)
 			{
-				_typed_relay.reset();
+				std::atomic_store(&_typed_relay, std::shared_ptr<TypedSignalRelay<R(T...)>>());
 				return true;
 			}
 		}
@@ -114,7 +171,7 @@ namespace mo
 		auto relay = relay_.lock();
 		if (_typed_relay == relay)
 		{
-			_typed_relay.reset();
+			std::atomic_store(&_typed_relay, std::shared_ptr<TypedSignalRelay<R(T...)>>());
 			return true;
 		}
 		return false;
@@ -132,26 +189,30 @@ namespace mo
 	template<class...T>
 	void TypedSignal<void(T...)>::operator()(T... args)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		for (auto& relay : _typed_relays)
-		{
-			if (relay)
-			{
-				(*relay)(this, args...);
-			}
-		}
+        // Same as passing the signal's context, which may be null
+        Emit(GetContext(), args...);
 	}
     template<class...T>
     void TypedSignal<void(T...)>::operator()(Context* ctx, T... args)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        for (auto& relay : _typed_relays)
+        Emit(ctx, args...);
+    }
+    template<class...T>
+    void TypedSignal<void(T...)>::Emit(const Context* ctx, T&... args)
+    {
+        // Slots on other threads are collected over all relays so that the
+        // arguments are copied once for the whole emission
+        typename TypedSignalRelay<void(T...)>::RemoteCalls remote;
+        auto relays = _typed_relays.Get();
+        for (auto& relay : *relays)
         {
             if (relay)
             {
-                (*relay)(ctx, args...);
+                relay->Dispatch(ctx, remote, args...);
             }
         }
+        if (!remote.empty())
+            TypedSignalRelay<void(T...)>::Queue(remote, args...);
     }
 
 	template<class...T>
@@ -186,11 +247,8 @@ namespace mo
 		{
 			relay.reset(new TypedSignalRelay<void(T...)>());
 		}
-        std::lock_guard<std::mutex> lock(mtx);
-		auto itr = std::find(_typed_relays.begin(), _typed_relays.end(), relay);
-		if (itr == _typed_relays.end())
+		if (_typed_relays.Insert(relay))
 		{
-			_typed_relays.push_back(relay);
 			return std::shared_ptr<Connection>(new SignalConnection(this, relay));
 		}
 		return std::shared_ptr<Connection>();
@@ -200,27 +258,28 @@ namespace mo
 	template<class...T>
 	bool TypedSignal<void(T...)>::Disconnect()
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		if (_typed_relays.size())
+		// Relays are kept alive by the snapshot, so there is nothing to wait for
+		return _typed_relays.Update([](std::vector<std::shared_ptr<TypedSignalRelay<void(T...)>>>& relays)
 		{
-			_typed_relays.clear();
+			if (relays.empty())
+				return false;
+			relays.clear();
 			return true;
-		}
-		return false;
+		}, false);
 	}
 
 	template<class...T>
 	bool TypedSignal<void(T...)>::Disconnect(ISlot* slot_)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		for (auto relay = _typed_relays.begin(); relay != _typed_relays.end(); ++relay)
+		auto relays = _typed_relays.Get();
+		for (auto& relay : *relays)
 		{
-			for (auto& slot : (*relay)->_slots)
+			auto slots = relay->_slots->Get();
+			for (const auto& record : *slots)
 			{
-				if (slot == slot_)
+				if (record.slot == slot_)
 				{
-					_typed_relays.erase(relay);
-					return true;
+					return _typed_relays.Remove(relay, false);
 				}
 			}
 		}
@@ -230,14 +289,14 @@ namespace mo
 	template<class...T>
 	bool TypedSignal<void(T...)>::Disconnect(std::weak_ptr<ISignalRelay> relay_)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
 		auto relay = relay_.lock();
-		auto itr = std::find(_typed_relays.begin(), _typed_relays.end(), relay);
-		if (itr != _typed_relays.end())
+		return _typed_relays.Update([&relay](std::vector<std::shared_ptr<TypedSignalRelay<void(T...)>>>& relays)
 		{
-			_typed_relays.erase(itr);
+			auto itr = std::find(relays.begin(), relays.end(), relay);
+			if (itr == relays.end())
+				return false;
+			relays.erase(itr);
 			return true;
-		}
-		return false;
+		}, false);
 	}
 }
\ No newline at end of file
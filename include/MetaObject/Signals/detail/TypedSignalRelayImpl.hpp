@@ -3,66 +3,188 @@
 #include "MetaObject/Thread/InterThread.hpp"
 #include "MetaObject/Logging/Log.hpp"
 #include "MetaObject/Signals/Connection.hpp"
+#include "MetaObject/Signals/ISlot.hpp"
 namespace mo
 {
 	template<class Sig> class TypedSignalRelay;
 
+	template<class...T>
+	TypedSignalRelay<void(T...)>::TypedSignalRelay():
+		_slots(std::make_shared<SnapshotList<SlotRecord>>()),
+		_generation(ISlot::GetContextGeneration())
+	{
+	}
+
+	template<class...T>
+	typename TypedSignalRelay<void(T...)>::Snapshot TypedSignalRelay<void(T...)>::GetSlots()
+	{
+		const size_t generation = ISlot::GetContextGeneration();
+		if (_generation.load(std::memory_order_acquire) != generation)
+		{
+			_slots->Update([](typename SnapshotList<SlotRecord>::List& list)
+			{
+				for (SlotRecord& record : list)
+					record.ctx = record.slot->GetContext();
+				return !list.empty();
+			}, false);
+			_generation.store(generation, std::memory_order_release);
+		}
+		return _slots->Get();
+	}
+
 	template<class...T> 
 	void TypedSignalRelay<void(T...)>::operator()(TypedSignal<void(T...)>* sig, T&... args)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		for (auto slot : _slots)
+		const Context* sig_ctx = sig->GetContext();
+		if (sig_ctx == nullptr)
 		{
-			auto slot_ctx = slot->GetContext();
-			auto sig_ctx = sig->GetContext();
-			if (slot_ctx && sig_ctx)
-			{
-				if (slot_ctx->process_id == sig_ctx->process_id)
-				{
-					if (slot_ctx->thread_id != sig_ctx->thread_id)
-					{
-                        ThreadSpecificQueue::Push(
-                            std::bind([slot](T... args)
-                        {
-                            (*slot)(args...);
-                        }, args...), slot_ctx->thread_id, slot);
-                        continue;
-					}
-				}
-			}
-            if(slot)
-			    (*slot)(args...);
+			(*this)(args...);
+			return;
 		}
+		RemoteCalls remote;
+		Dispatch(sig_ctx, remote, args...);
+		if (!remote.empty())
+			Queue(remote, args...);
 	}
     template<class...T>
     void TypedSignalRelay<void(T...)>::operator()(T&... args)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        for (auto slot : _slots)
+        auto slots = _slots->Get();
+        SignalDispatch dispatch(slots.get());
+        for (const SlotRecord& record : *slots)
         {
-            (*slot)(args...);
+            (*record.slot)(args...);
         }
     }
     template<class...T> 
     void TypedSignalRelay<void(T...)>::operator()(Context* ctx, T&... args)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        for (auto slot : _slots)
+        RemoteCalls remote;
+        Dispatch(ctx, remote, args...);
+        if (!remote.empty())
+            Queue(remote, args...);
+    }
+    template<class...T>
+    void TypedSignalRelay<void(T...)>::Dispatch(const Context* ctx, RemoteCalls& remote, T&... args)
+    {
+        auto slots = GetSlots();
+        SignalDispatch dispatch(slots.get());
+        // The emitting thread is read once rather than per slot, without a
+        // context the slots are compared to the calling thread
+        const size_t process_id = ctx ? ctx->process_id : 0;
+        const size_t thread_id = ctx ? ctx->thread_id : GetThisThread();
+        for (const SlotRecord& record : *slots)
         {
-            auto slot_ctx = slot->GetContext();
-            if(slot_ctx)
+            const Context* slot_ctx = record.ctx;
+            if(slot_ctx && (ctx == nullptr || slot_ctx->process_id == process_id))
             {
-                if(slot_ctx->process_id == ctx->process_id && slot_ctx->thread_id != ctx->thread_id)
+                const size_t slot_thread = slot_ctx->thread_id;
+                if(slot_thread != thread_id)
                 {
-                    ThreadSpecificQueue::Push(
-                        std::bind([slot](T... args)
-                        {
-                            (*slot)(args...);
-                        }, args...), slot_ctx->thread_id, slot);
+                    const QueuePriority priority = record.slot->GetQueuePriority();
+                    auto itr = std::find_if(remote.begin(), remote.end(),
+                        [slot_thread, priority](const RemoteThread& queued)
+                    {
+                        return queued.thread == slot_thread && queued.priority == priority;
+                    });
+                    if(itr == remote.end())
+                    {
+                        RemoteThread queued = {slot_thread, priority, std::vector<QueuedSlots>()};
+                        remote.push_back(queued);
+                        itr = remote.end() - 1;
+                    }
+                    if(itr->calls.empty() || itr->calls.back().list != _slots)
+                    {
+                        QueuedSlots queued;
+                        queued.list = _slots;
+                        itr->calls.push_back(queued);
+                    }
+                    std::shared_ptr<Mailbox> mailbox;
+                    if(record.slot->GetDeliveryPolicy() != QueueAll_e)
+                        mailbox = record.mailbox;
+                    itr->calls.back().slots.emplace_back(record.slot, mailbox);
                     continue;
                 }
             }
-            (*slot)(args...);
+            (*record.slot)(args...);
+        }
+    }
+    template<class...T>
+    void TypedSignalRelay<void(T...)>::Queue(RemoteCalls& remote, T&... args)
+    {
+        // The arguments are copied once and shared by the calls on every thread
+        std::shared_ptr<Payload> payload = std::make_shared<Payload>(
+            std::bind([](TypedSlot<void(T...)>* slot, T&... args)
+            {
+                (*slot)(args...);
+            }, std::placeholders::_1, args...));
+        for (auto& queued : remote)
+        {
+            std::vector<QueuedSlots> calls;
+            for (QueuedSlots& relay_calls : queued.calls)
+            {
+                auto itr = std::remove_if(relay_calls.slots.begin(), relay_calls.slots.end(),
+                    [&payload](const std::pair<TypedSlot<void(T...)>*, std::shared_ptr<Mailbox>>& call)
+                {
+                    const std::shared_ptr<Mailbox>& mailbox = call.second;
+                    if(!mailbox)
+                        return false;
+                    if(call.first->GetDeliveryPolicy() == DropWhenBusy_e)
+                    {
+                        if(mailbox->queued.exchange(true))
+                            return true;
+                        std::atomic_store(&mailbox->payload, payload);
+                        return false;
+                    }
+                    // The pending call delivers the latest arguments, otherwise queue one
+                    std::atomic_store(&mailbox->payload, payload);
+                    return mailbox->queued.exchange(true);
+                });
+                relay_calls.slots.erase(itr, relay_calls.slots.end());
+                if(!relay_calls.slots.empty())
+                    calls.push_back(std::move(relay_calls));
+            }
+            if(calls.empty())
+                continue;
+            ThreadSpecificQueue::Push([payload, calls]()
+            {
+                for (const QueuedSlots& relay_calls : calls)
+                {
+                    // A slot is destroyed only after it has been disconnected, which waits
+                    // for this snapshot, so the slots still in it can be called
+                    auto snapshot = relay_calls.list->Get();
+                    SignalDispatch dispatch(snapshot.get());
+                    for (const SlotRecord& record : *snapshot)
+                    {
+                        auto call = std::find_if(relay_calls.slots.begin(), relay_calls.slots.end(),
+                            [&record](const std::pair<TypedSlot<void(T...)>*, std::shared_ptr<Mailbox>>& queued_call)
+                        {
+                            return queued_call.first == record.slot;
+                        });
+                        if(call == relay_calls.slots.end())
+                            continue;
+                        const std::shared_ptr<Mailbox>& mailbox = call->second;
+                        if(!mailbox)
+                        {
+                            (*payload)(record.slot);
+                        }else if(record.slot->GetDeliveryPolicy() == DropWhenBusy_e)
+                        {
+                            // Busy until the call returns
+                            std::shared_ptr<Payload> latest = std::atomic_exchange(&mailbox->payload, std::shared_ptr<Payload>());
+                            if(latest)
+                                (*latest)(record.slot);
+                            mailbox->queued = false;
+                        }else
+                        {
+                            // Emissions from now on queue a new call
+                            mailbox->queued = false;
+                            std::shared_ptr<Payload> latest = std::atomic_exchange(&mailbox->payload, std::shared_ptr<Payload>());
+                            if(latest)
+                                (*latest)(record.slot);
+                        }
+                    }
+                }
+            }, queued.thread, nullptr, queued.priority);
         }
     }
 	
@@ -97,16 +219,17 @@ namespace mo
 	template<class...T>
 	bool TypedSignalRelay<void(T...)>::Connect(TypedSlot<void(T...)>* slot)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		_slots.insert(slot);
+		SlotRecord record = {slot, slot->GetContext(), std::make_shared<Mailbox>()};
+		_slots->Insert(record);
 		return true;
 	}
 
 	template<class...T> 
 	bool TypedSignalRelay<void(T...)>::Disconnect(ISlot* slot)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		return _slots.erase(static_cast<TypedSlot<void(T...)>*>(slot)) > 0;
+		// Waits for emissions on other threads so that the slot can be destroyed
+		SlotRecord record = {static_cast<TypedSlot<void(T...)>*>(slot), nullptr, std::shared_ptr<Mailbox>()};
+		return _slots->Remove(record, true);
 	}
 
 	template<class...T> 
@@ -122,24 +245,25 @@ namespace mo
 	}
 	template<class...T> bool TypedSignalRelay<void(T...)>::HasSlots() const
 	{
-		return _slots.size() !=  0;
+		return !_slots->Empty();
 	}
 	
 	// ------------------------------------------------------------------
 	// Return value specialization
 	template<class R, class...T> 
-	TypedSignalRelay<R(T...)>::TypedSignalRelay(): 
-		_slot(nullptr)
+	TypedSignalRelay<R(T...)>::TypedSignalRelay():
+		_slot(std::make_shared<SnapshotList<TypedSlot<R(T...)>*>>())
 	{
 	}
 
 	template<class R, class...T> 
 	R TypedSignalRelay<R(T...)>::operator()(TypedSignal<R(T...)>* sig, T&... args)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		if (_slot)
+        auto slot = _slot->Get();
+		if (!slot->empty())
 		{
-			return (*_slot)(args...);
+            SignalDispatch dispatch(slot.get());
+			return (*slot->front())(args...);
 		}
 		THROW(debug) << "Slot not connected";
 		return R();
@@ -148,20 +272,114 @@ namespace mo
     template<class R, class...T>
     R TypedSignalRelay<R(T...)>::operator()(Context* ctx, T&... args)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        if(_slot)
-            return (*_slot)(args...);
+        auto slot = _slot->Get();
+        if(!slot->empty())
+        {
+            SignalDispatch dispatch(slot.get());
+            return (*slot->front())(args...);
+        }
         THROW(debug) << "Slot not connected";
         return R();
     }
     template<class R, class... T>
     R TypedSignalRelay<R(T...)>::operator()(T&... args)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (_slot)
-            return (*_slot)(args...);
+        auto slot = _slot->Get();
+        if (!slot->empty())
+        {
+            SignalDispatch dispatch(slot.get());
+            return (*slot->front())(args...);
+        }
         THROW(debug) << "Slot not connected";
         return R();
+    }
+    template<class R, class... T>
+    std::future<R> TypedSignalRelay<R(T...)>::AsyncCall(const Context* ctx, T&... args)
+    {
+        auto slot = _slot->Get();
+        if (slot->empty())
+        {
+            THROW(debug) << "Slot not connected";
+            return std::future<R>();
+        }
+        RemoteCalls remote;
+        std::future<R> result = Dispatch(ctx, slot, remote, args...);
+        if (!remote.empty())
+            Queue(remote, args...);
+        return result;
+    }
+    template<class R, class... T>
+    std::future<R> TypedSignalRelay<R(T...)>::Dispatch(const Context* ctx, const Snapshot& slot, RemoteCalls& remote, T&... args)
+    {
+        TypedSlot<R(T...)>* typed = slot->front();
+        std::shared_ptr<std::promise<R>> promise = std::make_shared<std::promise<R>>();
+        std::future<R> result = promise->get_future();
+        const Context* slot_ctx = typed->GetContext();
+        const size_t thread_id = ctx ? ctx->thread_id : GetThisThread();
+        if (slot_ctx && (ctx == nullptr || slot_ctx->process_id == ctx->process_id) &&
+            slot_ctx->thread_id != thread_id)
+        {
+            const size_t slot_thread = slot_ctx->thread_id;
+            const QueuePriority priority = typed->GetQueuePriority();
+            auto itr = std::find_if(remote.begin(), remote.end(),
+                [slot_thread, priority](const RemoteThread& queued)
+            {
+                return queued.thread == slot_thread && queued.priority == priority;
+            });
+            if (itr == remote.end())
+            {
+                RemoteThread queued = {slot_thread, priority, std::vector<PendingCall>()};
+                remote.push_back(queued);
+                itr = remote.end() - 1;
+            }
+            PendingCall call = {_slot, typed, promise};
+            itr->calls.push_back(call);
+            return result;
+        }
+        SignalDispatch dispatch(slot.get());
+        try
+        {
+            promise->set_value((*typed)(args...));
+        }catch(...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+        return result;
+    }
+    template<class R, class... T>
+    void TypedSignalRelay<R(T...)>::Queue(RemoteCalls& remote, T&... args)
+    {
+        // The arguments are copied once and shared by the calls on every thread
+        std::shared_ptr<Payload> payload = std::make_shared<Payload>(
+            std::bind([](TypedSlot<R(T...)>* slot, T&... args)
+            {
+                return (*slot)(args...);
+            }, std::placeholders::_1, args...));
+        for (auto& queued : remote)
+        {
+            std::vector<PendingCall> calls;
+            calls.swap(queued.calls);
+            ThreadSpecificQueue::Push([payload, calls]()
+            {
+                for (const PendingCall& call : calls)
+                {
+                    // A slot is destroyed only after it has been disconnected, which waits
+                    // for this snapshot, so it can be called if it is still in it.
+                    // Otherwise the promise is broken once this call is released
+                    auto snapshot = call.list->Get();
+                    if (snapshot->empty() || snapshot->front() != call.slot)
+                        continue;
+                    SignalDispatch dispatch(snapshot.get());
+                    try
+                    {
+                        call.promise->set_value((*payload)(call.slot));
+                    }catch(...)
+                    {
+                        call.promise->set_exception(std::current_exception());
+                    }
+                }
+            }, queued.thread, nullptr, queued.priority);
+        }
     }
 	template<class R, class...T> 
 	bool TypedSignalRelay<R(T...)>::Connect(ISlot* slot)
@@ -177,11 +395,14 @@ namespace mo
 	template<class R, class...T>
 	bool TypedSignalRelay<R(T...)>::Connect(TypedSlot<R(T...)>* slot)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		if (_slot == slot)
-			return false;
-		_slot = slot;
-		return true;
+		// The replaced slot may be destroyed once this returns
+		return _slot->Update([slot](std::vector<TypedSlot<R(T...)>*>& list)
+		{
+			if (list.size() == 1 && list[0] == slot)
+				return false;
+			list.assign(1, slot);
+			return true;
+		}, true);
 	}
 
 	template<class R, class...T> 
@@ -199,13 +420,7 @@ namespace mo
 	template<class R, class...T> 
 	bool TypedSignalRelay<R(T...)>::Disconnect(ISlot* slot)
 	{
-        std::lock_guard<std::mutex> lock(mtx);
-		if (_slot == slot)
-		{
-			_slot = nullptr;
-			return true;
-		}
-		return false;
+		return _slot->Remove(static_cast<TypedSlot<R(T...)>*>(slot), true);
 	}
 	
 	template<class R, class...T> 
@@ -223,7 +438,7 @@ namespace mo
 	template<class R, class...T> 
 	bool TypedSignalRelay<R(T...)>::HasSlots() const
 	{
-		return _slot != nullptr;
+		return !_slot->Empty();
 	}
 	
 }
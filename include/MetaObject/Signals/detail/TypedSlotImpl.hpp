@@ -15,14 +15,14 @@ namespace mo
 
 	template<class R, class...T>
 	TypedSlot<R(T...)>::TypedSlot(const std::function<R(T...)>& other) :
-		std::function<R(T...)>(other)
+		Delegate<R(T...)>(other)
 	{
 		
 	}
     
     template<class R, class...T>
     TypedSlot<R(T...)>::TypedSlot(std::function<R(T...)>&& other):
-        std::function<R(T...)>(other)
+        Delegate<R(T...)>(std::move(other))
     {
     }
 
@@ -38,7 +38,14 @@ namespace mo
 	template<class R, class...T>
 	TypedSlot<R(T...)>& TypedSlot<R(T...)>::operator=(const std::function<R(T...)>& other)
 	{
-		std::function<R(T...)>::operator=(other);
+		Delegate<R(T...)>::operator=(other);
+		return *this;
+	}
+
+	template<class R, class...T>
+	TypedSlot<R(T...)>& TypedSlot<R(T...)>::operator=(const Delegate<R(T...)>& other)
+	{
+		Delegate<R(T...)>::operator=(other);
 		return *this;
 	}
 
@@ -6,13 +6,29 @@
 
 namespace mo
 {
+    /*!
+     * \brief QueuePriority is the lane of a thread's queue that a call is
+     *        pushed to.  Calls in higher lanes run first, but a lane that was
+     *        passed over ThreadSpecificQueue::StarvationLimit times in a row
+     *        runs its next call before any higher lane.
+     */
+    enum QueuePriority
+    {
+        LowPriority_e = 0,  // Background work, ie UI refreshes
+        NormalPriority_e,   // Data path, ie signal deliveries and parameter updates
+        HighPriority_e      // Control actions, ie stop, reconfigure and setting parameters
+    };
     class MO_EXPORTS ThreadSpecificQueue
     {
     public:
-        static void Push(const std::function<void(void)>& f, size_t id = GetThisThread(), void* obj = nullptr);
+        // Calls of higher lanes that a waiting call of a lower lane lets run before it
+        static const size_t StarvationLimit = 16;
+        static void Push(const std::function<void(void)>& f, size_t id = GetThisThread(), void* obj = nullptr,
+                         QueuePriority priority = NormalPriority_e);
         static void RemoveFromQueue(void* obj);
         static void Run(size_t id = GetThisThread());
-        static void RunOnce(size_t id = GetThisThread());
+        // Runs the next call of the queue, returns false if the queue is empty
+        static bool RunOnce(size_t id = GetThisThread());
         // Register a notifier function to signal new data input onto a queue
         static void RegisterNotifier(const std::function<void(void)>& f, size_t id = GetThisThread());
 		static size_t Size(size_t id = GetThisThread());
@@ -4,6 +4,7 @@
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <atomic>
 #include <functional>
 #include <queue>
 
@@ -16,7 +17,7 @@ namespace mo
     class MO_EXPORTS Thread
     {
     public:
-        // Events have to be handled by this thread
+        // Events have to be handled by this thread, they are queued ahead of signals and data
         void PushEventQueue(const std::function<void(void)>& f);
         // Work can be stolen and can exist on any thread
         void PushWork(const std::function<void(void)>& f);
@@ -31,6 +32,9 @@ namespace mo
         std::shared_ptr<Connection> SetInnerLoop(TypedSlot<int(void)>* slot);
         ThreadPool* GetPool() const;
         Context* GetContext() const;
+        // Pin the thread to the CPUs of a NUMA node so that its allocator draws node local memory, -1 unpins
+        void SetNumaNode(int node);
+        int GetNumaNode() const;
     protected:
         friend class ThreadPool;
         friend class ThreadHandle;
@@ -53,7 +57,8 @@ namespace mo
         boost::mutex              _mtx;
         bool                      _run;
         std::queue<std::function<void(void)>> _work_queue;
-        std::queue<std::function<void(void)>> _event_queue;
         bool _paused;
+        // Set and read from any thread
+        std::atomic<int> _numa_node;
     };
 }
\ No newline at end of file
@@ -35,6 +35,8 @@ namespace mo
         void SetExitCallback(const std::function<void(void)>& f);
         void SetStartCallback(const std::function<void(void)>& f);
         void SetThreadName(const std::string& name);
+        void SetNumaNode(int node);
+        int GetNumaNode() const;
         std::shared_ptr<Connection> SetInnerLoop(TypedSlot<int(void)>* slot);
     protected:
         friend class ThreadPool;
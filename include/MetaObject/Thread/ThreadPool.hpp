@@ -9,7 +9,8 @@ namespace mo
     {
     public:
         static ThreadPool* Instance();
-        ThreadHandle RequestThread();
+        // A non negative numa_node pins the thread to that node, see SetThreadNumaNode
+        ThreadHandle RequestThread(int numa_node = -1);
         void Cleanup();
     protected:
         friend class ThreadHandle;
@@ -0,0 +1,222 @@
+#include "MetaObject/Detail/AllocationProfile.hpp"
+#include "MetaObject/Detail/Allocator.hpp"
+#include "MetaObject/Detail/MemoryTrimmer.hpp"
+#include "MetaObject/Logging/Log.hpp"
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace mo;
+
+std::atomic<bool> AllocationProfiler::recording(false);
+
+namespace
+{
+    struct ProfilerState
+    {
+        boost::mutex mtx;
+        // Profiles of allocators destroyed while recording, by name
+        std::map<std::string, AllocationProfile> retired;
+        // Profiles read by Load, by name
+        std::map<std::string, AllocationProfile> loaded;
+    };
+
+    ProfilerState& State()
+    {
+        // Never destroyed, allocators retire their profiles from thread exit handlers
+        static ProfilerState* g_inst = new ProfilerState();
+        return *g_inst;
+    }
+
+    void Merge(std::map<std::string, AllocationProfile>& profiles, const AllocationProfile& profile)
+    {
+        AllocationProfile& merged = profiles[profile.name];
+        merged.name = profile.name;
+        merged.cpu.Merge(profile.cpu);
+        merged.gpu.Merge(profile.gpu);
+    }
+
+    void Write(std::ostream& os, const std::string& name, const char* device, const AllocationHistogram& histogram)
+    {
+        if(histogram.peak_counts.empty())
+            return;
+        os << name << '\t' << device << "\tpeak_bytes\t" << histogram.peak_bytes << '\n';
+        for(const auto& count : histogram.peak_counts)
+            os << name << '\t' << device << '\t' << count.first << '\t' << count.second << '\n';
+    }
+
+    // Does not log, so it is safe to call at exit after the logging core is gone
+    bool WriteProfiles(const std::string& path, size_t& count)
+    {
+        std::map<std::string, AllocationProfile> profiles;
+        {
+            ProfilerState& state = State();
+            boost::mutex::scoped_lock lock(state.mtx);
+            profiles = state.retired;
+        }
+        for(const AllocationProfile& profile : Allocator::GetLiveAllocationProfiles())
+        {
+            Merge(profiles, profile);
+        }
+        std::ofstream ofs(path.c_str());
+        if(!ofs.good())
+            return false;
+        ofs << "# MetaObject allocation profile: allocator, device, request size or peak_bytes, peak count\n";
+        count = 0;
+        for(const auto& itr : profiles)
+        {
+            if(itr.first.empty())
+                continue;
+            // Fields are tab separated
+            std::string name = itr.first;
+            std::replace(name.begin(), name.end(), '\t', ' ');
+            std::replace(name.begin(), name.end(), '\n', ' ');
+            Write(ofs, name, "cpu", itr.second.cpu);
+            Write(ofs, name, "gpu", itr.second.gpu);
+            ++count;
+        }
+        return ofs.good();
+    }
+
+    void SaveProfileAtExit();
+
+    struct EnvironmentStart
+    {
+        EnvironmentStart()
+        {
+            if(const char* path = std::getenv("MO_ALLOCATION_PROFILE"))
+            {
+                // The first run has nothing to load yet
+                if(std::ifstream(path).good())
+                    AllocationProfiler::Load(path);
+                AllocationProfiler::Start();
+                std::atexit(&SaveProfileAtExit);
+            }
+        }
+    } g_environment_start;
+
+    void SaveProfileAtExit()
+    {
+        size_t count;
+        if(const char* path = std::getenv("MO_ALLOCATION_PROFILE"))
+            WriteProfiles(path, count);
+        AllocationProfiler::Stop();
+    }
+}
+
+// ================================================================
+// AllocationHistogram
+void AllocationHistogram::Merge(const AllocationHistogram& other)
+{
+    for(const auto& count : other.peak_counts)
+    {
+        size_t& peak = peak_counts[count.first];
+        peak = std::max(peak, count.second);
+    }
+    peak_bytes = std::max(peak_bytes, other.peak_bytes);
+}
+
+AllocationHistogram AllocationHistogram::Range(size_t min_size, size_t max_size) const
+{
+    AllocationHistogram output;
+    size_t total = 0;
+    for(auto itr = peak_counts.lower_bound(min_size); itr != peak_counts.end() && itr->first < max_size; ++itr)
+    {
+        output.peak_counts.insert(*itr);
+        total += itr->first * itr->second;
+    }
+    output.peak_bytes = std::min(peak_bytes, total);
+    return output;
+}
+
+// ================================================================
+// AllocationProfiler
+void AllocationProfiler::Start()
+{
+    {
+        ProfilerState& state = State();
+        boost::mutex::scoped_lock lock(state.mtx);
+        state.retired.clear();
+    }
+    recording = true;
+}
+
+void AllocationProfiler::Stop()
+{
+    recording = false;
+}
+
+bool AllocationProfiler::Save(const std::string& path)
+{
+    size_t count = 0;
+    if(!WriteProfiles(path, count))
+    {
+        LOG(warning) << "Unable to save the allocation profile to " << path;
+        return false;
+    }
+    LOG(info) << "Saved the allocation profile of " << count << " allocators to " << path;
+    return true;
+}
+
+bool AllocationProfiler::Load(const std::string& path, std::chrono::milliseconds grace)
+{
+    std::ifstream ifs(path.c_str());
+    if(!ifs.good())
+    {
+        LOG(warning) << "Unable to open allocation profile " << path;
+        return false;
+    }
+    std::map<std::string, AllocationProfile> profiles;
+    std::string line;
+    while(std::getline(ifs, line))
+    {
+        if(line.empty() || line[0] == '#')
+            continue;
+        std::stringstream ss(line);
+        std::string name, device, size, count;
+        if(!std::getline(ss, name, '\t') || !std::getline(ss, device, '\t') ||
+           !std::getline(ss, size, '\t') || !std::getline(ss, count, '\t'))
+        {
+            LOG(warning) << "Skipping malformed allocation profile line '" << line << "'";
+            continue;
+        }
+        AllocationProfile& profile = profiles[name];
+        profile.name = name;
+        AllocationHistogram& histogram = device == "gpu" ? profile.gpu : profile.cpu;
+        const size_t value = static_cast<size_t>(std::strtoull(count.c_str(), nullptr, 10));
+        if(size == "peak_bytes")
+            histogram.peak_bytes = value;
+        else
+            histogram.peak_counts[static_cast<size_t>(std::strtoull(size.c_str(), nullptr, 10))] = value;
+    }
+    {
+        ProfilerState& state = State();
+        boost::mutex::scoped_lock lock(state.mtx);
+        state.loaded.swap(profiles);
+    }
+    MemoryTrimmer::Instance()->Defer(grace);
+    LOG(info) << "Loaded allocation profile " << path;
+    return true;
+}
+
+bool AllocationProfiler::GetProfile(const std::string& name, AllocationProfile& profile)
+{
+    ProfilerState& state = State();
+    boost::mutex::scoped_lock lock(state.mtx);
+    auto itr = state.loaded.find(name);
+    if(itr == state.loaded.end())
+        return false;
+    profile = itr->second;
+    return true;
+}
+
+void AllocationProfiler::Retire(const AllocationProfile& profile)
+{
+    if(profile.name.empty())
+        return;
+    ProfilerState& state = State();
+    boost::mutex::scoped_lock lock(state.mtx);
+    Merge(state.retired, profile);
+}
@@ -0,0 +1,276 @@
+#include "MetaObject/Detail/AllocationTrace.hpp"
+#include "MetaObject/Detail/Allocator.hpp"
+#include "MetaObject/Logging/Log.hpp"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+
+using namespace mo;
+
+std::atomic<bool> AllocationTrace::recording(false);
+
+namespace
+{
+    const char Magic[4] = {'M', 'O', 'A', 'T'};
+    const size_t BufferSize = 4096;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+    };
+
+    struct ThreadBuffer;
+
+    struct TraceState
+    {
+        boost::mutex mtx;
+        FILE* file = nullptr;
+        std::chrono::steady_clock::time_point start;
+        std::map<const Allocator*, uint16_t> allocator_ids;
+        std::set<ThreadBuffer*> buffers;
+        uint32_t next_thread = 0;
+        // Incremented by Start, invalidates the allocator ids cached by the threads
+        std::atomic<uint32_t> trace{0};
+
+        // Called with mtx held
+        void write(const AllocationTraceEvent* events, size_t count)
+        {
+            if(file && count)
+                fwrite(events, sizeof(AllocationTraceEvent), count, file);
+        }
+
+        // Called with mtx held
+        uint16_t getId(const Allocator* allocator, const std::string& name)
+        {
+            auto itr = allocator_ids.find(allocator);
+            if(itr != allocator_ids.end())
+                return itr->second;
+            uint16_t id = static_cast<uint16_t>(allocator_ids.size());
+            allocator_ids[allocator] = id;
+            writeName(id, name);
+            return id;
+        }
+
+        // Called with mtx held
+        void writeName(uint16_t id, const std::string& name)
+        {
+            if(!file)
+                return;
+            AllocationTraceEvent event;
+            memset(&event, 0, sizeof(event));
+            event.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+            event.allocator = id;
+            event.op = AllocationTraceEvent::Name_e;
+            event.size = name.size();
+            fwrite(&event, sizeof(event), 1, file);
+            fwrite(name.data(), 1, name.size(), file);
+        }
+    };
+
+    TraceState& State()
+    {
+        // Leaked so that threads exiting after main can still flush
+        static TraceState* g_inst = new TraceState();
+        return *g_inst;
+    }
+
+    struct ThreadBuffer
+    {
+        ThreadBuffer()
+        {
+            TraceState& state = State();
+            boost::mutex::scoped_lock lock(state.mtx);
+            thread = state.next_thread++;
+            state.buffers.insert(this);
+        }
+
+        ~ThreadBuffer()
+        {
+            TraceState& state = State();
+            boost::mutex::scoped_lock lock(state.mtx);
+            flush(state);
+            state.buffers.erase(this);
+        }
+
+        // Called with the state mutex held
+        void flush(TraceState& state)
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            state.write(events, count);
+            count = 0;
+        }
+
+        // Only contended while another thread starts or stops the trace
+        boost::mutex mtx;
+        AllocationTraceEvent events[BufferSize];
+        size_t count = 0;
+        uint32_t thread;
+        // Only used by the owning thread
+        const Allocator* last_allocator = nullptr;
+        uint16_t last_id = 0;
+        uint32_t last_trace = 0;
+    };
+
+    boost::thread_specific_ptr<ThreadBuffer> thread_buffer;
+
+    void StopTraceAtExit()
+    {
+        AllocationTrace::Stop();
+    }
+
+    struct EnvironmentStart
+    {
+        EnvironmentStart()
+        {
+            if(const char* path = std::getenv("MO_ALLOCATION_TRACE"))
+            {
+                if(AllocationTrace::Start(path))
+                    std::atexit(&StopTraceAtExit);
+            }
+        }
+    } g_environment_start;
+}
+
+bool AllocationTrace::Start(const std::string& path)
+{
+    TraceState& state = State();
+    boost::mutex::scoped_lock lock(state.mtx);
+    if(state.file)
+    {
+        LOG(warning) << "An allocation trace is already being recorded";
+        return false;
+    }
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file)
+    {
+        LOG(warning) << "Unable to open " << path << " for the allocation trace";
+        return false;
+    }
+    Header header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    fwrite(&header, sizeof(header), 1, file);
+    // Drop events that raced with the previous Stop
+    for(ThreadBuffer* buffer : state.buffers)
+    {
+        boost::mutex::scoped_lock buffer_lock(buffer->mtx);
+        buffer->count = 0;
+    }
+    state.file = file;
+    state.start = std::chrono::steady_clock::now();
+    state.allocator_ids.clear();
+    ++state.trace;
+    recording = true;
+    LOG(info) << "Recording allocation trace to " << path;
+    return true;
+}
+
+void AllocationTrace::Stop()
+{
+    TraceState& state = State();
+    boost::mutex::scoped_lock lock(state.mtx);
+    if(!state.file)
+        return;
+    recording = false;
+    for(ThreadBuffer* buffer : state.buffers)
+        buffer->flush(state);
+    fclose(state.file);
+    state.file = nullptr;
+}
+
+void AllocationTrace::Record(AllocationTraceEvent::Op op, AllocationTraceEvent::Device device,
+                             const Allocator* allocator, const void* ptr, size_t size)
+{
+    ThreadBuffer* buffer = thread_buffer.get();
+    if(buffer == nullptr)
+    {
+        buffer = new ThreadBuffer();
+        thread_buffer.reset(buffer);
+    }
+    TraceState& state = State();
+    const uint32_t trace = state.trace.load();
+    if(allocator != buffer->last_allocator || trace != buffer->last_trace)
+    {
+        // Named outside of the trace lock, GetName takes the allocator's lock
+        const std::string name = allocator->GetName();
+        boost::mutex::scoped_lock lock(state.mtx);
+        buffer->last_id = state.getId(allocator, name);
+        buffer->last_allocator = allocator;
+        buffer->last_trace = trace;
+    }
+    {
+        boost::mutex::scoped_lock lock(buffer->mtx);
+        AllocationTraceEvent& event = buffer->events[buffer->count++];
+        event.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - state.start).count();
+        event.ptr = reinterpret_cast<uint64_t>(ptr);
+        event.size = size;
+        event.thread = buffer->thread;
+        event.allocator = buffer->last_id;
+        event.op = static_cast<uint8_t>(op);
+        event.device = static_cast<uint8_t>(device);
+        if(buffer->count != BufferSize)
+            return;
+    }
+    boost::mutex::scoped_lock lock(state.mtx);
+    buffer->flush(state);
+}
+
+void AllocationTrace::Rename(const Allocator* allocator, const std::string& name)
+{
+    TraceState& state = State();
+    boost::mutex::scoped_lock lock(state.mtx);
+    auto itr = state.allocator_ids.find(allocator);
+    if(itr != state.allocator_ids.end())
+        state.writeName(itr->second, name);
+}
+
+bool AllocationTrace::Read(const std::string& path,
+                           std::vector<AllocationTraceEvent>& events,
+                           std::vector<std::string>* names)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file)
+        return false;
+    Header header;
+    if(fread(&header, sizeof(header), 1, file) != 1 ||
+       memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+       header.version != Version)
+    {
+        fclose(file);
+        return false;
+    }
+    AllocationTraceEvent event;
+    while(fread(&event, sizeof(event), 1, file) == 1)
+    {
+        if(event.op == AllocationTraceEvent::Name_e)
+        {
+            std::string name(static_cast<size_t>(event.size), '\0');
+            if(event.size && fread(&name[0], 1, name.size(), file) != name.size())
+                break;
+            if(names)
+            {
+                if(names->size() <= event.allocator)
+                    names->resize(event.allocator + 1);
+                (*names)[event.allocator] = name;
+            }
+            continue;
+        }
+        events.push_back(event);
+    }
+    fclose(file);
+    std::stable_sort(events.begin(), events.end(),
+        [](const AllocationTraceEvent& lhs, const AllocationTraceEvent& rhs)
+    {
+        return lhs.time < rhs.time;
+    });
+    return true;
+}
@@ -1,4 +1,18 @@
 #include "MetaObject/Detail/AllocatorImpl.hpp"
+#include "MetaObject/Detail/AllocationProfile.hpp"
+#include "MetaObject/Detail/AllocationTrace.hpp"
+#include "MetaObject/Detail/HostMemoryBackend.hpp"
+#include "MetaObject/Detail/MemoryTrimmer.hpp"
+#include "MetaObject/Detail/Numa.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 using namespace mo;
 boost::thread_specific_ptr<Allocator> thread_specific_allocator;
@@ -129,25 +143,291 @@ const std::string& mo::GetScopeName()
     return *current_scope;
 }
 
-class CpuMemoryPoolImpl: public CpuMemoryPool
+namespace
+{
+    /*!
+     * \brief The BlockRegistry class maps the blocks of every CpuMemoryPool to
+     *        their pool so that a free on any thread can find the home pool.
+     *        Entries are kept sorted by address and looked up with a binary
+     *        search.  Lookups take no lock: writers bump a sequence number
+     *        before and after changing the entries, and a lookup that saw it
+     *        change retries.  A block is only removed once it has no
+     *        allocations left, so the entry of a live pointer is found by the
+     *        retry.
+     */
+    class BlockRegistry
+    {
+    public:
+        enum { MaxBlocks = 4096 };
+        static BlockRegistry& Instance()
+        {
+            static BlockRegistry* g_inst = new BlockRegistry();
+            return *g_inst;
+        }
+
+        void Add(const CpuMemoryBlock& block, CpuMemoryPool* pool, bool node)
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            const size_t n = count.load(std::memory_order_relaxed);
+            if(n == MaxBlocks)
+            {
+                THROW(warning) << "Exceeded " << MaxBlocks << " CPU memory pool blocks";
+            }
+            const size_t index = LowerBound(block.Begin(), n);
+            BeginWrite();
+            for(size_t i = n; i > index; --i)
+                Copy(entries[i - 1], entries[i]);
+            entries[index].begin.store(block.Begin(), std::memory_order_relaxed);
+            entries[index].end.store(block.End(), std::memory_order_relaxed);
+            entries[index].pool.store(pool, std::memory_order_relaxed);
+            entries[index].node.store(node, std::memory_order_relaxed);
+            count.store(n + 1, std::memory_order_relaxed);
+            EndWrite();
+        }
+
+        void Remove(const CpuMemoryBlock& block)
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            const size_t n = count.load(std::memory_order_relaxed);
+            const size_t index = LowerBound(block.Begin(), n);
+            if(index == n || entries[index].begin.load(std::memory_order_relaxed) != block.Begin())
+                return;
+            BeginWrite();
+            for(size_t i = index + 1; i < n; ++i)
+                Copy(entries[i], entries[i - 1]);
+            count.store(n - 1, std::memory_order_relaxed);
+            EndWrite();
+        }
+
+        CpuMemoryPool* Find(const void* ptr, bool nodes_only) const
+        {
+            const unsigned char* address = static_cast<const unsigned char*>(ptr);
+            while(true)
+            {
+                const size_t sequence = version.load(std::memory_order_acquire);
+                if(sequence & 1)
+                {
+                    boost::this_thread::yield();
+                    continue;
+                }
+                const size_t n = std::min<size_t>(count.load(std::memory_order_relaxed), MaxBlocks);
+                // Last entry that begins at or before ptr
+                size_t index = UpperBound(address, n);
+                CpuMemoryPool* pool = nullptr;
+                if(index > 0)
+                {
+                    const Entry& entry = entries[index - 1];
+                    if(address < entry.end.load(std::memory_order_relaxed) &&
+                       (entry.node.load(std::memory_order_relaxed) || !nodes_only))
+                        pool = entry.pool.load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(version.load(std::memory_order_relaxed) == sequence)
+                    return pool;
+            }
+        }
+    private:
+        BlockRegistry():
+            version(0),
+            count(0){}
+        struct Entry
+        {
+            std::atomic<const unsigned char*> begin{nullptr};
+            std::atomic<const unsigned char*> end{nullptr};
+            std::atomic<CpuMemoryPool*> pool{nullptr};
+            std::atomic<bool> node{false};
+        };
+
+        static void Copy(const Entry& src, Entry& dst)
+        {
+            dst.begin.store(src.begin.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            dst.end.store(src.end.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            dst.pool.store(src.pool.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            dst.node.store(src.node.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+        // First entry that begins at or after ptr
+        size_t LowerBound(const unsigned char* ptr, size_t n) const
+        {
+            size_t low = 0;
+            while(low < n)
+            {
+                const size_t mid = low + (n - low) / 2;
+                if(entries[mid].begin.load(std::memory_order_relaxed) < ptr)
+                    low = mid + 1;
+                else
+                    n = mid;
+            }
+            return low;
+        }
+
+        // First entry that begins after ptr
+        size_t UpperBound(const unsigned char* ptr, size_t n) const
+        {
+            size_t low = 0;
+            while(low < n)
+            {
+                const size_t mid = low + (n - low) / 2;
+                if(entries[mid].begin.load(std::memory_order_relaxed) <= ptr)
+                    low = mid + 1;
+                else
+                    n = mid;
+            }
+            return low;
+        }
+
+        // Writers hold mtx, lookups retry while the sequence number is odd or changed
+        void BeginWrite()
+        {
+            version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void EndWrite()
+        {
+            version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        boost::mutex mtx;
+        std::atomic<size_t> version;
+        std::atomic<size_t> count;
+        Entry entries[MaxBlocks];
+    };
+}
+
+/*!
+ * \brief The CpuMemoryPoolImpl class sub allocates from a list of large
+ *        blocks.  Blocks that have been completely free for longer than the
+ *        MemoryTrimmer's maximum age are released by the trimmer thread, which
+ *        is why every access goes through the pool mutex.  A pool with a NUMA
+ *        node places its blocks on that node and keeps them for its lifetime.
+ */
+class CpuMemoryPoolImpl: public CpuMemoryPool, public ITrimmable
 {
 public:
-    CpuMemoryPoolImpl(size_t initial_size = 1e8):
+    CpuMemoryPoolImpl(size_t initial_size = 1e8, int numa_node_ = -1):
+        total_usage(0),
         _initial_block_size(initial_size),
-        total_usage(0)
+        numa_node(numa_node_)
+    {
+        blocks.emplace_back(createBlock(_initial_block_size));
+        MemoryTrimmer::Instance()->Register(this);
+    }
+
+    ~CpuMemoryPoolImpl()
     {
-        blocks.emplace_back(new mo::CpuMemoryBlock(_initial_block_size));
+        MemoryTrimmer::Instance()->Unregister(this);
+        for(const auto& itr : blocks)
+            BlockRegistry::Instance().Remove(*itr.block);
     }
 
     bool allocate(void** ptr, size_t total, size_t elemSize)
     {
+        boost::mutex::scoped_lock lock(mtx);
+        return allocateImpl(ptr, total, elemSize);
+    }
+
+    uchar* allocate(size_t num_bytes)
+    {
+        uchar* ptr = nullptr;
+        boost::mutex::scoped_lock lock(mtx);
+        allocateImpl((void**)&ptr, num_bytes, sizeof(uchar));
+        return ptr;
+    }
+
+    bool deallocate(void* ptr, size_t total)
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        return deallocateImpl(ptr, total);
+    }
+
+    size_t Trim(std::chrono::milliseconds max_age, size_t bytes)
+    {
+        // Node pools keep their blocks for the lifetime of the process
+        if(numa_node >= 0)
+            return 0;
+        boost::mutex::scoped_lock lock(mtx);
+        const auto now = std::chrono::steady_clock::now();
+        size_t released = 0;
+        // The initial block is the pool's reservation, it is only released above the high watermark
+        for(auto itr = blocks.empty() ? blocks.end() : std::next(blocks.begin()); itr != blocks.end(); )
+        {
+            if(itr->block->FreeBytes() == itr->block->Size() && now - itr->empty_since > max_age)
+            {
+                released += itr->block->Size();
+                BlockRegistry::Instance().Remove(*itr->block);
+                itr = blocks.erase(itr);
+            }else
+            {
+                ++itr;
+            }
+        }
+        while(released < bytes)
+        {
+            // Release the block that has been empty the longest
+            auto oldest = blocks.end();
+            for(auto itr = blocks.begin(); itr != blocks.end(); ++itr)
+            {
+                if(itr->block->FreeBytes() == itr->block->Size() &&
+                    (oldest == blocks.end() || itr->empty_since < oldest->empty_since))
+                {
+                    oldest = itr;
+                }
+            }
+            if(oldest == blocks.end())
+                break;
+            released += oldest->block->Size();
+            BlockRegistry::Instance().Remove(*oldest->block);
+            blocks.erase(oldest);
+        }
+        if(released)
+        {
+            LOG(debug) << "[CPU] Released " << released / (1024 * 1024) << " MB of unused pool blocks";
+        }
+        return released;
+    }
+
+    size_t GetCachedBytes() const
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        size_t cached = 0;
+        for(const auto& itr : blocks)
+        {
+            if(itr.block->FreeBytes() == itr.block->Size())
+                cached += itr.block->Size();
+        }
+        return cached;
+    }
+
+    void Reserve(size_t bytes)
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        size_t capacity = 0;
+        for(const auto& itr : blocks)
+            capacity += itr.block->Size();
+        if(capacity >= bytes)
+            return;
+        blocks.emplace_back(createBlock(bytes - capacity));
+        HostMemoryBackend::Prefault(blocks.back().block->Begin(), blocks.back().block->Size());
+        LOG(debug) << "[CPU] Reserved " << (bytes - capacity) / (1024 * 1024) << " MB of pool blocks";
+    }
+
+protected:
+    // Callers must hold mtx
+    bool allocateImpl(void** ptr, size_t total, size_t elemSize)
+    {
+        if(blocks.empty())
+        {
+            blocks.emplace_back(createBlock(std::max(_initial_block_size, total)));
+        }
         int index = 0;
         unsigned char* _ptr;
-        for (auto& block : blocks)
+        for (auto& itr : blocks)
         {
-            _ptr = block->allocate(total, elemSize);
+            _ptr = itr.block->allocate(total, elemSize);
             if (_ptr)
             {
+                PoolTally::Hit();
                 *ptr = _ptr;
                 LOG(trace) << "Allocating " << total << " bytes from pre-allocated memory block number "
                            << index << " at address: " << (void*)_ptr;
@@ -156,10 +436,9 @@ public:
             ++index;
         }
         LOG(trace) << "Creating new block of page locked memory for allocation.";
-        blocks.push_back(
-            std::shared_ptr<mo::CpuMemoryBlock>(
-                new mo::CpuMemoryBlock(std::max(_initial_block_size / 2, total))));
-        _ptr = (*blocks.rbegin())->allocate(total, elemSize);
+        PoolTally::Miss();
+        blocks.emplace_back(createBlock(std::max(_initial_block_size / 2, total)));
+        _ptr = blocks.back().block->allocate(total, elemSize);
         if (_ptr)
         {
             LOG(debug) << "Allocating " << total
@@ -167,239 +446,1254 @@ public:
             *ptr = _ptr;
             return true;
         }
-        return false;
+        return false;
+    }
+
+    bool deallocateImpl(void* ptr, size_t total)
+    {
+        LOG(trace) << "Releasing memory block of size "
+                   << total << " at address: " << ptr;
+        return returnToBlock(ptr);
+    }
+
+    // Does not log, so it is safe to call from thread exit handlers after the
+    // logging thread locals are gone
+    bool returnToBlock(void* ptr)
+    {
+        for (auto& itr : blocks)
+        {
+            if (ptr >= itr.block->Begin() && ptr < itr.block->End())
+            {
+                if (itr.block->deAllocate((unsigned char*)ptr))
+                {
+                    if(itr.block->FreeBytes() == itr.block->Size())
+                        itr.empty_since = std::chrono::steady_clock::now();
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    mutable boost::mutex mtx;
+    const int numa_node;
+private:
+    std::shared_ptr<mo::CpuMemoryBlock> createBlock(size_t size)
+    {
+        auto block = numa_node < 0 ? std::make_shared<mo::CpuMemoryBlock>(size) :
+                                     std::make_shared<mo::CpuMemoryBlock>(size, numa_node);
+        BlockRegistry::Instance().Add(*block, this, numa_node >= 0);
+        return block;
+    }
+
+    struct PoolBlock
+    {
+        PoolBlock(const std::shared_ptr<mo::CpuMemoryBlock>& block_):
+            block(block_), empty_since(std::chrono::steady_clock::now()){}
+        std::shared_ptr<mo::CpuMemoryBlock> block;
+        // Only meaningful while the block has no allocations
+        std::chrono::steady_clock::time_point empty_since;
+    };
+    size_t total_usage;
+    size_t _initial_block_size;
+    std::list<PoolBlock> blocks;
+};
+
+/*!
+ * \brief The mt_CpuMemoryPoolImpl class puts a per thread cache of size class
+ *        magazines in front of the shared pool.  Requests up to the largest
+ *        size class are rounded up to a power of two and served from the calling
+ *        thread's magazine without locking.  An empty magazine is refilled and a
+ *        full magazine is flushed in batches so the pool lock is taken once per
+ *        batch instead of once per request.  Larger requests lock the pool directly.
+ */
+class mt_CpuMemoryPoolImpl: public CpuMemoryPoolImpl
+{
+public:
+    enum
+    {
+        MinClassShift = 6,          // 64 bytes, one cache line
+        MaxClassShift = 19,         // 512 KB, the CombinedPolicy small / large threshold
+        NumClasses = MaxClassShift - MinClassShift + 1,
+        MaxMagazineDepth = 64,
+        MagazineBytes = 1024 * 1024 // Upper bound of cached bytes per size class per thread
+    };
+
+    mt_CpuMemoryPoolImpl(int numa_node = -1):
+        CpuMemoryPoolImpl(1e8, numa_node),
+        thread_cache(&mt_CpuMemoryPoolImpl::releaseThreadCache)
+    {
+    }
+
+    bool allocate(void** ptr, size_t total, size_t elemSize)
+    {
+        if(uchar* cached = allocateCached(total, elemSize))
+        {
+            *ptr = cached;
+            return true;
+        }
+        boost::mutex::scoped_lock lock(mtx);
+        ++retired.pool_allocations;
+        return allocateImpl(ptr, AllocationSize(total), elemSize);
+    }
+
+    uchar* allocate(size_t total)
+    {
+        if(uchar* cached = allocateCached(total, sizeof(uchar)))
+        {
+            return cached;
+        }
+        boost::mutex::scoped_lock lock(mtx);
+        ++retired.pool_allocations;
+        uchar* ptr = nullptr;
+        allocateImpl((void**)&ptr, AllocationSize(total), sizeof(uchar));
+        return ptr;
+    }
+
+    bool deallocate(void* ptr, size_t total)
+    {
+        // Frees from threads on another node go straight back to the pool instead
+        // of sitting in a cache that thread never allocates from
+        if((numa_node < 0 || GetThreadNumaNode() == numa_node) &&
+            deallocateCached(static_cast<uchar*>(ptr), total))
+        {
+            return true;
+        }
+        boost::mutex::scoped_lock lock(mtx);
+        ++retired.pool_deallocations;
+        return deallocateImpl(ptr, total);
+    }
+
+    CpuMemoryPoolStatistics GetStatistics() const
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        CpuMemoryPoolStatistics output = retired;
+        for(const ThreadCache* cache : caches)
+        {
+            output.cache_hits += cache->hits.load(std::memory_order_relaxed);
+            output.cache_refills += cache->refills.load(std::memory_order_relaxed);
+            output.cache_flushes += cache->flushes.load(std::memory_order_relaxed);
+        }
+        return output;
+    }
+
+private:
+    struct ThreadCache
+    {
+        ThreadCache(mt_CpuMemoryPoolImpl* pool_):
+            pool(pool_), hits(0), refills(0), flushes(0)
+        {
+            for(int i = 0; i < NumClasses; ++i)
+            {
+                magazines[i].reserve(MagazineDepth(i));
+            }
+        }
+        mt_CpuMemoryPoolImpl* pool;
+        std::vector<uchar*> magazines[NumClasses];
+        // Only written by the owning thread, read by GetStatistics
+        std::atomic<size_t> hits;
+        std::atomic<size_t> refills;
+        std::atomic<size_t> flushes;
+    };
+
+    static int SizeClass(size_t total)
+    {
+        if(total == 0 || total > (size_t(1) << MaxClassShift))
+            return -1;
+        int shift = MinClassShift;
+        while((size_t(1) << shift) < total)
+            ++shift;
+        return shift - MinClassShift;
+    }
+
+    static size_t ClassSize(int size_class)
+    {
+        return size_t(1) << (size_class + MinClassShift);
+    }
+
+    // Every block of a size class spans the whole class, whichever path allocated it,
+    // since a free caches it for any later request of the class
+    static size_t AllocationSize(size_t total)
+    {
+        const int size_class = SizeClass(total);
+        return size_class < 0 ? total : ClassSize(size_class);
+    }
+
+    // Alignment of the blocks that refill a magazine
+    static size_t RefillAlignment(int size_class)
+    {
+        return std::min<size_t>(ClassSize(size_class), 64);
+    }
+
+    static size_t MagazineDepth(int size_class)
+    {
+        return std::max<size_t>(2, std::min<size_t>(MaxMagazineDepth, MagazineBytes / ClassSize(size_class)));
+    }
+
+    static void Increment(std::atomic<size_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static void releaseThreadCache(ThreadCache* cache)
+    {
+        cache->pool->retireThreadCache(cache);
+        delete cache;
+    }
+
+    ThreadCache* getThreadCache()
+    {
+        ThreadCache* cache = thread_cache.get();
+        if(cache == nullptr)
+        {
+            cache = new ThreadCache(this);
+            thread_cache.reset(cache);
+            boost::mutex::scoped_lock lock(mtx);
+            caches.insert(cache);
+        }
+        return cache;
+    }
+
+    uchar* allocateCached(size_t total, size_t elemSize)
+    {
+        int size_class = SizeClass(total);
+        if(size_class < 0)
+            return nullptr;
+        ThreadCache* cache = getThreadCache();
+        std::vector<uchar*>& magazine = cache->magazines[size_class];
+        // A freed block is only aligned as its previous user asked for, requests that
+        // need a stricter alignment than the next cached block take the slow path
+        if(elemSize > 1)
+        {
+            const size_t offset = magazine.empty() ? RefillAlignment(size_class) % elemSize :
+                                                     reinterpret_cast<size_t>(magazine.back()) % elemSize;
+            if(offset != 0)
+                return nullptr;
+        }
+        if(magazine.empty())
+        {
+            // Refill half of the magazine so that a following free does not immediately flush
+            const size_t batch = std::max<size_t>(1, MagazineDepth(size_class) / 2);
+            const size_t class_size = ClassSize(size_class);
+            // Attribute one hit or miss to the request rather than one per refilled block
+            const PoolTally tally = PoolTally::Thread();
+            {
+                boost::mutex::scoped_lock lock(mtx);
+                for(size_t i = 0; i < batch; ++i)
+                {
+                    uchar* ptr = nullptr;
+                    if(!allocateImpl((void**)&ptr, class_size, RefillAlignment(size_class)))
+                        break;
+                    magazine.push_back(ptr);
+                }
+            }
+            const bool grew = PoolTally::Thread().misses != tally.misses;
+            PoolTally::Thread() = tally;
+            grew ? PoolTally::Miss() : PoolTally::Hit();
+            Increment(cache->refills);
+            if(magazine.empty())
+                return nullptr;
+        }else
+        {
+            Increment(cache->hits);
+            PoolTally::Hit();
+        }
+        uchar* ptr = magazine.back();
+        magazine.pop_back();
+        return ptr;
+    }
+
+    bool deallocateCached(uchar* ptr, size_t total)
+    {
+        int size_class = SizeClass(total);
+        if(size_class < 0 || ptr == nullptr)
+            return false;
+        ThreadCache* cache = getThreadCache();
+        std::vector<uchar*>& magazine = cache->magazines[size_class];
+        if(magazine.size() >= MagazineDepth(size_class))
+        {
+            // Flush the older half of the magazine, keeping the recently freed (warm) blocks
+            const size_t batch = magazine.size() / 2;
+            const size_t class_size = ClassSize(size_class);
+            {
+                boost::mutex::scoped_lock lock(mtx);
+                for(size_t i = 0; i < batch; ++i)
+                {
+                    deallocateImpl(magazine[i], class_size);
+                }
+            }
+            magazine.erase(magazine.begin(), magazine.begin() + batch);
+            Increment(cache->flushes);
+        }
+        magazine.push_back(ptr);
+        return true;
+    }
+
+    void retireThreadCache(ThreadCache* cache)
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        for(int i = 0; i < NumClasses; ++i)
+        {
+            for(uchar* ptr : cache->magazines[i])
+            {
+                returnToBlock(ptr);
+            }
+            cache->magazines[i].clear();
+        }
+        retired.cache_hits += cache->hits.load(std::memory_order_relaxed);
+        retired.cache_refills += cache->refills.load(std::memory_order_relaxed);
+        retired.cache_flushes += cache->flushes.load(std::memory_order_relaxed);
+        caches.erase(cache);
+    }
+
+    boost::thread_specific_ptr<ThreadCache> thread_cache;
+    std::set<ThreadCache*> caches;
+    CpuMemoryPoolStatistics retired;
+};
+
+/*!
+ * \brief The ThreadCpuMemoryPoolImpl class is the pool of a single thread.
+ *        Frees from other threads can not touch the blocks without racing the
+ *        owner, so they are pushed on an intrusive lock free list, with the
+ *        link stored in the freed memory, and returned to the blocks by the
+ *        owner on its next allocation.  Every allocation holds a reference on
+ *        the pool, as does the owning thread, so the pool is destroyed by
+ *        whichever of them lets go last.
+ */
+class ThreadCpuMemoryPoolImpl: public CpuMemoryPoolImpl
+{
+public:
+    ThreadCpuMemoryPoolImpl():
+        refs(1),
+        orphaned(false),
+        remote_head(nullptr),
+        remote_deallocations(0),
+        remote_drains(0)
+    {
+        t_owned_pool = this;
+    }
+
+    // Thread exit handler, does not log
+    static void Retire(CpuMemoryPool* pool)
+    {
+        ThreadCpuMemoryPoolImpl* impl = static_cast<ThreadCpuMemoryPoolImpl*>(pool);
+        t_owned_pool = nullptr;
+        {
+            boost::mutex::scoped_lock lock(impl->mtx);
+            impl->drain();
+            impl->orphaned = true;
+        }
+        impl->release();
+    }
+
+    bool allocate(void** ptr, size_t total, size_t elemSize)
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        drain();
+        // A freed allocation has to be able to hold the remote free link
+        if(allocateImpl(ptr, std::max(total, sizeof(void*)), elemSize))
+        {
+            refs.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    uchar* allocate(size_t num_bytes)
+    {
+        uchar* ptr = nullptr;
+        allocate((void**)&ptr, num_bytes, sizeof(uchar));
+        return ptr;
+    }
+
+    bool deallocate(void* ptr, size_t total)
+    {
+        // Nobody drains the list of a pool whose thread has exited
+        if(t_owned_pool == this || orphaned.load(std::memory_order_acquire))
+        {
+            bool result;
+            {
+                boost::mutex::scoped_lock lock(mtx);
+                result = deallocateImpl(ptr, total);
+            }
+            if(result)
+                release();
+            return result;
+        }else
+        {
+            void* head = remote_head.load(std::memory_order_relaxed);
+            do
+            {
+                memcpy(ptr, &head, sizeof(head));
+            }while(!remote_head.compare_exchange_weak(head, ptr, std::memory_order_release,
+                                                      std::memory_order_relaxed));
+            remote_deallocations.fetch_add(1, std::memory_order_relaxed);
+            release();
+            return true;
+        }
+    }
+
+    CpuMemoryPoolStatistics GetStatistics() const
+    {
+        CpuMemoryPoolStatistics output;
+        output.remote_deallocations = remote_deallocations.load(std::memory_order_relaxed);
+        output.remote_drains = remote_drains.load(std::memory_order_relaxed);
+        return output;
+    }
+
+private:
+    // Callers must hold mtx
+    void drain()
+    {
+        if(remote_head.load(std::memory_order_relaxed) == nullptr)
+            return;
+        void* node = remote_head.exchange(nullptr, std::memory_order_acquire);
+        while(node)
+        {
+            void* next;
+            memcpy(&next, node, sizeof(next));
+            returnToBlock(node);
+            node = next;
+        }
+        remote_drains.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+        if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    static thread_local ThreadCpuMemoryPoolImpl* t_owned_pool;
+    std::atomic<size_t> refs;
+    std::atomic<bool> orphaned;
+    std::atomic<void*> remote_head;
+    std::atomic<size_t> remote_deallocations;
+    std::atomic<size_t> remote_drains;
+};
+
+thread_local ThreadCpuMemoryPoolImpl* ThreadCpuMemoryPoolImpl::t_owned_pool = nullptr;
+
+CpuMemoryPool* CpuMemoryPool::GlobalInstance()
+{
+    static CpuMemoryPool* g_inst = nullptr;
+    if(g_inst == nullptr)
+    {
+        g_inst = new mt_CpuMemoryPoolImpl();
+    }
+    return g_inst;
+}
+
+CpuMemoryPool* CpuMemoryPool::ThreadInstance()
+{
+    static boost::thread_specific_ptr<CpuMemoryPool> g_inst(&ThreadCpuMemoryPoolImpl::Retire);
+    if(g_inst.get() == nullptr)
+    {
+        g_inst.reset(new ThreadCpuMemoryPoolImpl());
+    }
+    return g_inst.get();
+}
+
+CpuMemoryPool* CpuMemoryPool::NodeInstance(int node)
+{
+    static const int num_nodes = GetNumaNodeCount();
+    if(node < 0 || node >= num_nodes || num_nodes < 2)
+    {
+        return GlobalInstance();
+    }
+    static std::atomic<CpuMemoryPool*>* g_inst = new std::atomic<CpuMemoryPool*>[num_nodes]();
+    static boost::mutex* mtx = new boost::mutex();
+    CpuMemoryPool* pool = g_inst[node].load(std::memory_order_acquire);
+    if(pool == nullptr)
+    {
+        boost::mutex::scoped_lock lock(*mtx);
+        pool = g_inst[node].load(std::memory_order_relaxed);
+        if(pool == nullptr)
+        {
+            pool = new mt_CpuMemoryPoolImpl(node);
+            g_inst[node].store(pool, std::memory_order_release);
+        }
+    }
+    return pool;
+}
+
+CpuMemoryPool* CpuMemoryPool::FindNodeInstance(const void* ptr)
+{
+    return BlockRegistry::Instance().Find(ptr, true);
+}
+
+CpuMemoryPool* CpuMemoryPool::FindInstance(const void* ptr)
+{
+    return BlockRegistry::Instance().Find(ptr, false);
+}
+
+namespace
+{
+    // Pool that a thread allocates from, node local if the thread is pinned
+    CpuMemoryPool* LocalPool(CpuMemoryPool* unpinned)
+    {
+        const int node = GetThreadNumaNode();
+        if(node >= 0 && GetNumaNodeCount() > 1)
+            return CpuMemoryPool::NodeInstance(node);
+        return unpinned;
+    }
+
+    // Pool that ptr has to be returned to
+    CpuMemoryPool* HomePool(const void* ptr, CpuMemoryPool* unpinned)
+    {
+        CpuMemoryPool* pool = CpuMemoryPool::FindInstance(ptr);
+        return pool ? pool : unpinned;
+    }
+}
+
+/*!
+ * \brief The CpuMemoryStackImpl class caches freed blocks on per size class
+ *        free stacks.  Requests are rounded up to geometric size classes,
+ *        1 / max_waste classes per power of two, so that a block can serve any
+ *        request within the allowed slack and reuse is a hash lookup plus a pop.
+ *        Deallocation only pushes the block, blocks that stay unused are
+ *        returned to the host backend by the MemoryTrimmer thread.  Since the
+ *        trimmer may run at any time the stack is always locked, for the thread
+ *        specific instance the lock is uncontended.
+ *        A block freed on another thread than the one that allocated it is
+ *        returned to the stack that allocated it, which is looked up in the
+ *        BlockOwners index.  A stack that is destroyed with blocks still in use,
+ *        ie by the exit of its thread, hands them over to the global stack.
+ *        Lock order is owner shard, stack, global stack, so the backend is
+ *        called and the index updated without holding the stack lock.
+ */
+class CpuMemoryStackImpl: public CpuMemoryStack, public ITrimmable
+{
+public:
+    typedef cv::Mat MatType;
+    typedef std::chrono::steady_clock clock_type;
+    // Blocks of one size class in release order, evicted from the front and reused from the back
+    typedef std::deque<std::pair<unsigned char*, clock_type::time_point>> FreeStack;
+    CpuMemoryStackImpl(double max_waste = 0.125):
+        total_usage(0),
+        backend(HostMemoryBackend::GetDefault())
+    {
+        SetMaxWaste(max_waste);
+        MemoryTrimmer::Instance()->Register(this);
+    }
+
+    ~CpuMemoryStackImpl()
+    {
+        MemoryTrimmer::Instance()->Unregister(this);
+        CpuMemoryStackImpl* global = static_cast<CpuMemoryStackImpl*>(GlobalInstance());
+        BlockOwners& owners = GetBlockOwners();
+        // Runs on thread exit for the thread instance, so does not log
+        std::vector<uchar*> blocks;
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            for(const auto& block : allocated_blocks)
+                blocks.push_back(block.first);
+            for(const auto& stack : free_stacks)
+            {
+                for(const auto& block : stack.second)
+                    blocks.push_back(block.first);
+            }
+        }
+        // Once a block is no longer owned by this stack no free can reach it,
+        // a free that already found this stack holds the shard lock until it is done
+        for(uchar* ptr : blocks)
+        {
+            BlockOwners::Shard& shard = owners.GetShard(ptr);
+            boost::mutex::scoped_lock shard_lock(shard.mtx);
+            boost::mutex::scoped_lock lock(mtx);
+            auto itr = allocated_blocks.find(ptr);
+            if(itr != allocated_blocks.end() && global != this)
+            {
+                boost::mutex::scoped_lock global_lock(global->mtx);
+                global->allocated_blocks[ptr] = itr->second;
+                global->total_usage += itr->second;
+                shard.owners[ptr] = global;
+            }
+            else
+            {
+                shard.owners.erase(ptr);
+            }
+        }
+        boost::mutex::scoped_lock lock(mtx);
+        for(auto& stack : free_stacks)
+        {
+            for(auto& block : stack.second)
+            {
+                backend->deallocate(block.first, stack.first);
+            }
+        }
+    }
+
+    bool allocate(void** ptr, size_t total, size_t elemSize)
+    {
+        *ptr = allocate(total);
+        return *ptr != nullptr;
+    }
+
+    uchar* allocate(size_t total)
+    {
+        const size_t class_size = SizeClass(total);
+        boost::mutex::scoped_lock lock(mtx);
+        auto itr = free_stacks.find(class_size);
+        if(itr != free_stacks.end() && !itr->second.empty())
+        {
+            uchar* ptr = itr->second.back().first;
+            itr->second.pop_back();
+            stats.cached_bytes -= class_size;
+            ++stats.reused;
+            PoolTally::Hit();
+            allocated_blocks[ptr] = class_size;
+            LOG(trace) << "[CPU] Reusing memory block of size "
+                       << class_size / (1024 * 1024) << " MB for a request of "
+                       << total / (1024 * 1024) << " MB. Total usage: "
+                       << total_usage / (1024 * 1024) << " MB";
+            return ptr;
+        }
+        PoolTally::Miss();
+        lock.unlock();
+        uchar* ptr = backend->allocateOnNode(class_size, GetThreadNumaNode());
+        GetBlockOwners().Register(ptr, this);
+        lock.lock();
+        total_usage += class_size;
+        ++stats.allocated;
+        allocated_blocks[ptr] = class_size;
+        LOG(trace) << "[CPU] Allocating block of size "
+                   << class_size / (1024 * 1024) << " MB. Total usage: "
+                   << total_usage / (1024 * 1024) << " MB";
+        return ptr;
+    }
+
+    bool deallocate(void* ptr, size_t total)
+    {
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            if(push(static_cast<uchar*>(ptr)))
+                return true;
+        }
+        // Allocated by the stack of another thread
+        BlockOwners::Shard& shard = GetBlockOwners().GetShard(ptr);
+        boost::mutex::scoped_lock shard_lock(shard.mtx);
+        auto owner = shard.owners.find(static_cast<uchar*>(ptr));
+        if(owner != shard.owners.end() && owner->second != this)
+        {
+            CpuMemoryStackImpl* stack = owner->second;
+            boost::mutex::scoped_lock lock(stack->mtx);
+            if(stack->push(static_cast<uchar*>(ptr)))
+            {
+                ++stack->stats.remote_deallocations;
+                return true;
+            }
+        }
+        LOG(debug) << "[CPU] Unable to find " << ptr << " in the lazy deallocation pool";
+        return false;
+    }
+
+    void SetMaxWaste(double ratio)
+    {
+        // Blocks remember their size class, so changing the ratio only affects new requests
+        classes_per_octave = static_cast<size_t>(std::ceil(1.0 / std::max(ratio, 1.0 / 64)));
+    }
+
+    void Reserve(size_t total, size_t count)
+    {
+        const size_t class_size = SizeClass(total);
+        boost::mutex::scoped_lock lock(mtx);
+        size_t existing = free_stacks[class_size].size();
+        for(const auto& itr : allocated_blocks)
+        {
+            if(itr.second == class_size)
+                ++existing;
+        }
+        lock.unlock();
+        std::vector<uchar*> reserved;
+        for(; existing < count; ++existing)
+        {
+            uchar* ptr = backend->allocateOnNode(class_size, GetThreadNumaNode());
+            HostMemoryBackend::Prefault(ptr, class_size);
+            GetBlockOwners().Register(ptr, this);
+            reserved.push_back(ptr);
+        }
+        lock.lock();
+        auto& stack = free_stacks[class_size];
+        for(uchar* ptr : reserved)
+        {
+            stack.emplace_back(ptr, clock_type::now());
+            total_usage += class_size;
+            stats.cached_bytes += class_size;
+            ++stats.reserved;
+        }
     }
-    uchar* allocate(size_t num_bytes)
+
+    CpuMemoryStackStatistics GetStatistics() const
     {
-        int index = 0;
-        unsigned char* _ptr;
-        for (auto& block : blocks)
+        boost::mutex::scoped_lock lock(mtx);
+        return stats;
+    }
+
+    size_t Trim(std::chrono::milliseconds max_age, size_t bytes)
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        const auto now = clock_type::now();
+        size_t released = 0;
+        std::vector<std::pair<uchar*, size_t>> blocks;
+        for (auto& stack : free_stacks)
         {
-            _ptr = block->allocate(num_bytes, sizeof(uchar));
-            if (_ptr)
+            // Blocks are pushed in release order, so the stale ones are at the front
+            auto itr = stack.second.begin();
+            while(itr != stack.second.end() && now - itr->second > max_age)
             {
-                LOG(trace) << "Allocating " << num_bytes << " bytes from pre-allocated memory block number "
-                           << index << " at address: " << (void*)_ptr;
-                return _ptr;
+                release(stack.first, *itr, now, blocks);
+                released += stack.first;
+                ++itr;
             }
-            ++index;
+            stack.second.erase(stack.second.begin(), itr);
         }
-        LOG(trace) << "Creating new block of page locked memory for allocation.";
-        blocks.push_back(
-            std::shared_ptr<mo::CpuMemoryBlock>(
-                new mo::CpuMemoryBlock(std::max(_initial_block_size / 2, num_bytes))));
-        _ptr = (*blocks.rbegin())->allocate(num_bytes, sizeof(uchar));
-        if (_ptr)
+        if(released < bytes)
+            released += evict(bytes - released, now, blocks);
+        lock.unlock();
+        deallocateBlocks(blocks);
+        return released;
+    }
+
+    size_t Evict(size_t bytes)
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        std::vector<std::pair<uchar*, size_t>> blocks;
+        const size_t released = evict(bytes, clock_type::now(), blocks);
+        lock.unlock();
+        deallocateBlocks(blocks);
+        return released;
+    }
+
+    size_t GetCachedBytes() const
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        return stats.cached_bytes;
+    }
+private:
+    // Index of the stack that owns each block, sharded by address so that
+    // frees of different blocks on different threads do not contend
+    struct BlockOwners
+    {
+        enum { NumShards = 64 };
+        struct Shard
         {
-            LOG(debug) << "Allocating " << num_bytes
-                       << " bytes from newly created memory block at address: " << (void*)_ptr;
-            return _ptr;
+            boost::mutex mtx;
+            std::unordered_map<uchar*, CpuMemoryStackImpl*> owners;
+        };
+
+        Shard& GetShard(const void* ptr)
+        {
+            // Blocks are at least 64 bytes, the low bits carry no information
+            return shards[(reinterpret_cast<size_t>(ptr) >> 6) % NumShards];
+        }
+
+        void Register(uchar* ptr, CpuMemoryStackImpl* stack)
+        {
+            Shard& shard = GetShard(ptr);
+            boost::mutex::scoped_lock lock(shard.mtx);
+            shard.owners[ptr] = stack;
+        }
+
+        void Unregister(uchar* ptr)
+        {
+            Shard& shard = GetShard(ptr);
+            boost::mutex::scoped_lock lock(shard.mtx);
+            shard.owners.erase(ptr);
         }
-        return nullptr;
+
+        Shard shards[NumShards];
+    };
+
+    static BlockOwners& GetBlockOwners()
+    {
+        // Not destroyed, stacks of threads may outlive static destruction
+        static BlockOwners* g_inst = new BlockOwners();
+        return *g_inst;
     }
-    bool deallocate(void* ptr, size_t total)
+
+    // Caches ptr if it was allocated from this stack, must hold mtx
+    bool push(uchar* ptr)
+    {
+        auto itr = allocated_blocks.find(ptr);
+        if(itr == allocated_blocks.end())
+            return false;
+        const size_t class_size = itr->second;
+        allocated_blocks.erase(itr);
+        LOG(trace) << "Releasing " << class_size / (1024 * 1024) << " MB to lazy deallocation pool";
+        free_stacks[class_size].emplace_back(ptr, clock_type::now());
+        stats.cached_bytes += class_size;
+        return true;
+    }
+
+    size_t SizeClass(size_t total) const
+    {
+        if(total <= 64)
+            return 64;
+        // Split the power of two range [2^k, 2^(k+1)) into classes_per_octave steps
+        size_t octave = 64;
+        while(octave * 2 < total)
+            octave *= 2;
+        const size_t step = std::max<size_t>(1, octave / classes_per_octave);
+        return ((total + step - 1) / step) * step;
+    }
+
+    // Releases the least recently used blocks over all size classes into blocks, must hold mtx
+    size_t evict(size_t bytes, clock_type::time_point now, std::vector<std::pair<uchar*, size_t>>& blocks)
     {
-        for (auto itr : blocks)
+        size_t released = 0;
+        while(released < bytes)
         {
-            if (ptr >= itr->Begin() && ptr < itr->End())
+            FreeStack* oldest = nullptr;
+            size_t oldest_class = 0;
+            for(auto& stack : free_stacks)
             {
-                LOG(trace) << "Releasing memory block of size "
-                                 << total << " at address: " << ptr;
-                if (itr->deAllocate((unsigned char*)ptr))
+                if(!stack.second.empty() &&
+                    (oldest == nullptr || stack.second.front().second < oldest->front().second))
                 {
-                    return true;
+                    oldest = &stack.second;
+                    oldest_class = stack.first;
                 }
             }
+            if(oldest == nullptr)
+                break;
+            release(oldest_class, oldest->front(), now, blocks);
+            released += oldest_class;
+            oldest->pop_front();
         }
-        return false;
+        return released;
     }
-private:
-    size_t total_usage;
-    size_t _initial_block_size;
-    std::list<std::shared_ptr<mo::CpuMemoryBlock>> blocks;
-};
 
-class mt_CpuMemoryPoolImpl: public CpuMemoryPoolImpl
-{
-public:
-    bool allocate(void** ptr, size_t total, size_t elemSize)
-    {
-        boost::mutex::scoped_lock lock(mtx);
-        return CpuMemoryPoolImpl::allocate(ptr, total, elemSize);
-    }
-    uchar* allocate(size_t total)
+    // Accounts for releasing block, which is returned to the backend by deallocateBlocks, must hold mtx
+    void release(size_t class_size, const std::pair<unsigned char*, clock_type::time_point>& block,
+                 clock_type::time_point now, std::vector<std::pair<uchar*, size_t>>& blocks)
     {
-        boost::mutex::scoped_lock lock(mtx);
-        return CpuMemoryPoolImpl::allocate(total);
+        total_usage -= class_size;
+        stats.cached_bytes -= class_size;
+        ++stats.released;
+        LOG(trace) << "[CPU] DeAllocating block of size " << class_size / (1024 * 1024)
+            << " MB. Which was stale for "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(now - block.second).count()
+            << " ms. Total usage: " << total_usage / (1024 * 1024) << " MB";
+        blocks.emplace_back(block.first, class_size);
     }
 
-    bool deallocate(void* ptr, size_t total)
+    // Must not hold mtx, blocks leave the index before the backend can hand them out again
+    void deallocateBlocks(const std::vector<std::pair<uchar*, size_t>>& blocks)
     {
-        boost::mutex::scoped_lock lock(mtx);
-        return CpuMemoryPoolImpl::deallocate(ptr, total);
+        BlockOwners& owners = GetBlockOwners();
+        for(const auto& block : blocks)
+        {
+            owners.Unregister(block.first);
+            backend->deallocate(block.first, block.second);
+        }
     }
-private:
-    boost::mutex mtx;
+
+    size_t total_usage;
+    std::atomic<size_t> classes_per_octave;
+    HostMemoryBackend* backend;
+    CpuMemoryStackStatistics stats;
+    // size class -> blocks of that size class in release order
+    std::unordered_map<size_t, FreeStack> free_stacks;
+    // block -> size class
+    std::unordered_map<unsigned char*, size_t> allocated_blocks;
+    mutable boost::mutex mtx;
 };
-CpuMemoryPool* CpuMemoryPool::GlobalInstance()
+
+CpuMemoryStack* CpuMemoryStack::GlobalInstance()
 {
-    static CpuMemoryPool* g_inst = nullptr;
+    static CpuMemoryStack* g_inst = nullptr;
     if(g_inst == nullptr)
     {
-        g_inst = new mt_CpuMemoryPoolImpl();
+        g_inst = new CpuMemoryStackImpl();
     }
     return g_inst;
 }
 
-CpuMemoryPool* CpuMemoryPool::ThreadInstance()
+CpuMemoryStack* CpuMemoryStack::ThreadInstance()
 {
-    static boost::thread_specific_ptr<CpuMemoryPool> g_inst;
+    static boost::thread_specific_ptr<CpuMemoryStack> g_inst;
     if(g_inst.get() == nullptr)
     {
-        g_inst.reset(new CpuMemoryPoolImpl());
+        g_inst.reset(new CpuMemoryStackImpl());
     }
     return g_inst.get();
 }
 
-class CpuMemoryStackImpl: public CpuMemoryStack
+namespace
 {
-public:
-    typedef cv::Mat MatType;
-    CpuMemoryStackImpl(size_t delay):
-        deallocation_delay(delay) {}
-
-    ~CpuMemoryStackImpl()
+    class MatHeaderPoolImpl
     {
-        cleanup(true);
-    }
+    public:
+        enum
+        {
+            CacheDepth = 64,  // headers per thread cache
+            DepotDepth = 4096 // headers held by the shared depot
+        };
 
-    bool allocate(void** ptr, size_t total, size_t elemSize)
-    {
-        for (auto itr = deallocate_stack.begin(); itr != deallocate_stack.end(); ++itr)
+        MatHeaderPoolImpl():
+            thread_cache(&MatHeaderPoolImpl::releaseThreadCache)
+        {
+        }
+
+        static MatHeaderPoolImpl* Instance()
         {
-            if(std::get<2>(*itr) == total)
+            // Leaked so that threads exiting after main can return their caches
+            static MatHeaderPoolImpl* g_inst = new MatHeaderPoolImpl();
+            return g_inst;
+        }
+
+        cv::UMatData* allocate(const cv::MatAllocator* allocator)
+        {
+            ThreadCache* cache = getThreadCache();
+            if(cache->headers.empty())
             {
-                *ptr = std::get<0>(*itr);
-                deallocate_stack.erase(itr);
-                LOG(trace) << "[CPU] Reusing memory block of size "
-                           << total / (1024 * 1024) << " MB. Total usage: "
-                           << total_usage /(1024*1024) << " MB";
-                return true;
+                boost::mutex::scoped_lock lock(mtx);
+                const size_t batch = std::min<size_t>(CacheDepth / 2, depot.size());
+                cache->headers.insert(cache->headers.end(), depot.end() - batch, depot.end());
+                depot.resize(depot.size() - batch);
             }
+            Increment(cache->allocations);
+            void* storage;
+            if(cache->headers.empty())
+            {
+                Increment(cache->heap_allocations);
+                storage = ::operator new(sizeof(cv::UMatData));
+            }else
+            {
+                storage = cache->headers.back();
+                cache->headers.pop_back();
+            }
+            return new(storage) cv::UMatData(allocator);
         }
-        LOG(trace) << "[CPU] Allocating block of size "
-                   << total / (1024 * 1024) << " MB. Total usage: "
-                   << total_usage / (1024 * 1024) << " MB";
-        CV_CUDEV_SAFE_CALL(cudaMallocHost(ptr, total));
-        return true;
-    }
-    uchar* allocate(size_t total)
-    {
-        for (auto itr = deallocate_stack.begin(); itr != deallocate_stack.end(); ++itr)
+
+        void deallocate(cv::UMatData* u)
         {
-            if(std::get<2>(*itr) == total)
+            u->~UMatData();
+            ThreadCache* cache = getThreadCache();
+            Increment(cache->deallocations);
+            if(cache->headers.size() >= CacheDepth)
             {
+                // Hand the older half to the depot, keeping the recently freed (warm) headers
+                const size_t batch = cache->headers.size() / 2;
+                boost::mutex::scoped_lock lock(mtx);
+                for(size_t i = 0; i < batch; ++i)
+                {
+                    if(depot.size() < DepotDepth)
+                    {
+                        depot.push_back(cache->headers[i]);
+                    }else
+                    {
+                        ++retired.heap_deallocations;
+                        ::operator delete(cache->headers[i]);
+                    }
+                }
+                cache->headers.erase(cache->headers.begin(), cache->headers.begin() + batch);
+            }
+            cache->headers.push_back(u);
+        }
 
-                deallocate_stack.erase(itr);
-                LOG(trace) << "[CPU] Reusing memory block of size "
-                           << total / (1024 * 1024) << " MB. Total usage: "
-                           << total_usage /(1024*1024) << " MB";
-                return std::get<0>(*itr);
+        MatHeaderPoolStatistics getStatistics()
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            MatHeaderPoolStatistics output = retired;
+            for(const ThreadCache* cache : caches)
+            {
+                output.allocations += cache->allocations.load(std::memory_order_relaxed);
+                output.deallocations += cache->deallocations.load(std::memory_order_relaxed);
+                output.heap_allocations += cache->heap_allocations.load(std::memory_order_relaxed);
             }
+            output.cached = depot.size();
+            return output;
         }
-        LOG(trace) << "[CPU] Allocating block of size "
-                   << total / (1024 * 1024) << " MB. Total usage: "
-                   << total_usage / (1024 * 1024) << " MB";
-        uchar* ptr = nullptr;
-        CV_CUDEV_SAFE_CALL(cudaMallocHost(&ptr, total));
-        return ptr;
-    }
 
-    bool deallocate(void* ptr, size_t total)
-    {
-        LOG(trace) << "Releasing " << total / (1024 * 1024) << " MB to lazy deallocation pool";
-        deallocate_stack.emplace_back((unsigned char*)ptr, clock(), total);
-        cleanup();
-        return true;
-    }
-private:
-    void cleanup(bool force  = false)
-    {
-        auto time = clock();
-        if (force)
-            time = 0;
-        for (auto itr = deallocate_stack.begin(); itr != deallocate_stack.end();)
+    private:
+        struct ThreadCache
         {
-            if((time - std::get<1>(*itr)) > deallocation_delay)
+            ThreadCache():
+                allocations(0), deallocations(0), heap_allocations(0)
             {
-                total_usage -= std::get<2>(*itr);
-                LOG(trace) << "[CPU] DeAllocating block of size " << std::get<2>(*itr) / (1024 * 1024)
-                    << " MB. Which was stale for " << time - std::get<1>(*itr)
-                    << " ms. Total usage: " << total_usage / (1024 * 1024) << " MB";
-                CV_CUDEV_SAFE_CALL(cudaFreeHost((void*)std::get<0>(*itr)));
-                itr = deallocate_stack.erase(itr);
-            }else
+                headers.reserve(CacheDepth);
+            }
+            std::vector<void*> headers;
+            // Only written by the owning thread, read by GetStatistics
+            std::atomic<size_t> allocations;
+            std::atomic<size_t> deallocations;
+            std::atomic<size_t> heap_allocations;
+        };
+
+        static void Increment(std::atomic<size_t>& counter)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        static void releaseThreadCache(ThreadCache* cache)
+        {
+            Instance()->retireThreadCache(cache);
+            delete cache;
+        }
+
+        ThreadCache* getThreadCache()
+        {
+            ThreadCache* cache = thread_cache.get();
+            if(cache == nullptr)
             {
-                ++itr;
+                cache = new ThreadCache();
+                thread_cache.reset(cache);
+                boost::mutex::scoped_lock lock(mtx);
+                caches.insert(cache);
+            }
+            return cache;
+        }
+
+        void retireThreadCache(ThreadCache* cache)
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            for(void* header : cache->headers)
+            {
+                if(depot.size() < DepotDepth)
+                {
+                    depot.push_back(header);
+                }else
+                {
+                    ++retired.heap_deallocations;
+                    ::operator delete(header);
+                }
             }
+            cache->headers.clear();
+            retired.allocations += cache->allocations.load(std::memory_order_relaxed);
+            retired.deallocations += cache->deallocations.load(std::memory_order_relaxed);
+            retired.heap_allocations += cache->heap_allocations.load(std::memory_order_relaxed);
+            caches.erase(cache);
         }
+
+        boost::mutex mtx;
+        std::vector<void*> depot;
+        boost::thread_specific_ptr<ThreadCache> thread_cache;
+        std::set<ThreadCache*> caches;
+        MatHeaderPoolStatistics retired;
+    };
+}
+
+cv::UMatData* MatHeaderPool::Allocate(const cv::MatAllocator* allocator)
+{
+    return MatHeaderPoolImpl::Instance()->allocate(allocator);
+}
+
+void MatHeaderPool::Deallocate(cv::UMatData* u)
+{
+    MatHeaderPoolImpl::Instance()->deallocate(u);
+}
+
+MatHeaderPoolStatistics MatHeaderPool::GetStatistics()
+{
+    return MatHeaderPoolImpl::Instance()->getStatistics();
+}
+
+PoolTally& PoolTally::Thread()
+{
+    static thread_local PoolTally t_tally;
+    return t_tally;
+}
+
+void PoolTally::Hit()
+{
+    ++Thread().hits;
+}
+
+void PoolTally::Miss()
+{
+    ++Thread().misses;
+}
+
+namespace
+{
+    struct LiveAllocators
+    {
+        boost::mutex mtx;
+        std::set<Allocator*> allocators;
+    };
+    LiveAllocators& GetLiveAllocators()
+    {
+        // Never destroyed, allocators are released from thread exit handlers
+        static LiveAllocators* g_inst = new LiveAllocators();
+        return *g_inst;
     }
-    size_t total_usage;
-    size_t deallocation_delay;
-    std::list<std::tuple<unsigned char*, clock_t, size_t>> deallocate_stack;
+}
+
+/*!
+ * \brief Live allocation counts per request size and their high water marks,
+ *        only updated while the AllocationProfiler is recording.  Frees of
+ *        allocations made before recording started are ignored.
+ */
+struct Allocator::ProfileState
+{
+    struct Device
+    {
+        std::map<size_t, size_t> live_counts;
+        size_t live_bytes = 0;
+        AllocationHistogram high_water;
+    };
+    boost::mutex mtx;
+    Device cpu;
+    Device gpu;
 };
 
-class mt_CpuMemoryStackImpl: public CpuMemoryStackImpl
+Allocator::Allocator():
+    profile_state(new ProfileState()),
+    bytes_in_use(0),
+    peak_bytes(0),
+    allocations(0),
+    deallocations(0),
+    pool_hits(0),
+    pool_misses(0)
 {
-public:
-    mt_CpuMemoryStackImpl(size_t delay):
-        CpuMemoryStackImpl(delay){}
-    bool allocate(void** ptr, size_t total, size_t elemSize)
+    LiveAllocators& live = GetLiveAllocators();
+    boost::mutex::scoped_lock lock(live.mtx);
+    live.allocators.insert(this);
+}
+
+Allocator::~Allocator()
+{
+    Unregister();
+}
+
+void Allocator::Unregister()
+{
+    bool removed;
     {
-        boost::mutex::scoped_lock lock(mtx);
-        return CpuMemoryStackImpl::allocate(ptr, total, elemSize);
+        LiveAllocators& live = GetLiveAllocators();
+        boost::mutex::scoped_lock lock(live.mtx);
+        removed = live.allocators.erase(this) != 0;
     }
-    uchar* allocate(size_t total)
+    if(removed && AllocationProfiler::IsRecording())
+        AllocationProfiler::Retire(GetAllocationProfile());
+}
+
+std::vector<AllocatorStatistics> Allocator::GetLiveAllocatorStatistics()
+{
+    LiveAllocators& live = GetLiveAllocators();
+    boost::mutex::scoped_lock lock(live.mtx);
+    std::vector<AllocatorStatistics> output;
+    output.reserve(live.allocators.size());
+    for(const Allocator* allocator : live.allocators)
     {
-        boost::mutex::scoped_lock lock(mtx);
-        return CpuMemoryStackImpl::allocate(total);
+        output.push_back(allocator->GetStatistics());
     }
+    return output;
+}
 
-    bool deallocate(void* ptr, size_t total)
+std::vector<AllocationProfile> Allocator::GetLiveAllocationProfiles()
+{
+    LiveAllocators& live = GetLiveAllocators();
+    boost::mutex::scoped_lock lock(live.mtx);
+    std::vector<AllocationProfile> output;
+    output.reserve(live.allocators.size());
+    for(const Allocator* allocator : live.allocators)
     {
-        boost::mutex::scoped_lock lock(mtx);
-        return CpuMemoryStackImpl::deallocate(ptr, total);
+        output.push_back(allocator->GetAllocationProfile());
     }
-private:
-    boost::mutex mtx;
-};
+    return output;
+}
 
-CpuMemoryStack* CpuMemoryStack::GlobalInstance()
+AllocationProfile Allocator::GetAllocationProfile() const
 {
-    static CpuMemoryStack* g_inst = nullptr;
-    if(g_inst == nullptr)
+    AllocationProfile output;
+    output.name = GetName();
+    boost::mutex::scoped_lock lock(profile_state->mtx);
+    output.cpu = profile_state->cpu.high_water;
+    output.gpu = profile_state->gpu.high_water;
+    return output;
+}
+
+void Allocator::RecordProfile(size_t num_bytes, bool gpu, bool allocate) const
+{
+    boost::mutex::scoped_lock lock(profile_state->mtx);
+    ProfileState::Device& device = gpu ? profile_state->gpu : profile_state->cpu;
+    if(allocate)
     {
-#ifdef _MSC_VER
-        g_inst = new mt_CpuMemoryStackImpl(1000);
-#else
-        g_inst = new RefCountPolicy<mt_CpuMemoryStackImpl>(1000*1000);
-#endif
+        const size_t count = ++device.live_counts[num_bytes];
+        size_t& peak = device.high_water.peak_counts[num_bytes];
+        peak = std::max(peak, count);
+        device.live_bytes += num_bytes;
+        device.high_water.peak_bytes = std::max(device.high_water.peak_bytes, device.live_bytes);
+    }else
+    {
+        auto itr = device.live_counts.find(num_bytes);
+        if(itr == device.live_counts.end() || itr->second == 0)
+            return;
+        --itr->second;
+        device.live_bytes -= num_bytes;
     }
-    return g_inst;
 }
 
-CpuMemoryStack* CpuMemoryStack::ThreadInstance()
+AllocatorStatistics Allocator::GetStatistics() const
+{
+    AllocatorStatistics output;
+    output.name = GetName();
+    output.bytes_in_use = bytes_in_use.load(std::memory_order_relaxed);
+    output.bytes_cached = GetCachedBytes();
+    output.peak_bytes = peak_bytes.load(std::memory_order_relaxed);
+    output.allocations = allocations.load(std::memory_order_relaxed);
+    output.deallocations = deallocations.load(std::memory_order_relaxed);
+    output.pool_hits = pool_hits.load(std::memory_order_relaxed);
+    output.pool_misses = pool_misses.load(std::memory_order_relaxed);
+    return output;
+}
+
+void Allocator::SetName(const std::string& name)
 {
-    static boost::thread_specific_ptr<CpuMemoryStack> g_inst;
-    if(g_inst.get() == nullptr)
     {
-#ifdef _MSC_VER
-        g_inst.reset(new CpuMemoryStackImpl(1000));
-#else
-        g_inst.reset(new RefCountPolicy<CpuMemoryStackImpl>(1000*1000));
-#endif
+        boost::mutex::scoped_lock lock(name_mtx);
+        this->name = name;
+    }
+    if(AllocationTrace::IsRecording())
+        AllocationTrace::Rename(this, name);
+    AllocationProfile profile;
+    if(AllocationProfiler::GetProfile(name, profile))
+    {
+        LOG(debug) << "Reserving memory for " << name << " from the allocation profile";
+        Reserve(profile);
+    }
+}
+
+const std::string Allocator::GetName() const
+{
+    boost::mutex::scoped_lock lock(name_mtx);
+    return name;
+}
+
+void Allocator::RecordAllocation(const void* ptr, size_t num_bytes, bool gpu, const PoolTally& before) const
+{
+    if(AllocationTrace::IsRecording())
+        AllocationTrace::Record(AllocationTraceEvent::Allocate_e,
+                                gpu ? AllocationTraceEvent::Gpu_e : AllocationTraceEvent::Cpu_e,
+                                this, ptr, num_bytes);
+    if(AllocationProfiler::IsRecording())
+        RecordProfile(num_bytes, gpu, true);
+    const PoolTally& after = PoolTally::Thread();
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(after.hits != before.hits)
+        pool_hits.fetch_add(after.hits - before.hits, std::memory_order_relaxed);
+    if(after.misses != before.misses)
+        pool_misses.fetch_add(after.misses - before.misses, std::memory_order_relaxed);
+    const size_t in_use = bytes_in_use.fetch_add(num_bytes, std::memory_order_relaxed) + num_bytes;
+    size_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while(in_use > peak && !peak_bytes.compare_exchange_weak(peak, in_use, std::memory_order_relaxed))
+    {
     }
-    return g_inst.get();
+}
+
+void Allocator::RecordDeallocation(const void* ptr, size_t num_bytes, bool gpu) const
+{
+    if(AllocationTrace::IsRecording())
+        AllocationTrace::Record(AllocationTraceEvent::Free_e,
+                                gpu ? AllocationTraceEvent::Gpu_e : AllocationTraceEvent::Cpu_e,
+                                this, ptr, num_bytes);
+    if(AllocationProfiler::IsRecording())
+        RecordProfile(num_bytes, gpu, false);
+    deallocations.fetch_add(1, std::memory_order_relaxed);
+    bytes_in_use.fetch_sub(num_bytes, std::memory_order_relaxed);
 }
 
 Allocator* Allocator::GetThreadSafeAllocator()
@@ -421,6 +1715,35 @@ Allocator* Allocator::GetThreadSpecificAllocator()
     return thread_specific_allocator.get();
 }
 
+// ================================================================
+// BudgetPolicyBase
+void BudgetPolicyBase::RecordCharge(const void* ptr, const std::shared_ptr<MemoryBudget>& budget_, size_t num_bytes) const
+{
+    boost::mutex::scoped_lock lock(charge_mtx);
+    Charge& charge = charges[ptr];
+    charge.budget = budget_;
+    charge.num_bytes = num_bytes;
+    num_charges.store(charges.size(), std::memory_order_release);
+}
+
+void BudgetPolicyBase::ReleaseCharge(const void* ptr) const
+{
+    if(num_charges.load(std::memory_order_acquire) == 0)
+        return;
+    Charge charge;
+    {
+        boost::mutex::scoped_lock lock(charge_mtx);
+        auto itr = charges.find(ptr);
+        if(itr == charges.end())
+            return;
+        charge = std::move(itr->second);
+        charges.erase(itr);
+        num_charges.store(charges.size(), std::memory_order_release);
+    }
+    // Released outside of the lock, it may wake allocations blocked on the budget
+    charge.budget->Release(charge.num_bytes);
+}
+
 // ================================================================
 // CpuStackPolicy
 cv::UMatData* CpuStackPolicy::allocate(int dims, const int* sizes, int type,
@@ -445,7 +1768,7 @@ cv::UMatData* CpuStackPolicy::allocate(int dims, const int* sizes, int type,
         total *= sizes[i];
     }
 
-    cv::UMatData* u = new cv::UMatData(this);
+    cv::UMatData* u = MatHeaderPool::Allocate(this);
     u->size = total;
 
     if (data)
@@ -469,6 +1792,12 @@ uchar* CpuStackPolicy::allocate(size_t total)
     return CpuMemoryStack::ThreadInstance()->allocate(total);
 }
 
+void CpuStackPolicy::Reserve(const AllocationHistogram& histogram)
+{
+    for(const auto& count : histogram.peak_counts)
+        CpuMemoryStack::ThreadInstance()->Reserve(count.first, count.second);
+}
+
 bool CpuStackPolicy::allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const
 {
     return false;
@@ -495,7 +1824,7 @@ void CpuStackPolicy::deallocate(cv::UMatData* u) const
             u->origdata = 0;
         }
 
-        delete u;
+        MatHeaderPool::Deallocate(u);
     }
 }
 
@@ -524,7 +1853,7 @@ cv::UMatData* mt_CpuStackPolicy::allocate(int dims, const int* sizes, int type,
         total *= sizes[i];
     }
 
-    cv::UMatData* u = new cv::UMatData(this);
+    cv::UMatData* u = MatHeaderPool::Allocate(this);
     u->size = total;
 
     if (data)
@@ -549,6 +1878,22 @@ bool mt_CpuStackPolicy::allocate(cv::UMatData* data, int accessflags, cv::UMatUs
     return false;
 }
 
+uchar* mt_CpuStackPolicy::allocate(size_t total)
+{
+    return CpuMemoryStack::GlobalInstance()->allocate(total);
+}
+
+bool mt_CpuStackPolicy::deallocate(uchar* ptr, size_t total)
+{
+    return CpuMemoryStack::GlobalInstance()->deallocate(ptr, total);
+}
+
+void mt_CpuStackPolicy::Reserve(const AllocationHistogram& histogram)
+{
+    for(const auto& count : histogram.peak_counts)
+        CpuMemoryStack::GlobalInstance()->Reserve(count.first, count.second);
+}
+
 void mt_CpuStackPolicy::deallocate(cv::UMatData* u) const
 {
     if (!u)
@@ -566,7 +1911,7 @@ void mt_CpuStackPolicy::deallocate(cv::UMatData* u) const
             u->origdata = 0;
         }
 
-        delete u;
+        MatHeaderPool::Deallocate(u);
     }
 }
 
@@ -594,7 +1939,7 @@ cv::UMatData* CpuPoolPolicy::allocate(int dims, const int* sizes, int type,
         total *= sizes[i];
     }
 
-    cv::UMatData* u = new cv::UMatData(this);
+    cv::UMatData* u = MatHeaderPool::Allocate(this);
     u->size = total;
 
     if (data)
@@ -605,7 +1950,7 @@ cv::UMatData* CpuPoolPolicy::allocate(int dims, const int* sizes, int type,
     else
     {
         void* ptr = 0;
-        CpuMemoryPool::ThreadInstance()->allocate(&ptr, total, CV_ELEM_SIZE(type));
+        LocalPool(CpuMemoryPool::ThreadInstance())->allocate(&ptr, total, CV_ELEM_SIZE(type));
 
         u->data = u->origdata = static_cast<uchar*>(ptr);
     }
@@ -631,21 +1976,26 @@ void CpuPoolPolicy::deallocate(cv::UMatData* u) const
         if (!(u->flags & cv::UMatData::USER_ALLOCATED))
         {
             //cudaFreeHost(u->origdata);
-            CpuMemoryPool::ThreadInstance()->deallocate(u->origdata, u->size);
+            HomePool(u->origdata, CpuMemoryPool::ThreadInstance())->deallocate(u->origdata, u->size);
             u->origdata = 0;
         }
 
-        delete u;
+        MatHeaderPool::Deallocate(u);
     }
 }
 uchar* CpuPoolPolicy::allocate(size_t num_bytes)
 {
-    return CpuMemoryPool::ThreadInstance()->allocate(num_bytes);
+    return LocalPool(CpuMemoryPool::ThreadInstance())->allocate(num_bytes);
 }
 
 void CpuPoolPolicy::deallocate(uchar* ptr, size_t num_bytes)
 {
+    HomePool(ptr, CpuMemoryPool::ThreadInstance())->deallocate(ptr, num_bytes);
+}
 
+void CpuPoolPolicy::Reserve(const AllocationHistogram& histogram)
+{
+    LocalPool(CpuMemoryPool::ThreadInstance())->Reserve(histogram.peak_bytes);
 }
 
 // ================================================================
@@ -672,7 +2022,7 @@ cv::UMatData* mt_CpuPoolPolicy::allocate(int dims, const int* sizes, int type,
         total *= sizes[i];
     }
 
-    cv::UMatData* u = new cv::UMatData(this);
+    cv::UMatData* u = MatHeaderPool::Allocate(this);
     u->size = total;
 
     if (data)
@@ -683,7 +2033,7 @@ cv::UMatData* mt_CpuPoolPolicy::allocate(int dims, const int* sizes, int type,
     else
     {
         void* ptr = 0;
-        CpuMemoryPool::GlobalInstance()->allocate(&ptr, total, CV_ELEM_SIZE(type));
+        LocalPool(CpuMemoryPool::GlobalInstance())->allocate(&ptr, total, CV_ELEM_SIZE(type));
 
         u->data = u->origdata = static_cast<uchar*>(ptr);
     }
@@ -696,6 +2046,21 @@ bool mt_CpuPoolPolicy::allocate(cv::UMatData* data, int accessflags, cv::UMatUsa
     return false;
 }
 
+uchar* mt_CpuPoolPolicy::allocate(size_t num_bytes)
+{
+    return LocalPool(CpuMemoryPool::GlobalInstance())->allocate(num_bytes);
+}
+
+void mt_CpuPoolPolicy::deallocate(uchar* ptr, size_t num_bytes)
+{
+    HomePool(ptr, CpuMemoryPool::GlobalInstance())->deallocate(ptr, num_bytes);
+}
+
+void mt_CpuPoolPolicy::Reserve(const AllocationHistogram& histogram)
+{
+    LocalPool(CpuMemoryPool::GlobalInstance())->Reserve(histogram.peak_bytes);
+}
+
 void mt_CpuPoolPolicy::deallocate(cv::UMatData* u) const
 {
     if (!u)
@@ -709,11 +2074,11 @@ void mt_CpuPoolPolicy::deallocate(cv::UMatData* u) const
         if (!(u->flags & cv::UMatData::USER_ALLOCATED))
         {
             //cudaFreeHost(u->origdata);
-            CpuMemoryPool::GlobalInstance()->deallocate(u->origdata, u->size);
+            HomePool(u->origdata, CpuMemoryPool::GlobalInstance())->deallocate(u->origdata, u->size);
             u->origdata = 0;
         }
 
-        delete u;
+        MatHeaderPool::Deallocate(u);
     }
 }
 
@@ -740,7 +2105,7 @@ cv::UMatData* PinnedAllocator::allocate(int dims, const int* sizes, int type,
         total *= sizes[i];
     }
 
-    cv::UMatData* u = new cv::UMatData(this);
+    cv::UMatData* u = MatHeaderPool::Allocate(this);
     u->size = total;
 
     if (data)
@@ -780,6 +2145,6 @@ void PinnedAllocator::deallocate(cv::UMatData* u) const
             u->origdata = 0;
         }
 
-        delete u;
+        MatHeaderPool::Deallocate(u);
     }
 }
@@ -0,0 +1,192 @@
+#include "MetaObject/Detail/Arena.hpp"
+#include "MetaObject/Detail/Allocator.hpp"
+#include "MetaObject/Detail/HostMemoryBackend.hpp"
+#include "MetaObject/Detail/Numa.hpp"
+#include "MetaObject/Context.hpp"
+#include "MetaObject/Logging/Log.hpp"
+
+using namespace mo;
+
+namespace
+{
+    unsigned char* AlignUp(unsigned char* ptr, size_t alignment)
+    {
+        size_t addr = reinterpret_cast<size_t>(ptr);
+        return reinterpret_cast<unsigned char*>((addr + alignment - 1) & ~(alignment - 1));
+    }
+}
+
+Arena* Arena::Current()
+{
+    return Context::GetDefaultThreadContext()->arena;
+}
+
+Arena::Arena(size_t chunk_size_, HostMemoryBackend* backend_):
+    backend(backend_ ? backend_ : HostMemoryBackend::GetDefault()),
+    chunk_size(chunk_size_)
+{
+}
+
+Arena::~Arena()
+{
+    if(live_mats)
+    {
+        LOG(warning) << live_mats << " cv::Mat buffers still reference an arena that is being destroyed";
+    }
+    releaseChunks();
+}
+
+unsigned char* Arena::allocate(size_t num_bytes, size_t alignment)
+{
+    if(chunks.size())
+    {
+        Chunk& chunk = chunks[current_chunk];
+        unsigned char* ptr = AlignUp(chunk.begin + offset, alignment);
+        if(ptr + num_bytes <= chunk.begin + chunk.size)
+        {
+            offset = (ptr - chunk.begin) + num_bytes;
+            return ptr;
+        }
+        used_before += offset;
+    }
+    // Chunks are only appended during an iteration, Reset folds them back into one
+    addChunk(num_bytes + alignment);
+    current_chunk = chunks.size() - 1;
+    Chunk& chunk = chunks[current_chunk];
+    unsigned char* ptr = AlignUp(chunk.begin, alignment);
+    offset = (ptr - chunk.begin) + num_bytes;
+    return ptr;
+}
+
+void Arena::Reset()
+{
+    size_t used = GetUsedBytes();
+    if(used > peak)
+        peak = used;
+    if(live_mats)
+    {
+        LOG(trace) << live_mats << " cv::Mat buffers allocated from the arena are still alive at reset";
+    }
+    if(chunks.size() > 1)
+    {
+        releaseChunks();
+        addChunk(used);
+    }
+    current_chunk = 0;
+    offset = 0;
+    used_before = 0;
+    ++resets;
+}
+
+size_t Arena::GetUsedBytes() const
+{
+    return used_before + offset;
+}
+
+size_t Arena::GetCapacity() const
+{
+    size_t capacity = 0;
+    for(const Chunk& chunk : chunks)
+        capacity += chunk.size;
+    return capacity;
+}
+
+size_t Arena::GetPeakBytes() const
+{
+    size_t used = GetUsedBytes();
+    return used > peak ? used : peak;
+}
+
+size_t Arena::GetResetCount() const
+{
+    return resets;
+}
+
+size_t Arena::GetLiveMatCount() const
+{
+    return live_mats;
+}
+
+void Arena::addChunk(size_t min_size)
+{
+    size_t size = ((min_size + chunk_size - 1) / chunk_size) * chunk_size;
+    if(size == 0)
+        size = chunk_size;
+    LOG(trace) << "Adding arena chunk of " << size << " bytes";
+    Chunk chunk;
+    chunk.begin = backend->allocateOnNode(size, GetThreadNumaNode());
+    chunk.size = size;
+    chunks.push_back(chunk);
+}
+
+void Arena::releaseChunks()
+{
+    for(const Chunk& chunk : chunks)
+        backend->deallocate(chunk.begin, chunk.size);
+    chunks.clear();
+}
+
+cv::UMatData* Arena::allocate(int dims, const int* sizes, int type,
+    void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
+{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+    {
+        if (step)
+        {
+            if (data && step[i] != CV_AUTOSTEP)
+            {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else
+            {
+                step[i] = total;
+            }
+        }
+
+        total *= sizes[i];
+    }
+
+    cv::UMatData* u = MatHeaderPool::Allocate(this);
+    u->size = total;
+
+    if (data)
+    {
+        u->data = u->origdata = static_cast<uchar*>(data);
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    else
+    {
+        // cv::MatAllocator's interface is const, the arena itself is owned by one thread
+        u->data = u->origdata = const_cast<Arena*>(this)->allocate(total);
+        ++live_mats;
+    }
+
+    return u;
+}
+
+bool Arena::allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const
+{
+    return false;
+}
+
+void Arena::deallocate(cv::UMatData* u) const
+{
+    if (!u)
+        return;
+
+    CV_Assert(u->urefcount >= 0);
+    CV_Assert(u->refcount >= 0);
+
+    if (u->refcount == 0)
+    {
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+        {
+            // The memory itself is reclaimed by the next Reset
+            u->origdata = 0;
+            --live_mats;
+        }
+        MatHeaderPool::Deallocate(u);
+    }
+}
@@ -1,63 +1,82 @@
-#include "MetaObject/Context.hpp"
-#include "MetaObject/Thread/ThreadRegistry.hpp"
-#include "MetaObject/Detail/Allocator.hpp"
-#include "MetaObject/Logging/Profiling.hpp"
-#include "MetaObject/Detail/HelperMacros.hpp"
-#include "boost/lexical_cast.hpp"
-#include <boost/thread/tss.hpp>
-
-using namespace mo;
-boost::thread_specific_ptr<Context> thread_specific_context;
-
-thread_local Context* thread_set_context = nullptr;
-
-Context* Context::GetDefaultThreadContext()
-{
-    if(thread_set_context)
-        return thread_set_context;
-
-    if(thread_specific_context.get() == nullptr)
-    {
-        thread_specific_context.reset(new Context());
-    }
-    return thread_specific_context.get();
-}
-
-void Context::SetDefaultThreadContext(Context*  ctx)
-{
-    thread_set_context = ctx;
-}
-
-
-Context::Context(const std::string& name)
-{
-    thread_id = GetThisThread();
-    allocator = Allocator::GetThreadSpecificAllocator();
-    SetGpuAllocatorHelper<cv::cuda::GpuMat>(allocator);
-    SetCpuAllocatorHelper<cv::Mat>(allocator);
-    if(name.size())
-    {
-        allocator->SetName(name);
-        mo::SetThreadName(name.c_str());
-
-    }else
-    {
-        allocator->SetName("Thread " + boost::lexical_cast<std::string>(thread_id) + " allocator");
-    }
-    this->name = name;
-}
-
-Context::~Context()
-{
-    
-}
-
-cv::cuda::Stream &Context::GetStream()
-{
-    return stream;
-}
-
-void Context::SetStream(cv::cuda::Stream stream)
-{
-    mo::SetStreamName(name.c_str(), stream);
-}
+#include "MetaObject/Context.hpp"
+#include "MetaObject/Thread/ThreadRegistry.hpp"
+#include "MetaObject/Detail/Allocator.hpp"
+#include "MetaObject/Detail/Arena.hpp"
+#include "MetaObject/Detail/MemoryResource.hpp"
+#include "MetaObject/Logging/Profiling.hpp"
+#include "MetaObject/Detail/HelperMacros.hpp"
+#include "boost/lexical_cast.hpp"
+#include <boost/thread/tss.hpp>
+
+using namespace mo;
+boost::thread_specific_ptr<Context> thread_specific_context;
+
+thread_local Context* thread_set_context = nullptr;
+
+Context* Context::GetDefaultThreadContext()
+{
+    if(thread_set_context)
+        return thread_set_context;
+
+    if(thread_specific_context.get() == nullptr)
+    {
+        thread_specific_context.reset(new Context());
+    }
+    return thread_specific_context.get();
+}
+
+void Context::SetDefaultThreadContext(Context*  ctx)
+{
+    thread_set_context = ctx;
+}
+
+
+Context::Context(const std::string& name)
+{
+    thread_id = GetThisThread();
+    allocator = Allocator::GetThreadSpecificAllocator();
+    arena = new Arena();
+    memory_resource = PoolMemoryResource::ThreadInstance();
+    SetGpuAllocatorHelper<cv::cuda::GpuMat>(allocator);
+    SetCpuAllocatorHelper<cv::Mat>(allocator);
+    if(name.size())
+    {
+        allocator->SetName(name);
+        mo::SetThreadName(name.c_str());
+
+    }else
+    {
+        allocator->SetName("Thread " + boost::lexical_cast<std::string>(thread_id) + " allocator");
+    }
+    this->name = name;
+}
+
+Context::~Context()
+{
+    delete arena;
+}
+
+void Context::SetMemoryBudget(std::shared_ptr<MemoryBudget> cpu, std::shared_ptr<MemoryBudget> gpu)
+{
+    allocator->SetMemoryBudget(cpu, gpu);
+}
+
+std::shared_ptr<MemoryBudget> Context::GetCpuMemoryBudget() const
+{
+    return allocator->GetCpuMemoryBudget();
+}
+
+std::shared_ptr<MemoryBudget> Context::GetGpuMemoryBudget() const
+{
+    return allocator->GetGpuMemoryBudget();
+}
+
+cv::cuda::Stream &Context::GetStream()
+{
+    return stream;
+}
+
+void Context::SetStream(cv::cuda::Stream stream)
+{
+    mo::SetStreamName(name.c_str(), stream);
+}
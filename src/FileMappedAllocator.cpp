@@ -0,0 +1,403 @@
+#include "MetaObject/Detail/FileMappedAllocator.hpp"
+#include "MetaObject/Detail/Allocator.hpp"
+#include "MetaObject/Logging/Log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+using namespace mo;
+
+namespace
+{
+    size_t RoundUp(size_t size, size_t alignment)
+    {
+        return ((size + alignment - 1) / alignment) * alignment;
+    }
+
+    std::string DefaultDirectory()
+    {
+        if(const char* dir = std::getenv("MO_MAPPED_FILE_DIR"))
+            return dir;
+#ifdef _WIN32
+        char path[MAX_PATH + 1];
+        const DWORD length = GetTempPathA(MAX_PATH + 1, path);
+        if(length > 0 && length <= MAX_PATH)
+            return std::string(path, length);
+        return ".";
+#else
+        if(const char* dir = std::getenv("TMPDIR"))
+            return dir;
+        return "/tmp";
+#endif
+    }
+
+    bool IsMemoryBacked(const std::string& directory)
+    {
+#ifdef __linux__
+        const long tmpfs_magic = 0x01021994;
+        struct statfs info;
+        return statfs(directory.c_str(), &info) == 0 && static_cast<long>(info.f_type) == tmpfs_magic;
+#else
+        return false;
+#endif
+    }
+}
+
+/*!
+ * \brief A Chunk is one sparse temporary file mapped in full.  Free space is
+ *        indexed by address, to coalesce neighbours, and by size, for a best
+ *        fit lookup, like MemoryBlock.  All sizes are multiples of the page size.
+ */
+struct FileMappedAllocator::Chunk
+{
+    unsigned char* begin;
+    size_t size;
+#ifdef _WIN32
+    // Kept open to release the disk blocks of freed ranges, the file is deleted on close
+    HANDLE file;
+#endif
+    size_t free_bytes;
+    std::map<unsigned char*, size_t> free_ranges;
+    std::multimap<size_t, unsigned char*> free_sizes;
+
+    void insertFreeRange(unsigned char* ptr, size_t size_)
+    {
+        free_ranges[ptr] = size_;
+        free_sizes.insert(std::make_pair(size_, ptr));
+        free_bytes += size_;
+    }
+
+    void eraseFreeRange(std::map<unsigned char*, size_t>::iterator itr)
+    {
+        auto range = free_sizes.equal_range(itr->second);
+        for(auto size_itr = range.first; size_itr != range.second; ++size_itr)
+        {
+            if(size_itr->second == itr->first)
+            {
+                free_sizes.erase(size_itr);
+                break;
+            }
+        }
+        free_bytes -= itr->second;
+        free_ranges.erase(itr);
+    }
+
+    unsigned char* allocate(size_t size_)
+    {
+        auto candidate = free_sizes.lower_bound(size_);
+        if(candidate == free_sizes.end())
+            return nullptr;
+        unsigned char* ptr = candidate->second;
+        const size_t range_size = candidate->first;
+        eraseFreeRange(free_ranges.find(ptr));
+        if(range_size > size_)
+            insertFreeRange(ptr + size_, range_size - size_);
+        return ptr;
+    }
+
+    void deallocate(unsigned char* ptr, size_t size_)
+    {
+        // Freed data is never read again, so give its disk blocks back instead of writing it back
+#ifdef _WIN32
+        FILE_ZERO_DATA_INFORMATION zero;
+        zero.FileOffset.QuadPart = static_cast<LONGLONG>(ptr - begin);
+        zero.BeyondFinalZero.QuadPart = static_cast<LONGLONG>(ptr - begin + size_);
+        DWORD returned = 0;
+        DeviceIoControl(file, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), nullptr, 0, &returned, nullptr);
+#elif defined(MADV_REMOVE)
+        madvise(ptr, size_, MADV_REMOVE);
+#else
+        madvise(ptr, size_, MADV_DONTNEED);
+#endif
+        unsigned char* range_begin = ptr;
+        unsigned char* range_end = ptr + size_;
+        auto next = free_ranges.find(range_end);
+        if(next != free_ranges.end())
+        {
+            range_end += next->second;
+            eraseFreeRange(next);
+        }
+        auto prev = free_ranges.lower_bound(range_begin);
+        if(prev != free_ranges.begin())
+        {
+            --prev;
+            if(prev->first + prev->second == range_begin)
+            {
+                range_begin = prev->first;
+                eraseFreeRange(prev);
+            }
+        }
+        insertFreeRange(range_begin, range_end - range_begin);
+    }
+
+    bool empty() const
+    {
+        return free_bytes == size;
+    }
+};
+
+const size_t FileMappedAllocator::ChunkSize;
+
+FileMappedAllocator* FileMappedAllocator::Instance()
+{
+    static FileMappedAllocator* g_inst = new FileMappedAllocator();
+    return g_inst;
+}
+
+FileMappedAllocator::FileMappedAllocator(const std::string& directory_):
+    directory(directory_.empty() ? DefaultDirectory() : directory_),
+    mapped_bytes(0)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    page_size = info.dwAllocationGranularity;
+#else
+    page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    if(IsMemoryBacked(directory))
+    {
+        LOG(warning) << "Memory mapped files in " << directory << " are held in memory (tmpfs), "
+                     << "set MO_MAPPED_FILE_DIR to a directory on disk to page mats out";
+    }
+}
+
+FileMappedAllocator::~FileMappedAllocator()
+{
+    for(auto& chunk : chunks)
+        destroyChunk(chunk.second.get());
+}
+
+cv::UMatData* FileMappedAllocator::allocate(int dims, const int* sizes, int type,
+    void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
+{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+    {
+        if (step)
+        {
+            if (data && step[i] != CV_AUTOSTEP)
+            {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else
+            {
+                step[i] = total;
+            }
+        }
+
+        total *= sizes[i];
+    }
+
+    cv::UMatData* u = MatHeaderPool::Allocate(this);
+    u->size = total;
+
+    if (data)
+    {
+        u->data = u->origdata = static_cast<uchar*>(data);
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    else
+    {
+        u->data = u->origdata = map(total);
+    }
+
+    return u;
+}
+
+bool FileMappedAllocator::allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const
+{
+    return false;
+}
+
+void FileMappedAllocator::deallocate(cv::UMatData* u) const
+{
+    if (!u)
+        return;
+
+    CV_Assert(u->urefcount >= 0);
+    CV_Assert(u->refcount >= 0);
+
+    if (u->refcount == 0)
+    {
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+        {
+            unmap(u->origdata, u->size);
+            u->origdata = 0;
+        }
+
+        MatHeaderPool::Deallocate(u);
+    }
+}
+
+void FileMappedAllocator::PageOut(const cv::Mat& mat)
+{
+    if(mat.u == nullptr || mat.u->origdata == nullptr)
+        return;
+    const FileMappedAllocator* allocator = dynamic_cast<const FileMappedAllocator*>(mat.u->currAllocator);
+    if(allocator == nullptr)
+        return;
+#ifdef _WIN32
+    // Unlocking pages that are not locked removes them from the working set
+    VirtualUnlock(mat.u->origdata, RoundUp(mat.u->size, allocator->page_size));
+#else
+    // Dirty pages of a shared file mapping stay in the file cache and are written back
+    madvise(mat.u->origdata, RoundUp(mat.u->size, allocator->page_size), MADV_DONTNEED);
+#endif
+}
+
+size_t FileMappedAllocator::GetMappedBytes() const
+{
+    return mapped_bytes;
+}
+
+size_t FileMappedAllocator::GetChunkCount() const
+{
+    boost::mutex::scoped_lock lock(mtx);
+    return chunks.size();
+}
+
+const std::string& FileMappedAllocator::GetDirectory() const
+{
+    return directory;
+}
+
+unsigned char* FileMappedAllocator::map(size_t size) const
+{
+    // Zero sized mats still get a unique address
+    const size_t mapped_size = RoundUp(std::max<size_t>(size, 1), page_size);
+    boost::mutex::scoped_lock lock(mtx);
+    unsigned char* ptr = nullptr;
+    for(auto& chunk : chunks)
+    {
+        ptr = chunk.second->allocate(mapped_size);
+        if(ptr)
+            break;
+    }
+    if(ptr == nullptr)
+    {
+        Chunk* chunk = createChunk(std::max<size_t>(mapped_size, ChunkSize));
+        ptr = chunk->allocate(mapped_size);
+    }
+    mapped_bytes += mapped_size;
+    LOG(trace) << "[CPU] Mapped " << mapped_size / (1024 * 1024) << " MB in " << directory
+               << ". Total mapped: " << mapped_bytes / (1024 * 1024) << " MB in " << chunks.size() << " files";
+    return ptr;
+}
+
+void FileMappedAllocator::unmap(unsigned char* ptr, size_t size) const
+{
+    const size_t mapped_size = RoundUp(std::max<size_t>(size, 1), page_size);
+    boost::mutex::scoped_lock lock(mtx);
+    auto itr = chunks.upper_bound(ptr);
+    CV_Assert(itr != chunks.begin());
+    --itr;
+    Chunk* chunk = itr->second.get();
+    CV_Assert(ptr + mapped_size <= chunk->begin + chunk->size);
+    chunk->deallocate(ptr, mapped_size);
+    mapped_bytes -= mapped_size;
+    if(!chunk->empty())
+        return;
+    // Keep one empty chunk so that a history that drains and refills does not remap
+    bool other_empty = chunk->size != ChunkSize;
+    for(auto& other : chunks)
+        other_empty = other_empty || (other.second.get() != chunk && other.second->empty());
+    if(other_empty)
+    {
+        destroyChunk(chunk);
+        chunks.erase(itr);
+    }
+}
+
+FileMappedAllocator::Chunk* FileMappedAllocator::createChunk(size_t size) const
+{
+#ifdef _WIN32
+    char path[MAX_PATH + 1];
+    if(GetTempFileNameA(directory.c_str(), "mo", 0, path) == 0)
+    {
+        THROW(warning) << "Unable to create a temporary file in " << directory;
+    }
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        THROW(warning) << "Unable to open temporary file " << path;
+    }
+    DWORD returned = 0;
+    DeviceIoControl(file, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+    const unsigned long long file_size = size;
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                        static_cast<DWORD>(file_size >> 32), static_cast<DWORD>(file_size), nullptr);
+    void* ptr = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+    // The view keeps the mapping alive
+    if(mapping)
+        CloseHandle(mapping);
+    if(ptr == nullptr)
+    {
+        CloseHandle(file);
+        THROW(warning) << "Unable to map " << size << " bytes of " << path;
+    }
+#else
+    std::string pattern = directory + "/mo_mapped_XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    const int fd = mkstemp(path.data());
+    if(fd < 0)
+    {
+        THROW(warning) << "Unable to create a temporary file in " << directory << ": " << strerror(errno);
+    }
+    // Only the mapping refers to the file from now on, so it is removed even if we crash
+    unlink(path.data());
+    // Extending the file with ftruncate leaves it sparse, blocks are allocated as pages are written back
+    if(ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        const int error = errno;
+        close(fd);
+        THROW(warning) << "Unable to size temporary file to " << size << " bytes: " << strerror(error);
+    }
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    close(fd);
+    if(ptr == MAP_FAILED)
+    {
+        THROW(warning) << "Unable to map " << size << " bytes of a temporary file: " << strerror(error);
+    }
+    madvise(ptr, size, MADV_SEQUENTIAL);
+#endif
+    std::unique_ptr<Chunk> chunk(new Chunk());
+    chunk->begin = static_cast<unsigned char*>(ptr);
+    chunk->size = size;
+#ifdef _WIN32
+    chunk->file = file;
+#endif
+    chunk->free_bytes = 0;
+    chunk->insertFreeRange(chunk->begin, size);
+    Chunk* output = chunk.get();
+    chunks[chunk->begin] = std::move(chunk);
+    LOG(debug) << "[CPU] Mapped a " << size / (1024 * 1024) << " MB file in " << directory;
+    return output;
+}
+
+void FileMappedAllocator::destroyChunk(Chunk* chunk) const
+{
+#ifdef _WIN32
+    UnmapViewOfFile(chunk->begin);
+    CloseHandle(chunk->file);
+#else
+    munmap(chunk->begin, chunk->size);
+#endif
+}
@@ -0,0 +1,252 @@
+#include "MetaObject/Detail/HostMemoryBackend.hpp"
+#include "MetaObject/Detail/Numa.hpp"
+#include "MetaObject/Logging/Log.hpp"
+#include <opencv2/core/cuda.hpp>
+#include <opencv2/cudev/common.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cuda_runtime.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace mo;
+
+namespace
+{
+    const size_t huge_page_size = 2 * 1024 * 1024;
+
+    size_t RoundUp(size_t size, size_t alignment)
+    {
+        return ((size + alignment - 1) / alignment) * alignment;
+    }
+
+    class PinnedHostMemory: public HostMemoryBackend
+    {
+    public:
+        unsigned char* allocate(size_t size)
+        {
+            unsigned char* ptr = nullptr;
+            CV_CUDEV_SAFE_CALL(cudaMallocHost(&ptr, size));
+            return ptr;
+        }
+        unsigned char* allocateOnNode(size_t size, int node)
+        {
+#ifdef _WIN32
+            return allocate(size);
+#else
+            if(node < 0 || GetNumaNodeCount() < 2)
+                return allocate(size);
+            // cudaMallocHost faults the pages in on the calling thread's node, so map,
+            // bind and then page lock the range instead
+            void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(ptr == MAP_FAILED)
+            {
+                THROW(debug) << "Unable to map " << size << " bytes of host memory: " << strerror(errno);
+            }
+            BindToNumaNode(ptr, size, node);
+            CV_CUDEV_SAFE_CALL(cudaHostRegister(ptr, size, cudaHostRegisterDefault));
+            boost::mutex::scoped_lock lock(mtx);
+            registered.insert(static_cast<unsigned char*>(ptr));
+            return static_cast<unsigned char*>(ptr);
+#endif
+        }
+        void deallocate(unsigned char* ptr, size_t size)
+        {
+#ifndef _WIN32
+            {
+                boost::mutex::scoped_lock lock(mtx);
+                auto itr = registered.find(ptr);
+                if(itr != registered.end())
+                {
+                    registered.erase(itr);
+                    lock.unlock();
+                    CV_CUDEV_SAFE_CALL(cudaHostUnregister(ptr));
+                    munmap(ptr, size);
+                    return;
+                }
+            }
+#endif
+            CV_CUDEV_SAFE_CALL(cudaFreeHost(ptr));
+        }
+        Type GetType() const
+        {
+            return Pinned_e;
+        }
+    private:
+        boost::mutex mtx;
+        // Node local allocations that were mapped and registered instead of cudaMallocHost'd
+        std::set<unsigned char*> registered;
+    };
+
+    class MappedHostMemory: public HostMemoryBackend
+    {
+    public:
+        MappedHostMemory(bool huge_pages_):
+            huge_pages(huge_pages_)
+        {
+#ifdef _WIN32
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            page_size = info.dwAllocationGranularity;
+#else
+            page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        }
+
+        unsigned char* allocate(size_t size)
+        {
+            const size_t mapped_size = RoundUp(size, alignment());
+#ifdef _WIN32
+            void* ptr = VirtualAlloc(nullptr, mapped_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if(ptr == nullptr)
+            {
+                THROW(debug) << "Unable to map " << mapped_size << " bytes of host memory";
+            }
+            return static_cast<unsigned char*>(ptr);
+#else
+            void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            if(huge_pages)
+            {
+                ptr = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if(ptr != MAP_FAILED)
+                {
+                    return static_cast<unsigned char*>(ptr);
+                }
+                LOG_FIRST_N(debug, 1) << "No reserved huge pages available, falling back to transparent huge pages";
+            }
+#endif
+            // Over map so that the returned range can be aligned to the huge page size,
+            // otherwise transparent huge pages cannot back the first and last pages
+            const size_t padding = huge_pages ? huge_page_size : 0;
+            ptr = mmap(nullptr, mapped_size + padding, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(ptr == MAP_FAILED)
+            {
+                THROW(debug) << "Unable to map " << mapped_size << " bytes of host memory: " << strerror(errno);
+            }
+            unsigned char* begin = static_cast<unsigned char*>(ptr);
+            if(padding)
+            {
+                unsigned char* aligned = reinterpret_cast<unsigned char*>(
+                            RoundUp(reinterpret_cast<size_t>(begin), huge_page_size));
+                if(aligned != begin)
+                    munmap(begin, aligned - begin);
+                if(aligned + mapped_size != begin + mapped_size + padding)
+                    munmap(aligned + mapped_size, (begin + mapped_size + padding) - (aligned + mapped_size));
+                begin = aligned;
+#ifdef MADV_HUGEPAGE
+                madvise(begin, mapped_size, MADV_HUGEPAGE);
+#endif
+            }
+            return begin;
+#endif
+        }
+
+        unsigned char* allocateOnNode(size_t size, int node)
+        {
+            unsigned char* ptr = allocate(size);
+            // The pages have not been touched yet, so the policy decides where they are faulted in
+            BindToNumaNode(ptr, RoundUp(size, alignment()), node);
+            return ptr;
+        }
+
+        void deallocate(unsigned char* ptr, size_t size)
+        {
+#ifdef _WIN32
+            VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+            if(munmap(ptr, RoundUp(size, alignment())) != 0)
+            {
+                LOG(warning) << "Unable to unmap " << size << " bytes at " << (void*)ptr << ": " << strerror(errno);
+            }
+#endif
+        }
+
+        Type GetType() const
+        {
+            return huge_pages ? HugePage_e : Mapped_e;
+        }
+    private:
+        size_t alignment() const
+        {
+            return huge_pages ? huge_page_size : page_size;
+        }
+        bool huge_pages;
+        size_t page_size;
+    };
+
+    HostMemoryBackend::Type DefaultType()
+    {
+        const char* env = std::getenv("MO_HOST_MEMORY");
+        if(env)
+        {
+            std::string value(env);
+            if(value == "mapped")
+                return HostMemoryBackend::Mapped_e;
+            if(value == "hugepage")
+                return HostMemoryBackend::HugePage_e;
+            if(value == "pinned")
+                return HostMemoryBackend::Pinned_e;
+            LOG(warning) << "Unknown MO_HOST_MEMORY value '" << value << "'";
+        }
+        // cudaMallocHost fails without a device, only called once since the default is cached
+        if(cv::cuda::getCudaEnabledDeviceCount() <= 0)
+        {
+            LOG(info) << "No CUDA device found, using mapped host memory";
+            return HostMemoryBackend::Mapped_e;
+        }
+        return HostMemoryBackend::Pinned_e;
+    }
+
+    std::atomic<HostMemoryBackend*>& DefaultBackend()
+    {
+        static std::atomic<HostMemoryBackend*> g_inst(HostMemoryBackend::Get(DefaultType()));
+        return g_inst;
+    }
+}
+
+HostMemoryBackend* HostMemoryBackend::Get(Type type)
+{
+    // Never destroyed, memory stacks release their blocks from thread exit handlers
+    static HostMemoryBackend* g_pinned = new PinnedHostMemory();
+    static HostMemoryBackend* g_mapped = new MappedHostMemory(false);
+    static HostMemoryBackend* g_huge = new MappedHostMemory(true);
+    switch(type)
+    {
+    case Mapped_e: return g_mapped;
+    case HugePage_e: return g_huge;
+    default: return g_pinned;
+    }
+}
+
+HostMemoryBackend* HostMemoryBackend::GetDefault()
+{
+    return DefaultBackend().load();
+}
+
+void HostMemoryBackend::SetDefault(Type type)
+{
+    DefaultBackend().store(Get(type));
+}
+
+void HostMemoryBackend::Prefault(unsigned char* ptr, size_t size)
+{
+    // The smallest page size of any supported platform, touching more often than needed is harmless
+    const size_t stride = 4096;
+    volatile unsigned char* begin = ptr;
+    for(size_t offset = 0; offset < size; offset += stride)
+        begin[offset] = 0;
+    if(size)
+        begin[size - 1] = 0;
+}
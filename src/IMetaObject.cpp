@@ -74,6 +74,8 @@ IMetaObject::IMetaObject()
     _ctx = nullptr;
     _sig_manager = nullptr;
     _pimpl->_slot_parameter_updated = std::bind(&IMetaObject::onParameterUpdate, this, std::placeholders::_1, std::placeholders::_2);
+    // Setting a parameter from another thread reconfigures the object, it runs ahead of queued data
+    _pimpl->_slot_parameter_updated.SetQueuePriority(HighPriority_e);
 }
 
 
@@ -95,6 +97,7 @@ void IMetaObject::Init(bool firstInit)
         auto update_slot = this->GetSlot<void(mo::Context*, mo::IParameter*)>("on_" + param->GetName() + "_modified");
         if(update_slot)
         {
+            update_slot->SetQueuePriority(HighPriority_e);
             auto connection = param->RegisterUpdateNotifier(update_slot);
             this->AddConnection(connection, param->GetName() + "_modified", "on_" + param->GetName() + "_modified", update_slot->GetSignature(), this);
         }
@@ -279,6 +282,8 @@ void IMetaObject::SetContext(Context* ctx, bool overwrite)
     if(_ctx && overwrite == false)
         return;
     _ctx = ctx;
+    // Slots of this object report its context
+    ISlot::InvalidateContexts();
     for(auto& param : _pimpl->_implicit_parameters)
     {
         param.second->SetContext(ctx);
@@ -1,5 +1,6 @@
 #include "MetaObject/Detail/MemoryBlock.h"
 #include "MetaObject/Detail/AllocatorImpl.hpp"
+#include "MetaObject/Detail/HostMemoryBackend.hpp"
 #include <algorithm>
 #include <vector>
 #include <utility>
@@ -14,94 +15,168 @@ void GPUMemory::_allocate(unsigned char** ptr, size_t size)
 {
     CV_CUDEV_SAFE_CALL(cudaMalloc(ptr, size));
 }
-void GPUMemory::_deallocate(unsigned char* ptr)
+void GPUMemory::_deallocate(unsigned char* ptr, size_t size)
 {
     CV_CUDEV_SAFE_CALL(cudaFree(ptr));
 }
 
 void CPUMemory::_allocate(unsigned char** ptr, size_t size)
 {
-    CV_CUDEV_SAFE_CALL(cudaMallocHost(ptr, size));
+    backend = HostMemoryBackend::GetDefault();
+    *ptr = backend->allocate(size);
 }
 
-void CPUMemory::_deallocate(unsigned char* ptr)
+void CPUMemory::_allocate(unsigned char** ptr, size_t size, int numa_node)
 {
-    CV_CUDEV_SAFE_CALL(cudaFreeHost(ptr));
+    backend = HostMemoryBackend::GetDefault();
+    *ptr = backend->allocateOnNode(size, numa_node);
+}
+
+void CPUMemory::_deallocate(unsigned char* ptr, size_t size)
+{
+    backend->deallocate(ptr, size);
 }
 
 template<class XPU>
 MemoryBlock<XPU>::MemoryBlock(size_t size_):
-    size(size_)
+    size(size_),
+    free_bytes(0)
 {
     XPU::_allocate(&begin, size);
     end = begin + size;
+    insertFreeRange(begin, size);
+}
+
+template<>
+MemoryBlock<CPUMemory>::MemoryBlock(size_t size_, int numa_node):
+    size(size_),
+    free_bytes(0)
+{
+    CPUMemory::_allocate(&begin, size, numa_node);
+    end = begin + size;
+    insertFreeRange(begin, size);
 }
 
 template<class XPU>
 MemoryBlock<XPU>::~MemoryBlock()
 {
-    XPU::_deallocate(begin);
+    XPU::_deallocate(begin, size);
 }
 
 template<class XPU>
-unsigned char* MemoryBlock<XPU>::allocate(size_t size_, size_t elemSize_)
+void MemoryBlock<XPU>::insertFreeRange(unsigned char* ptr, size_t size_)
 {
-    if (size_ > size)
-        return nullptr;
-    std::vector<std::pair<size_t, unsigned char*>> candidates;
-    unsigned char* prevEnd = begin;
-    if (allocatedBlocks.size())
-    {
-        for (auto itr : allocatedBlocks)
-        {
-            if (static_cast<size_t>(itr.first - prevEnd) > size_)
-            {
-                auto alignment = alignmentOffset(prevEnd, elemSize_);
-                if (static_cast<size_t>(itr.first - prevEnd + alignment) >= size_)
-                {
-                    candidates.push_back(std::make_pair(size_t(itr.first - prevEnd + alignment), prevEnd + alignment));
-                }
-            }
-            prevEnd = itr.second;
-        }
-    }
-    if (static_cast<size_t>(end - prevEnd) >= size_)
+    if (size_ == 0)
+        return;
+    freeRanges[ptr] = size_;
+    freeSizes.insert(std::make_pair(size_, ptr));
+    free_bytes += size_;
+}
+
+template<class XPU>
+void MemoryBlock<XPU>::eraseFreeRange(std::map<unsigned char*, size_t>::iterator itr)
+{
+    auto range = freeSizes.equal_range(itr->second);
+    for (auto size_itr = range.first; size_itr != range.second; ++size_itr)
     {
-        auto alignment = alignmentOffset(prevEnd, elemSize_);
-        if (static_cast<size_t>(end - prevEnd + alignment) >= size_)
+        if (size_itr->second == itr->first)
         {
-            candidates.push_back(std::make_pair(size_t(end - prevEnd + alignment), prevEnd + alignment));
+            freeSizes.erase(size_itr);
+            break;
         }
     }
-    // Find the smallest chunk of memory that fits our requirement, helps reduce fragmentation.
-    auto min = std::min_element(candidates.begin(), candidates.end(),
-                    [](const std::pair<size_t, unsigned char*>& first, const std::pair<size_t, unsigned char*>& second)
-                    {
-                        return first.first < second.first;
-                    });
-
-    if (min != candidates.end() && min->first > size_)
+    free_bytes -= itr->second;
+    freeRanges.erase(itr);
+}
+
+template<class XPU>
+unsigned char* MemoryBlock<XPU>::allocate(size_t size_, size_t elemSize_)
+{
+    if (size_ == 0 || size_ > free_bytes)
+        return nullptr;
+    if (elemSize_ == 0)
+        elemSize_ = 1;
+    // Best fit: the smallest free range that can hold the request.  If its
+    // alignment padding pushes it over, the smallest range that can hold the
+    // request with worst case padding is guaranteed to fit.
+    auto candidate = freeSizes.lower_bound(size_);
+    if (candidate != freeSizes.end() &&
+        candidate->first < size_ + alignmentOffset(candidate->second, static_cast<int>(elemSize_)))
     {
-        allocatedBlocks[min->second] = (unsigned char*)(min->second + size_);
-        return min->second;
+        candidate = freeSizes.lower_bound(size_ + elemSize_ - 1);
     }
-    return nullptr;
+    if (candidate == freeSizes.end())
+        return nullptr;
+
+    unsigned char* range_begin = candidate->second;
+    size_t range_size = candidate->first;
+    eraseFreeRange(freeRanges.find(range_begin));
+
+    size_t alignment = alignmentOffset(range_begin, static_cast<int>(elemSize_));
+    unsigned char* ptr = range_begin + alignment;
+    // Padding in front of the allocation and the tail behind it stay free
+    insertFreeRange(range_begin, alignment);
+    insertFreeRange(ptr + size_, range_size - alignment - size_);
+    allocatedBlocks[ptr] = ptr + size_;
+    return ptr;
 }
 
 template<class XPU>
 bool MemoryBlock<XPU>::deAllocate(unsigned char* ptr)
 {
-    if (ptr < begin || ptr > end)
+    if (ptr < begin || ptr >= end)
         return false;
     auto itr = allocatedBlocks.find(ptr);
-    if (itr != allocatedBlocks.end())
+    if (itr == allocatedBlocks.end())
+        return false;
+    unsigned char* range_begin = itr->first;
+    unsigned char* range_end = itr->second;
+    allocatedBlocks.erase(itr);
+
+    // Coalesce with the free range directly after the released range
+    auto next = freeRanges.find(range_end);
+    if (next != freeRanges.end())
     {
-        allocatedBlocks.erase(itr);
-        return true;
+        range_end += next->second;
+        eraseFreeRange(next);
     }
+    // Coalesce with the free range directly before the released range
+    auto prev = freeRanges.lower_bound(range_begin);
+    if (prev != freeRanges.begin())
+    {
+        --prev;
+        if (prev->first + prev->second == range_begin)
+        {
+            range_begin = prev->first;
+            eraseFreeRange(prev);
+        }
+    }
+    insertFreeRange(range_begin, range_end - range_begin);
     return true;
 }
 
+template<class XPU>
+size_t MemoryBlock<XPU>::FreeBytes() const
+{
+    return free_bytes;
+}
+
+template<class XPU>
+size_t MemoryBlock<XPU>::LargestFreeRange() const
+{
+    if (freeSizes.empty())
+        return 0;
+    return freeSizes.rbegin()->first;
+}
+
+template<class XPU>
+double MemoryBlock<XPU>::Fragmentation() const
+{
+    if (free_bytes == 0)
+        return 0.0;
+    return 1.0 - static_cast<double>(LargestFreeRange()) / static_cast<double>(free_bytes);
+}
+
 template<class XPU>
 unsigned char* MemoryBlock<XPU>::Begin() const
 {
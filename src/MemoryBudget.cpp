@@ -0,0 +1,159 @@
+#include "MetaObject/Detail/MemoryBudget.hpp"
+#include "MetaObject/Logging/Log.hpp"
+#include <algorithm>
+
+using namespace mo;
+
+namespace
+{
+    void UpdatePeak(std::atomic<size_t>& peak, size_t value)
+    {
+        size_t current = peak.load(std::memory_order_relaxed);
+        while(value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    const char* ActionName(MemoryBudget::Action action)
+    {
+        switch(action)
+        {
+        case MemoryBudget::Block_e: return "block";
+        case MemoryBudget::Evict_e: return "evict";
+        default: return "fail fast";
+        }
+    }
+}
+
+MemoryBudget::MemoryBudget(size_t limit_, Action action_, std::chrono::milliseconds timeout_, const std::string& name_):
+    name(name_),
+    action(action_),
+    timeout(timeout_),
+    limit(limit_),
+    in_use(0),
+    peak_bytes(0),
+    admitted(0),
+    rejected(0),
+    blocked(0),
+    evicted_bytes(0),
+    waiters(0)
+{
+}
+
+void MemoryBudget::SetLimit(size_t bytes)
+{
+    limit = bytes;
+    if(waiters.load())
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        cv.notify_all();
+    }
+}
+
+size_t MemoryBudget::GetLimit() const
+{
+    return limit;
+}
+
+MemoryBudget::Action MemoryBudget::GetAction() const
+{
+    return action;
+}
+
+size_t MemoryBudget::GetUsage() const
+{
+    return in_use;
+}
+
+MemoryBudgetStatistics MemoryBudget::GetStatistics() const
+{
+    MemoryBudgetStatistics stats;
+    stats.name = name;
+    stats.limit = limit;
+    stats.bytes_in_use = in_use;
+    stats.peak_bytes = peak_bytes;
+    stats.admitted = admitted;
+    stats.rejected = rejected;
+    stats.blocked = blocked;
+    stats.evicted_bytes = evicted_bytes;
+    return stats;
+}
+
+bool MemoryBudget::TryAcquire(size_t num_bytes)
+{
+    size_t used = in_use.load();
+    while(used + num_bytes <= limit.load(std::memory_order_relaxed))
+    {
+        if(in_use.compare_exchange_weak(used, used + num_bytes))
+        {
+            UpdatePeak(peak_bytes, used + num_bytes);
+            ++admitted;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MemoryBudget::Acquire(size_t num_bytes, const std::function<size_t(size_t)>& evict)
+{
+    if(TryAcquire(num_bytes))
+        return;
+    if(action == Block_e)
+    {
+        ++blocked;
+        const auto deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(timeout.count());
+        ++waiters;
+        bool acquired = false;
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            // Release decrements before it checks for waiters, so the check
+            // under the lock cannot miss a free that happens while we wait
+            while(!(acquired = TryAcquire(num_bytes)))
+            {
+                if(cv.wait_until(lock, deadline) == boost::cv_status::timeout)
+                {
+                    acquired = TryAcquire(num_bytes);
+                    break;
+                }
+            }
+        }
+        --waiters;
+        if(acquired)
+            return;
+    }else if(action == Evict_e && evict)
+    {
+        const size_t used = in_use.load();
+        const size_t max = limit.load();
+        const size_t overshoot = used + num_bytes > max ? used + num_bytes - max : 0;
+        const size_t evicted = evict(overshoot);
+        evicted_bytes += evicted;
+        if(evicted >= overshoot)
+        {
+            Charge(num_bytes);
+            ++admitted;
+            return;
+        }
+    }
+    ++rejected;
+    THROW(warning) << "Allocation of " << num_bytes / 1024 << " KB exceeds memory budget '" << name
+                   << "' (" << in_use.load() / (1024 * 1024) << " of " << limit.load() / (1024 * 1024)
+                   << " MB in use, action: " << ActionName(action) << ")";
+}
+
+void MemoryBudget::Charge(size_t num_bytes)
+{
+    UpdatePeak(peak_bytes, in_use.fetch_add(num_bytes) + num_bytes);
+}
+
+void MemoryBudget::Release(size_t num_bytes)
+{
+    size_t used = in_use.load();
+    while(!in_use.compare_exchange_weak(used, used - std::min(used, num_bytes)))
+    {
+    }
+    if(waiters.load())
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        cv.notify_all();
+    }
+}
@@ -0,0 +1,126 @@
+#include "MetaObject/Detail/MemoryResource.hpp"
+#include "MetaObject/Detail/Allocator.hpp"
+#include "MetaObject/Detail/Arena.hpp"
+#include "MetaObject/Context.hpp"
+#include <new>
+
+using namespace mo;
+
+namespace
+{
+    CpuMemoryPool* PoolOrThread(CpuMemoryPool* pool)
+    {
+        return pool ? pool : CpuMemoryPool::ThreadInstance();
+    }
+}
+
+// ================================================================
+// PoolMemoryResource
+PoolMemoryResource* PoolMemoryResource::GlobalInstance()
+{
+    static PoolMemoryResource* g_inst = new PoolMemoryResource(CpuMemoryPool::GlobalInstance());
+    return g_inst;
+}
+
+PoolMemoryResource* PoolMemoryResource::ThreadInstance()
+{
+    static PoolMemoryResource* g_inst = new PoolMemoryResource();
+    return g_inst;
+}
+
+PoolMemoryResource::PoolMemoryResource(CpuMemoryPool* pool_):
+    pool(pool_)
+{
+}
+
+void* PoolMemoryResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    void* ptr = nullptr;
+    if(!PoolOrThread(pool)->allocate(&ptr, bytes, alignment) || ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void PoolMemoryResource::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+{
+    CpuMemoryPool* home = CpuMemoryPool::FindInstance(ptr);
+    (home ? home : PoolOrThread(pool))->deallocate(ptr, bytes);
+}
+
+bool PoolMemoryResource::do_is_equal(const boost::container::pmr::memory_resource& other) const BOOST_NOEXCEPT
+{
+    // Every pool frees into the pool the memory came from
+    return dynamic_cast<const PoolMemoryResource*>(&other) != nullptr;
+}
+
+// ================================================================
+// StackMemoryResource
+StackMemoryResource* StackMemoryResource::GlobalInstance()
+{
+    static StackMemoryResource* g_inst = new StackMemoryResource(CpuMemoryStack::GlobalInstance());
+    return g_inst;
+}
+
+StackMemoryResource* StackMemoryResource::ThreadInstance()
+{
+    static StackMemoryResource* g_inst = new StackMemoryResource();
+    return g_inst;
+}
+
+StackMemoryResource::StackMemoryResource(CpuMemoryStack* stack_):
+    stack(stack_)
+{
+}
+
+void* StackMemoryResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    void* ptr = nullptr;
+    CpuMemoryStack* target = stack ? stack : CpuMemoryStack::ThreadInstance();
+    if(!target->allocate(&ptr, bytes, alignment) || ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void StackMemoryResource::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+{
+    (stack ? stack : CpuMemoryStack::ThreadInstance())->deallocate(ptr, bytes);
+}
+
+bool StackMemoryResource::do_is_equal(const boost::container::pmr::memory_resource& other) const BOOST_NOEXCEPT
+{
+    // Stack blocks come straight from the host backend, so any stack can cache them
+    return dynamic_cast<const StackMemoryResource*>(&other) != nullptr;
+}
+
+// ================================================================
+// ArenaMemoryResource
+ArenaMemoryResource* ArenaMemoryResource::ThreadInstance()
+{
+    static ArenaMemoryResource* g_inst = new ArenaMemoryResource();
+    return g_inst;
+}
+
+ArenaMemoryResource::ArenaMemoryResource(Arena* arena_):
+    arena(arena_)
+{
+}
+
+void* ArenaMemoryResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    return (arena ? arena : Arena::Current())->allocate(bytes, alignment);
+}
+
+void ArenaMemoryResource::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+{
+}
+
+bool ArenaMemoryResource::do_is_equal(const boost::container::pmr::memory_resource& other) const BOOST_NOEXCEPT
+{
+    // Deallocation is a no-op, so memory from any arena can be handed to any other
+    return dynamic_cast<const ArenaMemoryResource*>(&other) != nullptr;
+}
+
+boost::container::pmr::memory_resource* mo::GetThreadMemoryResource()
+{
+    return Context::GetDefaultThreadContext()->memory_resource;
+}
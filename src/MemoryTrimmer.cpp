@@ -0,0 +1,192 @@
+#include "MetaObject/Detail/MemoryTrimmer.hpp"
+#include "MetaObject/Logging/Log.hpp"
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <vector>
+
+using namespace mo;
+
+struct MemoryTrimmer::impl
+{
+    std::vector<ITrimmable*> objects;
+    // Held for the duration of a pass so that Unregister waits for a running trim
+    mutable boost::mutex mtx;
+    boost::mutex thread_mtx;
+    boost::condition_variable cv;
+    boost::thread thread;
+    bool running = false;
+    size_t low_watermark = std::numeric_limits<size_t>::max();
+    size_t high_watermark = std::numeric_limits<size_t>::max();
+    std::chrono::milliseconds max_age = std::chrono::milliseconds(1000);
+    std::chrono::milliseconds period = std::chrono::milliseconds(100);
+    std::chrono::steady_clock::time_point deferred_until;
+
+    size_t trim()
+    {
+        boost::mutex::scoped_lock lock(mtx);
+        size_t released = 0;
+        std::vector<std::pair<size_t, ITrimmable*>> cached;
+        size_t total = 0;
+        for(ITrimmable* obj : objects)
+        {
+            released += obj->Trim(max_age, 0);
+            size_t bytes = obj->GetCachedBytes();
+            total += bytes;
+            cached.emplace_back(bytes, obj);
+        }
+        if(total > high_watermark)
+        {
+            size_t excess = total - std::min(low_watermark, high_watermark);
+            LOG(debug) << "Cached memory " << total / (1024 * 1024) << " MB is above the high watermark, releasing "
+                       << excess / (1024 * 1024) << " MB";
+            // Largest caches first
+            std::sort(cached.begin(), cached.end(),
+                [](const std::pair<size_t, ITrimmable*>& lhs, const std::pair<size_t, ITrimmable*>& rhs)
+            {
+                return lhs.first > rhs.first;
+            });
+            for(auto& obj : cached)
+            {
+                if(excess == 0)
+                    break;
+                size_t bytes = obj.second->Trim(max_age, excess);
+                released += bytes;
+                excess -= std::min(bytes, excess);
+            }
+        }
+        return released;
+    }
+
+    void run()
+    {
+        while(!boost::this_thread::interruption_requested())
+        {
+            std::chrono::milliseconds wait;
+            std::chrono::steady_clock::time_point deferred;
+            {
+                boost::mutex::scoped_lock lock(mtx);
+                wait = period;
+            }
+            {
+                boost::mutex::scoped_lock lock(thread_mtx);
+                cv.wait_for(lock, boost::chrono::milliseconds(wait.count()));
+                deferred = deferred_until;
+            }
+            if(std::chrono::steady_clock::now() >= deferred)
+                trim();
+        }
+    }
+};
+
+static void StopTrimmerAtExit()
+{
+    MemoryTrimmer::Instance()->Stop();
+}
+
+MemoryTrimmer* MemoryTrimmer::Instance()
+{
+    static MemoryTrimmer* g_inst = nullptr;
+    if(g_inst == nullptr)
+    {
+        g_inst = new MemoryTrimmer();
+        // Stop before logging and static pools are torn down
+        std::atexit(&StopTrimmerAtExit);
+    }
+    return g_inst;
+}
+
+MemoryTrimmer::MemoryTrimmer():
+    _pimpl(new impl())
+{
+}
+
+MemoryTrimmer::~MemoryTrimmer()
+{
+    Stop();
+}
+
+void MemoryTrimmer::Register(ITrimmable* obj)
+{
+    {
+        boost::mutex::scoped_lock lock(_pimpl->mtx);
+        _pimpl->objects.push_back(obj);
+    }
+    Start();
+}
+
+void MemoryTrimmer::Unregister(ITrimmable* obj)
+{
+    boost::mutex::scoped_lock lock(_pimpl->mtx);
+    _pimpl->objects.erase(std::remove(_pimpl->objects.begin(), _pimpl->objects.end(), obj), _pimpl->objects.end());
+}
+
+void MemoryTrimmer::SetWatermarks(size_t low_bytes, size_t high_bytes)
+{
+    boost::mutex::scoped_lock lock(_pimpl->mtx);
+    _pimpl->low_watermark = low_bytes;
+    _pimpl->high_watermark = high_bytes;
+}
+
+void MemoryTrimmer::SetMaxAge(std::chrono::milliseconds max_age)
+{
+    boost::mutex::scoped_lock lock(_pimpl->mtx);
+    _pimpl->max_age = max_age;
+}
+
+void MemoryTrimmer::SetPeriod(std::chrono::milliseconds period)
+{
+    {
+        boost::mutex::scoped_lock lock(_pimpl->mtx);
+        _pimpl->period = period;
+    }
+    _pimpl->cv.notify_all();
+}
+
+void MemoryTrimmer::Defer(std::chrono::milliseconds duration)
+{
+    const auto until = std::chrono::steady_clock::now() + duration;
+    boost::mutex::scoped_lock lock(_pimpl->thread_mtx);
+    if(until > _pimpl->deferred_until)
+        _pimpl->deferred_until = until;
+}
+
+size_t MemoryTrimmer::GetCachedBytes() const
+{
+    boost::mutex::scoped_lock lock(_pimpl->mtx);
+    size_t total = 0;
+    for(ITrimmable* obj : _pimpl->objects)
+        total += obj->GetCachedBytes();
+    return total;
+}
+
+size_t MemoryTrimmer::Trim()
+{
+    return _pimpl->trim();
+}
+
+void MemoryTrimmer::Start()
+{
+    boost::mutex::scoped_lock lock(_pimpl->thread_mtx);
+    if(_pimpl->running)
+        return;
+    _pimpl->running = true;
+    _pimpl->thread = boost::thread(&impl::run, _pimpl.get());
+}
+
+void MemoryTrimmer::Stop()
+{
+    {
+        boost::mutex::scoped_lock lock(_pimpl->thread_mtx);
+        if(!_pimpl->running)
+            return;
+        _pimpl->running = false;
+        _pimpl->thread.interrupt();
+    }
+    _pimpl->cv.notify_all();
+    _pimpl->thread.join();
+}
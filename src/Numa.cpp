@@ -0,0 +1,187 @@
+#include "MetaObject/Detail/Numa.hpp"
+#include "MetaObject/Logging/Log.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+    thread_local int t_numa_node = -1;
+
+#ifndef _WIN32
+    // From linux/mempolicy.h, not every distribution ships the header
+    const int mpol_preferred = 1;
+
+    // Parses the sysfs list format, ie "0-3,8-11"
+    std::vector<int> ParseList(const std::string& list)
+    {
+        std::vector<int> output;
+        std::stringstream ss(list);
+        std::string range;
+        while(std::getline(ss, range, ','))
+        {
+            if(range.empty())
+                continue;
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for(int i = first; i <= last; ++i)
+                output.push_back(i);
+        }
+        return output;
+    }
+
+    std::string ReadLine(const std::string& path)
+    {
+        std::ifstream ifs(path);
+        std::string line;
+        std::getline(ifs, line);
+        return line;
+    }
+
+    struct Topology
+    {
+        Topology()
+        {
+            std::vector<int> nodes = ParseList(ReadLine("/sys/devices/system/node/online"));
+            for(int node : nodes)
+            {
+                if(node >= static_cast<int>(node_cpus.size()))
+                    node_cpus.resize(node + 1);
+                node_cpus[node] = ParseList(ReadLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+                for(int cpu : node_cpus[node])
+                {
+                    if(cpu >= static_cast<int>(cpu_node.size()))
+                        cpu_node.resize(cpu + 1, 0);
+                    cpu_node[cpu] = node;
+                }
+            }
+            if(node_cpus.empty())
+                node_cpus.resize(1);
+        }
+        std::vector<std::vector<int>> node_cpus;
+        std::vector<int> cpu_node;
+    };
+
+    const Topology& GetTopology()
+    {
+        static Topology* g_inst = new Topology();
+        return *g_inst;
+    }
+#endif
+}
+
+namespace mo
+{
+int GetNumaNodeCount()
+{
+#ifdef _WIN32
+    ULONG highest = 0;
+    if(!GetNumaHighestNodeNumber(&highest))
+        return 1;
+    return static_cast<int>(highest) + 1;
+#else
+    return static_cast<int>(GetTopology().node_cpus.size());
+#endif
+}
+
+int GetCurrentNumaNode()
+{
+    if(t_numa_node >= 0)
+        return t_numa_node;
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    USHORT node = 0;
+    if(GetNumaProcessorNodeEx(&processor, &node))
+        return node;
+    return 0;
+#else
+    const Topology& topology = GetTopology();
+    int cpu = sched_getcpu();
+    if(cpu < 0 || cpu >= static_cast<int>(topology.cpu_node.size()))
+        return 0;
+    return topology.cpu_node[cpu];
+#endif
+}
+
+bool SetThreadNumaNode(int node)
+{
+    if(node >= GetNumaNodeCount())
+    {
+        LOG(warning) << "Unable to pin thread to NUMA node " << node << ", only "
+                     << GetNumaNodeCount() << " nodes available";
+        return false;
+    }
+#ifdef _WIN32
+    ULONGLONG mask = 0;
+    if(node < 0)
+    {
+        DWORD_PTR process_mask = 0, system_mask = 0;
+        GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask);
+        mask = process_mask;
+    }else if(!GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+    {
+        return false;
+    }
+    if(SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(mask)) == 0)
+        return false;
+#else
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    const Topology& topology = GetTopology();
+    for(size_t i = 0; i < topology.node_cpus.size(); ++i)
+    {
+        if(node >= 0 && static_cast<int>(i) != node)
+            continue;
+        for(int cpu : topology.node_cpus[i])
+            CPU_SET(cpu, &cpus);
+    }
+    // An empty set means the topology could not be read, leave the affinity alone
+    if(CPU_COUNT(&cpus) && sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+    {
+        LOG(warning) << "Unable to pin thread to NUMA node " << node << ": " << strerror(errno);
+        return false;
+    }
+#endif
+    t_numa_node = node;
+    LOG(debug) << "Pinned thread to NUMA node " << node;
+    return true;
+}
+
+int GetThreadNumaNode()
+{
+    return t_numa_node;
+}
+
+bool BindToNumaNode(void* ptr, size_t size, int node)
+{
+    if(node < 0 || GetNumaNodeCount() < 2)
+        return false;
+#ifdef _WIN32
+    return false;
+#else
+    unsigned long mask[4] = {0, 0, 0, 0};
+    const int bits = static_cast<int>(sizeof(unsigned long) * 8);
+    if(node >= bits * 4)
+        return false;
+    mask[node / bits] = 1ul << (node % bits);
+    if(syscall(SYS_mbind, ptr, size, mpol_preferred, mask, bits * 4 + 1, 0) != 0)
+    {
+        LOG(debug) << "Unable to bind memory to NUMA node " << node << ": " << strerror(errno);
+        return false;
+    }
+    return true;
+#endif
+}
+}
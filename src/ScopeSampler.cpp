@@ -0,0 +1,253 @@
+#include "MetaObject/Detail/ScopeSampler.hpp"
+#include "MetaObject/Detail/Allocator.hpp"
+#include "MetaObject/Thread/ThreadRegistry.hpp"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+using namespace mo;
+
+namespace
+{
+    struct ScopeEntry
+    {
+        // Written by the owning thread, live is also decremented by frees on other threads
+        std::atomic<size_t> samples{0};
+        std::atomic<size_t> allocated{0};
+        std::atomic<size_t> live{0};
+    };
+
+    struct ScopeSample
+    {
+        ScopeEntry* entry;
+        size_t weight;
+    };
+
+    /*!
+     * Scope table of one thread.  Tables are never destroyed since samples
+     * taken on a thread may be freed after it exited.
+     */
+    struct ScopeTable
+    {
+        size_t thread = 0;
+        // Only inserted into by the owning thread, guarded against GetStatistics
+        boost::mutex mtx;
+        std::map<std::string, std::unique_ptr<ScopeEntry>> entries;
+        // Bytes left until the next sample, only used by the owning thread
+        int64_t countdown = 0;
+        uint64_t random = 0;
+    };
+
+    struct SamplerState
+    {
+        enum { FilterSize = 4096 };
+        std::atomic<size_t> interval{0};
+        boost::mutex mtx;
+        std::vector<ScopeTable*> tables;
+        // Samples of allocations without a header.  The filter counts the samples
+        // per pointer hash so that unsampled frees do not take the lock.
+        std::atomic<uint32_t> filter[FilterSize];
+        boost::mutex pointer_mtx;
+        std::unordered_map<const void*, ScopeSample*> pointer_samples;
+
+        SamplerState()
+        {
+            for(size_t i = 0; i < FilterSize; ++i)
+                filter[i] = 0;
+            if(const char* env = std::getenv("MO_SCOPE_SAMPLE_INTERVAL"))
+                interval = static_cast<size_t>(std::strtoull(env, nullptr, 10));
+        }
+
+        static size_t Hash(const void* ptr)
+        {
+            // Allocations are at least 16 byte aligned
+            return (reinterpret_cast<size_t>(ptr) >> 4) % FilterSize;
+        }
+    };
+
+    SamplerState& State()
+    {
+        // Never destroyed, samples are released from thread exit handlers
+        static SamplerState* g_inst = new SamplerState();
+        return *g_inst;
+    }
+
+    // The table itself outlives the thread, see ScopeTable
+    void ReleaseTable(ScopeTable* table)
+    {
+    }
+
+    boost::thread_specific_ptr<ScopeTable> thread_table(&ReleaseTable);
+
+    // Exponentially distributed distance to the next sample, so that the sampling
+    // points do not synchronize with periodic allocation patterns
+    int64_t NextSample(ScopeTable* table, size_t interval)
+    {
+        table->random ^= table->random << 13;
+        table->random ^= table->random >> 7;
+        table->random ^= table->random << 17;
+        const double uniform = (static_cast<double>(table->random >> 11) + 1.0) / 9007199254740993.0;
+        return static_cast<int64_t>(-std::log(uniform) * static_cast<double>(interval)) + 1;
+    }
+
+    ScopeTable* GetThreadTable(size_t interval)
+    {
+        ScopeTable* table = thread_table.get();
+        if(table == nullptr)
+        {
+            table = new ScopeTable();
+            table->thread = GetThisThread();
+            table->random = static_cast<uint64_t>(table->thread) * 0x9E3779B97F4A7C15ull + 1;
+            table->countdown = NextSample(table, interval);
+            thread_table.reset(table);
+            SamplerState& state = State();
+            boost::mutex::scoped_lock lock(state.mtx);
+            state.tables.push_back(table);
+        }
+        return table;
+    }
+
+    ScopeSample* TakeSample(size_t num_bytes)
+    {
+        SamplerState& state = State();
+        const size_t interval = state.interval.load(std::memory_order_relaxed);
+        if(interval == 0)
+            return nullptr;
+        ScopeTable* table = GetThreadTable(interval);
+        table->countdown -= static_cast<int64_t>(num_bytes);
+        if(table->countdown > 0)
+            return nullptr;
+        table->countdown = NextSample(table, interval);
+        // Inverse of the probability of sampling an allocation of num_bytes
+        const double probability = 1.0 - std::exp(-static_cast<double>(num_bytes) / interval);
+        const size_t weight = static_cast<size_t>(num_bytes / std::max(probability, 1e-12));
+        ScopeEntry* entry;
+        {
+            const std::string& scope = GetScopeName();
+            boost::mutex::scoped_lock lock(table->mtx);
+            std::unique_ptr<ScopeEntry>& slot = table->entries[scope];
+            if(!slot)
+                slot.reset(new ScopeEntry());
+            entry = slot.get();
+        }
+        entry->samples.store(entry->samples.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        entry->allocated.store(entry->allocated.load(std::memory_order_relaxed) + weight, std::memory_order_relaxed);
+        entry->live.fetch_add(weight, std::memory_order_relaxed);
+        ScopeSample* sample = new ScopeSample();
+        sample->entry = entry;
+        sample->weight = weight;
+        return sample;
+    }
+}
+
+void ScopeSampler::SetSampleInterval(size_t bytes)
+{
+    State().interval = bytes;
+}
+
+size_t ScopeSampler::GetSampleInterval()
+{
+    return State().interval;
+}
+
+std::vector<ScopeAllocationStatistics> ScopeSampler::GetStatistics()
+{
+    SamplerState& state = State();
+    std::vector<ScopeTable*> tables;
+    {
+        boost::mutex::scoped_lock lock(state.mtx);
+        tables = state.tables;
+    }
+    std::vector<ScopeAllocationStatistics> output;
+    for(ScopeTable* table : tables)
+    {
+        boost::mutex::scoped_lock lock(table->mtx);
+        for(const auto& itr : table->entries)
+        {
+            ScopeAllocationStatistics stats;
+            stats.scope = itr.first;
+            stats.thread = table->thread;
+            stats.samples = itr.second->samples.load(std::memory_order_relaxed);
+            stats.allocated_bytes = itr.second->allocated.load(std::memory_order_relaxed);
+            stats.live_bytes = itr.second->live.load(std::memory_order_relaxed);
+            output.push_back(stats);
+        }
+    }
+    return output;
+}
+
+std::vector<ScopeAllocationStatistics> ScopeSampler::GetScopeTotals()
+{
+    std::map<std::string, ScopeAllocationStatistics> totals;
+    for(const ScopeAllocationStatistics& stats : GetStatistics())
+    {
+        ScopeAllocationStatistics& total = totals[stats.scope];
+        total.scope = stats.scope;
+        total.samples += stats.samples;
+        total.allocated_bytes += stats.allocated_bytes;
+        total.live_bytes += stats.live_bytes;
+    }
+    std::vector<ScopeAllocationStatistics> output;
+    output.reserve(totals.size());
+    for(const auto& itr : totals)
+        output.push_back(itr.second);
+    std::sort(output.begin(), output.end(),
+        [](const ScopeAllocationStatistics& lhs, const ScopeAllocationStatistics& rhs)
+    {
+        return lhs.live_bytes > rhs.live_bytes;
+    });
+    return output;
+}
+
+void* ScopeSampler::Sample(size_t num_bytes)
+{
+    return TakeSample(num_bytes);
+}
+
+void ScopeSampler::Release(void* sample)
+{
+    if(sample == nullptr)
+        return;
+    ScopeSample* scope_sample = static_cast<ScopeSample*>(sample);
+    scope_sample->entry->live.fetch_sub(scope_sample->weight, std::memory_order_relaxed);
+    delete scope_sample;
+}
+
+void ScopeSampler::SamplePointer(const void* ptr, size_t num_bytes)
+{
+    if(ptr == nullptr)
+        return;
+    ScopeSample* sample = TakeSample(num_bytes);
+    if(sample == nullptr)
+        return;
+    SamplerState& state = State();
+    boost::mutex::scoped_lock lock(state.pointer_mtx);
+    state.pointer_samples[ptr] = sample;
+    state.filter[SamplerState::Hash(ptr)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ScopeSampler::ReleasePointer(const void* ptr)
+{
+    SamplerState& state = State();
+    std::atomic<uint32_t>& filter = state.filter[SamplerState::Hash(ptr)];
+    if(filter.load(std::memory_order_relaxed) == 0)
+        return;
+    ScopeSample* sample = nullptr;
+    {
+        boost::mutex::scoped_lock lock(state.pointer_mtx);
+        auto itr = state.pointer_samples.find(ptr);
+        if(itr == state.pointer_samples.end())
+            return;
+        sample = itr->second;
+        state.pointer_samples.erase(itr);
+        filter.fetch_sub(1, std::memory_order_relaxed);
+    }
+    Release(sample);
+}
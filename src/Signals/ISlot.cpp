@@ -2,8 +2,14 @@
 #include "MetaObject/Thread/InterThread.hpp"
 #include "MetaObject/Signals/ISignalRelay.hpp"
 #include "MetaObject/IMetaObject.hpp"
+#include <atomic>
 using namespace mo;
 
+namespace
+{
+    std::atomic<size_t> g_context_generation(0);
+}
+
 ISlot::~ISlot()
 {
 	ThreadSpecificQueue::RemoveFromQueue(this);
@@ -16,6 +22,7 @@ ISlot::~ISlot()
 void ISlot::SetParent(IMetaObject* parent)
 {
 	_parent = parent;
+	InvalidateContexts();
 }
 
 IMetaObject* ISlot::GetParent() const
@@ -33,4 +40,35 @@ const Context* ISlot::GetContext() const
 void ISlot::SetContext(Context* ctx)
 {
     _ctx = ctx;
+    InvalidateContexts();
+}
+
+DeliveryPolicy ISlot::GetDeliveryPolicy() const
+{
+    return _delivery_policy;
+}
+
+void ISlot::SetDeliveryPolicy(DeliveryPolicy policy)
+{
+    _delivery_policy = policy;
+}
+
+QueuePriority ISlot::GetQueuePriority() const
+{
+    return _queue_priority;
+}
+
+void ISlot::SetQueuePriority(QueuePriority priority)
+{
+    _queue_priority = priority;
+}
+
+size_t ISlot::GetContextGeneration()
+{
+    return g_context_generation.load(std::memory_order_acquire);
+}
+
+void ISlot::InvalidateContexts()
+{
+    g_context_generation.fetch_add(1, std::memory_order_acq_rel);
 }
\ No newline at end of file
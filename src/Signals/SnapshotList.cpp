@@ -0,0 +1,32 @@
+#include "MetaObject/Signals/SnapshotList.hpp"
+
+using namespace mo;
+
+namespace
+{
+    // Innermost emission of this thread, frames live on the stack of the emitters
+    thread_local SignalDispatch* t_dispatch = nullptr;
+}
+
+SignalDispatch::SignalDispatch(const void* snapshot_):
+    snapshot(snapshot_),
+    previous(t_dispatch)
+{
+    t_dispatch = this;
+}
+
+SignalDispatch::~SignalDispatch()
+{
+    t_dispatch = previous;
+}
+
+long SignalDispatch::Count(const void* snapshot)
+{
+    long count = 0;
+    for(const SignalDispatch* frame = t_dispatch; frame != nullptr; frame = frame->previous)
+    {
+        if(frame->snapshot == snapshot)
+            ++count;
+    }
+    return count;
+}
@@ -1,21 +1,77 @@
 #include "MetaObject/Thread/InterThread.hpp"
 #include "MetaObject/Detail/ConcurrentQueue.hpp"
 #include "MetaObject/Logging/Log.hpp"
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <thread>
 #include <set>
 #include <map>
+#include <vector>
 using namespace mo;
+namespace
+{
+    typedef std::pair<std::function<void(void)>, void*> QueuedCall; // function + obj*
+    const size_t NumLanes = HighPriority_e + 1;
+
+    struct ThreadQueue
+    {
+        ThreadQueue():
+            running(nullptr)
+        {
+            std::fill(passed_over, passed_over + NumLanes, 0);
+        }
+        // Pops the next call, from the highest lane unless a lower lane has waited too long
+        bool try_pop(QueuedCall& call)
+        {
+            size_t lane = NumLanes;
+            for (size_t i = NumLanes; i-- > 0;)
+            {
+                if (lanes[i].size() == 0)
+                    continue;
+                if (lane == NumLanes)
+                    lane = i;
+                if (passed_over[i] >= ThreadSpecificQueue::StarvationLimit)
+                {
+                    lane = i;
+                    break;
+                }
+            }
+            if (lane == NumLanes || !lanes[lane].try_pop(call))
+                return false;
+            passed_over[lane] = 0;
+            for (size_t i = 0; i < lane; ++i)
+            {
+                if (lanes[i].size())
+                    ++passed_over[i];
+            }
+            return true;
+        }
+        size_t size()
+        {
+            size_t output = 0;
+            for (size_t i = 0; i < NumLanes; ++i)
+                output += lanes[i].size();
+            return output;
+        }
+
+        ConcurrentQueue<QueuedCall> lanes[NumLanes];
+        // Calls of higher lanes run while the lane had calls waiting, only accessed by the consumer
+        size_t passed_over[NumLanes];
+        std::function<void(void)> notifier; // callback on push to queue
+        std::mutex mtx;
+        // Object of the call that is running, calls run outside of mtx so that pushes do not wait for them
+        std::atomic<void*> running;
+    };
+}
+
 struct impl
 {
 #ifdef _DEBUG
     std::set<void*> _deleted_objects;
 
 #endif
-    std::map<size_t,  // Thread id
-        std::tuple<
-            ConcurrentQueue<std::pair<std::function<void(void)>, void*>>,  // queue of function + obj*
-            std::function<void(void)>, std::mutex> // callback on push to queue
-    > thread_queues;
+    std::map<size_t, ThreadQueue> thread_queues; // by thread id
 
     std::mutex mtx;
 
@@ -24,85 +80,106 @@ struct impl
         static impl g_inst;
         return &g_inst;        
     }
+    ThreadQueue* get_queue(size_t id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return &thread_queues[id];
+    }
     void register_notifier(const std::function<void(void)>& f, size_t id)
     {
         std::lock_guard<std::mutex> lock(mtx);
-        std::get<1>(thread_queues[id]) = f;
+        thread_queues[id].notifier = f;
     }
-    void push(const std::function<void(void)>& f, size_t id, void* obj)
+    void push(const std::function<void(void)>& f, size_t id, void* obj, QueuePriority priority)
     {
         if(GetThisThread() == id)
         {
             f();
             return;
         }
-        std::tuple<ConcurrentQueue<std::pair<std::function<void(void)>, void*>>, std::function<void(void)>, std::mutex>* queue = nullptr;
-        {
-            std::lock_guard<std::mutex> lock(mtx);
-            queue = &thread_queues[id];
-        }
-        std::lock_guard<std::mutex> lock(std::get<2>(*queue));
-        if(std::get<0>(*queue).size() > 100)
-            LOG(warning) << "Event loop processing queue overflow " << std::get<0>(*queue).size() << " for thread " << id;
-        std::get<0>(*queue).push(std::pair<std::function<void(void)>, void*>(f, obj));
-        if (std::get<1>(*queue))
-            std::get<1>(*queue)();
+        ThreadQueue* queue = get_queue(id);
+        std::lock_guard<std::mutex> lock(queue->mtx);
+        const size_t size = queue->size();
+        if(size > 100)
+            LOG(warning) << "Event loop processing queue overflow " << size << " for thread " << id;
+        queue->lanes[priority].push(QueuedCall(f, obj));
+        if (queue->notifier)
+            queue->notifier();
     }
     void run(size_t id)
     {
-        std::tuple<ConcurrentQueue<std::pair<std::function<void(void)>, void*>>, std::function<void(void)>, std::mutex>* queue = nullptr;
+        ThreadQueue* queue = get_queue(id);
+        while (run_once(queue))
         {
-            std::lock_guard<std::mutex> lock(mtx);
-            queue = &thread_queues[id];
-        }
-        std::lock_guard<std::mutex> lock(std::get<2>(*queue));
-        std::pair<std::function<void(void)>, void*> f;
-        while (std::get<0>(*queue).try_pop(f))
-        {
-            f.first();
         }
     }
-    void run_once(size_t id)
+    bool run_once(ThreadQueue* queue)
     {
-        std::tuple<ConcurrentQueue<std::pair<std::function<void(void)>, void*>>, std::function<void(void)>, std::mutex>* queue = nullptr;
+        QueuedCall f;
         {
-            std::lock_guard<std::mutex> lock(mtx);
-            queue = &thread_queues[id];
+            std::lock_guard<std::mutex> lock(queue->mtx);
+            if(!queue->try_pop(f))
+                return false;
+            queue->running = f.second;
         }
-        std::pair<std::function<void(void)>, void*> f;
-        std::lock_guard<std::mutex> lock(std::get<2>(*queue));
-        if(std::get<0>(*queue).try_pop(f))
+        try
         {
             f.first();
+        }catch(...)
+        {
+            queue->running = nullptr;
+            throw;
         }
+        queue->running = nullptr;
+        return true;
     }
     void remove_from_queue(void* obj)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        for (auto& queue: thread_queues)
+        const size_t this_thread = GetThisThread();
+        std::vector<ThreadQueue*> other_queues;
         {
-            std::lock_guard<std::mutex> lock(std::get<2>(queue.second));
-            for (auto itr = std::get<0>(queue.second).begin(); itr != std::get<0>(queue.second).end(); )
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto& queue: thread_queues)
             {
-                if(itr->second == obj)
-                {
-                    LOG(trace) << "Removing item from queue for object: " << obj;
-                    itr = std::get<0>(queue.second).erase(itr);
-                }
-                else
+                std::lock_guard<std::mutex> lock(queue.second.mtx);
+                for (ConcurrentQueue<QueuedCall>& lane : queue.second.lanes)
                 {
-                    ++itr;
+                    for (auto itr = lane.begin(); itr != lane.end(); )
+                    {
+                        if(itr->second == obj)
+                        {
+                            LOG(trace) << "Removing item from queue for object: " << obj;
+                            itr = lane.erase(itr);
+                        }
+                        else
+                        {
+                            ++itr;
+                        }
+                    }
                 }
+                if (queue.first != this_thread)
+                    other_queues.push_back(&queue.second);
+            }
+        }
+        // The object may be destroyed once this returns, so wait for a call of it that
+        // already left a queue.  Queues are never erased, and a running call may push
+        // onto other queues, so this waits without holding the locks.
+        if (obj)
+        {
+            for (ThreadQueue* queue : other_queues)
+            {
+                while (queue->running == obj)
+                    std::this_thread::yield();
             }
         }
     }
 	size_t size(size_t id)
 	{
 		std::lock_guard<std::mutex> lock(mtx);
-		return std::get<0>(thread_queues[id]).size();
+		return thread_queues[id].size();
 	}
 };
-void ThreadSpecificQueue::Push(const std::function<void(void)>& f, size_t id, void* obj)
+void ThreadSpecificQueue::Push(const std::function<void(void)>& f, size_t id, void* obj, QueuePriority priority)
 {
     
 #ifdef _DEBUG
@@ -112,7 +189,7 @@ void ThreadSpecificQueue::Push(const std::function<void(void)>& f, size_t id, vo
         //return;
     }
 #endif
-    impl::inst()->push(f, id, obj);
+    impl::inst()->push(f, id, obj, priority);
 }
 void ThreadSpecificQueue::Run(size_t id)
 {
@@ -122,9 +199,9 @@ void ThreadSpecificQueue::RegisterNotifier(const std::function<void(void)>& f, s
 {
     impl::inst()->register_notifier(f, id);
 }
-void ThreadSpecificQueue::RunOnce(size_t id)
+bool ThreadSpecificQueue::RunOnce(size_t id)
 {
-    impl::inst()->run_once(id);
+    return impl::inst()->run_once(impl::inst()->get_queue(id));
 }
 void ThreadSpecificQueue::RemoveFromQueue(void* obj)
 {
@@ -0,0 +1,21 @@
+#include "MetaObject/Parameters/Buffers/IBuffer.hpp"
+#include "MetaObject/Detail/FileMappedAllocator.hpp"
+#include <opencv2/core/mat.hpp>
+
+using namespace mo;
+using namespace mo::Buffer;
+
+void mo::Buffer::StoreBufferValue(cv::Mat& dst, const cv::Mat& src, cv::MatAllocator* allocator)
+{
+    if(allocator == nullptr || src.empty() || (src.u && src.u->currAllocator == allocator))
+    {
+        dst = src;
+        return;
+    }
+    // Entries are assigned over, release first so the copy does not reuse the old data
+    dst.release();
+    dst.allocator = allocator;
+    src.copyTo(dst);
+    // The frame was just written and is usually read much later
+    FileMappedAllocator::PageOut(dst);
+}
@@ -9,6 +9,9 @@ DefaultProxy::DefaultProxy(IParameter* param)
 {
     delete_slot = std::bind(&DefaultProxy::onParamDelete, this, std::placeholders::_1);
     update_slot = std::bind(&DefaultProxy::onParamUpdate, this, std::placeholders::_1, std::placeholders::_2);
+    // The widget only needs to show the latest value of a parameter updated from another thread
+    update_slot.SetDeliveryPolicy(Latest_e);
+    update_slot.SetQueuePriority(LowPriority_e);
     parameter = param;
     param->RegisterUpdateNotifier(&update_slot);
     param->RegisterDeleteNotifier(&delete_slot);
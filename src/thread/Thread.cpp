@@ -1,17 +1,38 @@
 #include "MetaObject/Thread/Thread.hpp"
 #include "MetaObject/Signals/TypedSignalRelay.hpp"
 #include "MetaObject/Context.hpp"
+#include "MetaObject/Detail/Arena.hpp"
 #include "MetaObject/Signals/TypedSlot.hpp"
 #include "MetaObject/Thread/BoostThread.h"
 #include "MetaObject/Thread/ThreadRegistry.hpp"
+#include "MetaObject/Thread/InterThread.hpp"
+#include "MetaObject/Detail/Numa.hpp"
 using namespace mo;
 
+namespace
+{
+    // Queued calls a thread runs per loop iteration, so that a flood of signals can not
+    // starve its inner loop.  They run without holding the thread's lock, so events and
+    // work can be pushed while the thread drains its queue.
+    const size_t MaxQueuedCallsPerIteration = 64;
+
+    void RunQueuedCalls()
+    {
+        for(size_t i = 0; i < MaxQueuedCallsPerIteration && ThreadSpecificQueue::RunOnce(); ++i)
+        {
+        }
+    }
+}
 
+// Events are control actions, they overtake the signals and data queued for this thread
 void Thread::PushEventQueue(const std::function<void(void)>& f)
 {
-    boost::mutex::scoped_lock lock(_mtx);
-    _event_queue.push(f);
-    _cv.notify_all();
+    ThreadSpecificQueue::Push(f, GetId(), this, HighPriority_e);
+    if(!IsOnThread())
+    {
+        boost::mutex::scoped_lock lock(_mtx);
+        _cv.notify_all();
+    }
 }
 // Work can be stolen and can exist on any thread
 void Thread::PushWork(const std::function<void(void)>& f)
@@ -49,11 +70,30 @@ Context* Thread::GetContext() const
 {
     return _ctx;
 }
+void Thread::SetNumaNode(int node)
+{
+    _numa_node = node;
+    if(IsOnThread())
+    {
+        SetThreadNumaNode(node);
+    }else
+    {
+        PushEventQueue([node]()
+        {
+            SetThreadNumaNode(node);
+        });
+    }
+}
+int Thread::GetNumaNode() const
+{
+    return _numa_node;
+}
 
 Thread::Thread()
 {
     _pool = nullptr;
     _ctx = nullptr;
+    _numa_node = -1;
     _inner_loop.reset(new mo::TypedSignalRelay<int(void)>());
     Stop();
     _thread = boost::thread(&Thread::Main, this);
@@ -63,6 +103,7 @@ Thread::Thread(ThreadPool* pool)
     _inner_loop.reset(new mo::TypedSignalRelay<int(void)>());
     _pool = pool;
     _ctx = nullptr;
+    _numa_node = -1;
     Stop();
     _thread = boost::thread(&Thread::Main, this);
 }
@@ -72,6 +113,7 @@ Thread::~Thread()
     _run = false;
     _thread.interrupt();
     _thread.join();
+    ThreadSpecificQueue::RemoveFromQueue(this);
 }
 
 void Thread::Main()
@@ -91,13 +133,8 @@ void Thread::Main()
                 _work_queue.back()();
                 _work_queue.pop();
             }
-            while(_event_queue.size())
-            {
-                _event_queue.back()();
-                _event_queue.pop();
-            }
-            mo::ThreadSpecificQueue::RunOnce();
         }
+        RunQueuedCalls();
         if(_run)
         {
             try
@@ -105,6 +142,7 @@ void Thread::Main()
                 if (_inner_loop->HasSlots())
                 {
                     int delay = (*_inner_loop)();
+                    ctx.arena->Reset();
                     if (delay)
                     {
                         boost::this_thread::sleep_for(boost::chrono::milliseconds(delay));
@@ -112,27 +150,25 @@ void Thread::Main()
                 }
             }catch(...)
             {
+                ctx.arena->Reset();
                 boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
             }
         }else
         {
             while(!_run)
             {
-                boost::mutex::scoped_lock lock(_mtx);
-                _cv.wait_for(lock, boost::chrono::milliseconds(10));
                 {
+                    boost::mutex::scoped_lock lock(_mtx);
+                    // Calls left over from the last iteration run without waiting
+                    if(ThreadSpecificQueue::Size() == 0)
+                        _cv.wait_for(lock, boost::chrono::milliseconds(10));
                     while (_work_queue.size())
                     {
                         _work_queue.back()();
                         _work_queue.pop();
                     }
-                    while(_event_queue.size())
-                    {
-                        _event_queue.back()();
-                        _event_queue.pop();
-                    }
-                    mo::ThreadSpecificQueue::RunOnce();
                 }
+                RunQueuedCalls();
             }
         }
     }
@@ -148,6 +148,21 @@ bool ThreadHandle::GetIsRunning() const
         return false;
     return _thread->_run && !_thread->_paused;
 }
+void ThreadHandle::SetNumaNode(int node)
+{
+    if(_thread)
+    {
+        _thread->SetNumaNode(node);
+    }
+}
+int ThreadHandle::GetNumaNode() const
+{
+    if(_thread)
+    {
+        return _thread->GetNumaNode();
+    }
+    return -1;
+}
 void ThreadHandle::SetThreadName(const std::string& name)
 {
     if(_thread)
@@ -12,17 +12,23 @@ ThreadPool* ThreadPool::Instance()
     return g_inst;
 }
 
-ThreadHandle ThreadPool::RequestThread()
+ThreadHandle ThreadPool::RequestThread(int numa_node)
 {
     for(auto& thread : _threads)
     {
         if(thread.available)
         {
             thread.ref_count = 0;
+            thread.available = false;
+            // Pooled threads keep the pin of their previous user otherwise
+            if(thread.thread->GetNumaNode() != numa_node)
+                thread.thread->SetNumaNode(numa_node);
             return ThreadHandle(thread.thread, &thread.ref_count);
         }
     }
     _threads.emplace_back(false, new Thread(this));
+    if(numa_node >= 0)
+        _threads.back().thread->SetNumaNode(numa_node);
     return ThreadHandle(_threads.back().thread, &_threads.back().ref_count);
 }
 
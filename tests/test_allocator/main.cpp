@@ -1,7 +1,18 @@
 #define BOOST_TEST_MAIN
 #include "MetaObject/Detail/Allocator.hpp"
 #include "MetaObject/Detail/AllocatorImpl.hpp"
+#include "MetaObject/Detail/AllocationProfile.hpp"
+#include "MetaObject/Detail/AllocationTrace.hpp"
+#include "MetaObject/Detail/Arena.hpp"
+#include "MetaObject/Detail/FileMappedAllocator.hpp"
+#include "MetaObject/Detail/MemoryBudget.hpp"
+#include "MetaObject/Detail/MemoryResource.hpp"
+#include "MetaObject/Detail/MemoryTrimmer.hpp"
+#include "MetaObject/Detail/Numa.hpp"
+#include "MetaObject/Detail/ScopeSampler.hpp"
 #include "MetaObject/Logging/Profiling.hpp"
+#include "MetaObject/Parameters/Buffers/IBuffer.hpp"
+#include "MetaObject/Context.hpp"
 
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
@@ -11,6 +22,7 @@
 #include <boost/log/common.hpp>
 #include <boost/log/exceptions.hpp>
 #include <opencv2/cudaarithm.hpp>
+#include <boost/thread.hpp>
 
 #ifdef _MSC_VER
 #include <boost/test/unit_test.hpp>
@@ -19,6 +31,9 @@
 #include <boost/test/included/unit_test.hpp>
 #endif
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 
 using namespace mo;
@@ -101,6 +116,106 @@ BOOST_AUTO_TEST_CASE(test_cpu_pooled_allocation)
         << " Thead Safe Pooled Time: " << mt_pooled_time;
 }
 
+BOOST_AUTO_TEST_CASE(test_cpu_pool_thread_cache)
+{
+    mo::CpuMemoryPool* pool = mo::CpuMemoryPool::GlobalInstance();
+    auto before = pool->GetStatistics();
+    auto start = boost::posix_time::microsec_clock::local_time();
+    boost::thread_group threads;
+    for(int i = 0; i < 8; ++i)
+    {
+        threads.create_thread([pool]()
+        {
+            for(int j = 0; j < 10000; ++j)
+            {
+                size_t size = 16 * (1 + rand() % 1000);
+                uchar* ptr = pool->allocate(size);
+                ptr[0] = 0;
+                pool->deallocate(ptr, size);
+            }
+        });
+    }
+    threads.join_all();
+    auto end = boost::posix_time::microsec_clock::local_time();
+    auto after = pool->GetStatistics();
+    BOOST_REQUIRE_GT(after.cache_hits, before.cache_hits);
+    std::cout << "\n ======================================================================== \n";
+    std::cout << " Thread Cached Global Pool\n";
+    std::cout
+        << " 8 Thread Time:     " << boost::posix_time::time_duration(end - start).total_milliseconds() << "\n"
+        << " Cache Hits:        " << after.cache_hits - before.cache_hits << "\n"
+        << " Pool Refills:      " << after.cache_refills - before.cache_refills << "\n"
+        << " Pool Flushes:      " << after.cache_flushes - before.cache_flushes << "\n";
+}
+
+BOOST_AUTO_TEST_CASE(test_cpu_pool_thread_cache_alignment)
+{
+    mo::CpuMemoryPool* pool = mo::CpuMemoryPool::GlobalInstance();
+    boost::thread thread([pool]()
+    {
+        // Blocks of a three channel float matrix are only aligned to 12 bytes, reusing
+        // one from the thread cache must not break a later request for 64 byte alignment
+        for(int i = 0; i < 64; ++i)
+        {
+            void* rgb[4];
+            for(int j = 0; j < 4; ++j)
+            {
+                BOOST_REQUIRE(pool->allocate(&rgb[j], 120, 12));
+                BOOST_REQUIRE_EQUAL(reinterpret_cast<size_t>(rgb[j]) % 12, 0);
+            }
+            for(int j = 0; j < 4; ++j)
+                pool->deallocate(rgb[j], 120);
+            void* aligned[4];
+            for(int j = 0; j < 4; ++j)
+            {
+                BOOST_REQUIRE(pool->allocate(&aligned[j], 128, 64));
+                BOOST_REQUIRE_EQUAL(reinterpret_cast<size_t>(aligned[j]) % 64, 0);
+            }
+            for(int j = 0; j < 4; ++j)
+                pool->deallocate(aligned[j], 128);
+        }
+    });
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(test_cpu_pool_thread_cache_reuse)
+{
+    mo::CpuMemoryPool* pool = mo::CpuMemoryPool::GlobalInstance();
+    boost::thread thread([pool]()
+    {
+        // Three channel blocks bypass the thread cache, once freed they are cached and
+        // reused for whole size class requests that must not run into their neighbours
+        const size_t size = 100;
+        const size_t class_size = 128;
+        for(int i = 0; i < 16; ++i)
+        {
+            uchar* rgb[8];
+            for(int j = 0; j < 8; ++j)
+            {
+                BOOST_REQUIRE(pool->allocate(reinterpret_cast<void**>(&rgb[j]), size, 3));
+                memset(rgb[j], j, size);
+            }
+            for(int j = 0; j < 8; j += 2)
+                pool->deallocate(rgb[j], size);
+            uchar* reused[4];
+            for(int j = 0; j < 4; ++j)
+            {
+                reused[j] = pool->allocate(class_size);
+                BOOST_REQUIRE(reused[j]);
+                memset(reused[j], 0xff, class_size);
+            }
+            for(int j = 1; j < 8; j += 2)
+            {
+                BOOST_REQUIRE(std::all_of(rgb[j], rgb[j] + size, [j](uchar value) { return value == j; }));
+                pool->deallocate(rgb[j], size);
+            }
+            for(int j = 0; j < 4; ++j)
+                pool->deallocate(reused[j], class_size);
+        }
+    });
+    thread.join();
+}
+
 BOOST_AUTO_TEST_CASE(test_cpu_stack_allocation)
 {
     auto start = boost::posix_time::microsec_clock::local_time();
@@ -172,6 +287,549 @@ BOOST_AUTO_TEST_CASE(test_cpu_stack_allocation)
         << " Thead Safe Pooled Time:   " << mt_pooled_time << "\n"
         << " Zero Allocation Time:     " << zero_alloc_time;
 }
+BOOST_AUTO_TEST_CASE(test_cpu_stack_size_classes)
+{
+    mo::CpuMemoryStack* stack = mo::CpuMemoryStack::ThreadInstance();
+    auto before = stack->GetStatistics();
+    mo::CpuStackPolicy allocator;
+    cv::Mat::setDefaultAllocator(&allocator);
+    for (int i = 0; i < 1000; ++i)
+    {
+        // Sizes drift by a few columns, exact size matching would never reuse these
+        cv::Mat vec(1000, 1000 + rand() % 8, CV_32F);
+        vec *= 100;
+    }
+    cv::Mat::setDefaultAllocator(nullptr);
+    auto after = stack->GetStatistics();
+    size_t reused = after.reused - before.reused;
+    size_t allocated = after.allocated - before.allocated;
+    BOOST_REQUIRE_GT(reused, 9 * allocated);
+    std::cout << "\n ======================================================================== \n";
+    std::cout << " Variable Size Stack Allocation\n";
+    std::cout
+        << " Reused:    " << reused << "\n"
+        << " Allocated: " << allocated << "\n";
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_trimmer)
+{
+    mo::MemoryTrimmer* trimmer = mo::MemoryTrimmer::Instance();
+    mo::CpuMemoryStack* stack = mo::CpuMemoryStack::ThreadInstance();
+    trimmer->SetMaxAge(std::chrono::milliseconds(100));
+    trimmer->SetPeriod(std::chrono::milliseconds(10));
+    auto before = stack->GetStatistics();
+    std::vector<uchar*> blocks;
+    for(int i = 0; i < 16; ++i)
+        blocks.push_back(stack->allocate(1024 * 1024));
+    for(uchar* block : blocks)
+        stack->deallocate(block, 1024 * 1024);
+    BOOST_REQUIRE_GE(stack->GetStatistics().cached_bytes, 16 * 1024 * 1024);
+    // Blocks are released by the trimmer thread once they are older than the maximum age
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(500));
+    auto after = stack->GetStatistics();
+    BOOST_REQUIRE_EQUAL(after.cached_bytes, 0);
+    BOOST_REQUIRE_GE(after.released - before.released, 16);
+
+    // Above the high watermark cached memory is released down to the low watermark regardless of age
+    trimmer->SetMaxAge(std::chrono::milliseconds(60 * 1000));
+    trimmer->SetWatermarks(4 * 1024 * 1024, 8 * 1024 * 1024);
+    blocks.clear();
+    for(int i = 0; i < 16; ++i)
+        blocks.push_back(stack->allocate(1024 * 1024));
+    for(uchar* block : blocks)
+        stack->deallocate(block, 1024 * 1024);
+    trimmer->Trim();
+    BOOST_REQUIRE_LE(trimmer->GetCachedBytes(), 4 * 1024 * 1024);
+    trimmer->SetWatermarks(std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max());
+    trimmer->SetMaxAge(std::chrono::milliseconds(1000));
+    trimmer->SetPeriod(std::chrono::milliseconds(100));
+}
+
+BOOST_AUTO_TEST_CASE(test_allocator_statistics)
+{
+    mo::Allocator* allocator = mo::Allocator::GetThreadSpecificAllocator();
+    allocator->SetName("test_allocator_statistics");
+    auto before = allocator->GetStatistics();
+    {
+        cv::Mat::setDefaultAllocator(allocator);
+        std::vector<cv::Mat> mats;
+        for(int i = 0; i < 10; ++i)
+            mats.emplace_back(100, 100, CV_32F);
+        auto during = allocator->GetStatistics();
+        BOOST_REQUIRE_EQUAL(during.allocations - before.allocations, 10);
+        BOOST_REQUIRE_GE(during.bytes_in_use - before.bytes_in_use, 10 * 100 * 100 * sizeof(float));
+        BOOST_REQUIRE_GE(during.peak_bytes, during.bytes_in_use);
+        cv::Mat::setDefaultAllocator(nullptr);
+    }
+    auto after = allocator->GetStatistics();
+    BOOST_REQUIRE_EQUAL(after.deallocations - before.deallocations, 10);
+    BOOST_REQUIRE_EQUAL(after.bytes_in_use, before.bytes_in_use);
+    BOOST_REQUIRE_EQUAL(after.pool_hits + after.pool_misses - before.pool_hits - before.pool_misses, 10);
+
+    bool found = false;
+    for(const auto& stats : mo::Allocator::GetLiveAllocatorStatistics())
+    {
+        if(stats.name == "test_allocator_statistics")
+        {
+            found = true;
+            BOOST_REQUIRE_EQUAL(stats.allocations, after.allocations);
+        }
+    }
+    BOOST_REQUIRE(found);
+}
+
+BOOST_AUTO_TEST_CASE(test_numa_node_pools)
+{
+    const int nodes = mo::GetNumaNodeCount();
+    BOOST_REQUIRE_GE(nodes, 1);
+    for(int node = 0; node < nodes; ++node)
+    {
+        uchar* ptr = nullptr;
+        mo::CpuMemoryPool* pool = nullptr;
+        bool pinned = false;
+        boost::thread thread([&]()
+        {
+            pinned = mo::SetThreadNumaNode(node) && mo::GetThreadNumaNode() == node;
+            pool = mo::CpuMemoryPool::NodeInstance(node);
+            ptr = pool->allocate(1024 * 1024);
+        });
+        thread.join();
+        BOOST_REQUIRE(pinned);
+        BOOST_REQUIRE(ptr);
+        if(nodes > 1)
+        {
+            // Freed from an unpinned thread, the block still has to find its home pool
+            BOOST_REQUIRE_EQUAL(mo::CpuMemoryPool::FindNodeInstance(ptr), pool);
+        }
+        BOOST_REQUIRE(pool->deallocate(ptr, 1024 * 1024));
+    }
+    BOOST_REQUIRE_EQUAL(mo::GetThreadNumaNode(), -1);
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_allocation)
+{
+    mo::Arena arena(64 * 1024);
+    for(int iteration = 0; iteration < 10; ++iteration)
+    {
+        {
+            mo::ArenaStlAllocator<int> stl_allocator(&arena);
+            std::vector<int, mo::ArenaStlAllocator<int>> vec(stl_allocator);
+            for(int i = 0; i < 10000; ++i)
+                vec.push_back(i);
+            cv::Mat mat;
+            mat.allocator = &arena;
+            mat.create(256, 256, CV_32F);
+            BOOST_REQUIRE_EQUAL(reinterpret_cast<size_t>(mat.data) % 16, 0);
+            BOOST_REQUIRE_EQUAL(arena.GetLiveMatCount(), 1);
+        }
+        BOOST_REQUIRE_EQUAL(arena.GetLiveMatCount(), 0);
+        arena.Reset();
+        // The iteration spilled into several chunks, they are folded into one that fits it
+        BOOST_REQUIRE_GE(arena.GetCapacity(), arena.GetPeakBytes());
+        BOOST_REQUIRE_LT(arena.GetCapacity(), arena.GetPeakBytes() + 64 * 1024);
+    }
+    BOOST_REQUIRE_EQUAL(arena.GetUsedBytes(), 0);
+    BOOST_REQUIRE_EQUAL(arena.GetResetCount(), 10);
+    BOOST_REQUIRE_GE(arena.GetPeakBytes(), 256 * 256 * sizeof(float) + 10000 * sizeof(int));
+}
+
+BOOST_AUTO_TEST_CASE(test_allocation_trace)
+{
+    const std::string path = "test_allocation_trace.moat";
+    mo::Allocator* allocator = mo::Allocator::GetThreadSpecificAllocator();
+    BOOST_REQUIRE(mo::AllocationTrace::Start(path));
+    BOOST_REQUIRE(mo::AllocationTrace::IsRecording());
+    std::vector<uchar*> ptrs;
+    for(int i = 0; i < 100; ++i)
+        ptrs.push_back(allocator->allocateCpu(1024 * (i + 1)));
+    for(int i = 0; i < 100; ++i)
+        allocator->deallocateCpu(ptrs[i], 1024 * (i + 1));
+    mo::AllocationTrace::Stop();
+    BOOST_REQUIRE(!mo::AllocationTrace::IsRecording());
+
+    std::vector<mo::AllocationTraceEvent> events;
+    std::vector<std::string> names;
+    BOOST_REQUIRE(mo::AllocationTrace::Read(path, events, &names));
+    BOOST_REQUIRE_EQUAL(events.size(), 200);
+    BOOST_REQUIRE_EQUAL(names.size(), 1);
+    BOOST_REQUIRE_EQUAL(names[0], allocator->GetName());
+    for(int i = 0; i < 100; ++i)
+    {
+        BOOST_REQUIRE_EQUAL(events[i].op, mo::AllocationTraceEvent::Allocate_e);
+        BOOST_REQUIRE_EQUAL(events[i].device, mo::AllocationTraceEvent::Cpu_e);
+        BOOST_REQUIRE_EQUAL(events[i].size, 1024 * (i + 1));
+        BOOST_REQUIRE_EQUAL(events[i].ptr, reinterpret_cast<uint64_t>(ptrs[i]));
+        BOOST_REQUIRE_EQUAL(events[100 + i].op, mo::AllocationTraceEvent::Free_e);
+        BOOST_REQUIRE_EQUAL(events[100 + i].ptr, reinterpret_cast<uint64_t>(ptrs[i]));
+    }
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_allocation_profile)
+{
+    const std::string path = "test_allocation_profile.txt";
+    const size_t large = 4 * 1024 * 1024;
+    mo::AllocationProfile recorded;
+    mo::AllocationProfiler::Start();
+    boost::thread recorder([&]()
+    {
+        mo::Allocator* allocator = mo::Allocator::GetThreadSpecificAllocator();
+        allocator->SetName("test_allocation_profile");
+        std::vector<uchar*> ptrs;
+        for(int i = 0; i < 3; ++i)
+            ptrs.push_back(allocator->allocateCpu(large));
+        for(uchar* ptr : ptrs)
+            allocator->deallocateCpu(ptr, large);
+        uchar* small = allocator->allocateCpu(1024);
+        recorded = allocator->GetAllocationProfile();
+        allocator->deallocateCpu(small, 1024);
+    });
+    recorder.join();
+    BOOST_REQUIRE_EQUAL(recorded.cpu.peak_counts[large], 3);
+    BOOST_REQUIRE_EQUAL(recorded.cpu.peak_counts[1024], 1);
+    BOOST_REQUIRE_EQUAL(recorded.cpu.peak_bytes, 3 * large);
+
+    // The allocator was destroyed with its thread, so this saves its retired profile
+    BOOST_REQUIRE(mo::AllocationProfiler::Save(path));
+    mo::AllocationProfiler::Stop();
+    BOOST_REQUIRE(mo::AllocationProfiler::Load(path, std::chrono::milliseconds(0)));
+    mo::AllocationProfile loaded;
+    BOOST_REQUIRE(mo::AllocationProfiler::GetProfile("test_allocation_profile", loaded));
+    BOOST_REQUIRE_EQUAL(loaded.cpu.peak_counts[large], 3);
+    BOOST_REQUIRE_EQUAL(loaded.cpu.peak_bytes, 3 * large);
+
+    size_t reserved = 0;
+    size_t misses = 0;
+    boost::thread restarted([&]()
+    {
+        mo::Allocator* allocator = mo::Allocator::GetThreadSpecificAllocator();
+        // Naming the allocator reserves the memory of the loaded profile
+        allocator->SetName("test_allocation_profile");
+        reserved = mo::CpuMemoryStack::ThreadInstance()->GetStatistics().reserved;
+        const size_t before = allocator->GetStatistics().pool_misses;
+        std::vector<uchar*> ptrs;
+        for(int i = 0; i < 3; ++i)
+            ptrs.push_back(allocator->allocateCpu(large));
+        misses = allocator->GetStatistics().pool_misses - before;
+        for(uchar* ptr : ptrs)
+            allocator->deallocateCpu(ptr, large);
+    });
+    restarted.join();
+    BOOST_REQUIRE_EQUAL(reserved, 3);
+    BOOST_REQUIRE_EQUAL(misses, 0);
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_mat_header_pool)
+{
+    mo::Allocator* allocator = mo::Allocator::GetThreadSpecificAllocator();
+    const mo::MatHeaderPoolStatistics before = mo::MatHeaderPool::GetStatistics();
+    for(int i = 0; i < 1000; ++i)
+    {
+        cv::Mat mat;
+        mat.allocator = allocator;
+        mat.create(16, 16, CV_32F);
+    }
+    const mo::MatHeaderPoolStatistics after = mo::MatHeaderPool::GetStatistics();
+    BOOST_REQUIRE_EQUAL(after.allocations - before.allocations, 1000);
+    BOOST_REQUIRE_EQUAL(after.deallocations - before.deallocations, 1000);
+    // Every header after the first comes from this thread's cache
+    BOOST_REQUIRE_LE(after.heap_allocations - before.heap_allocations, 1);
+}
+
+namespace
+{
+    size_t ScopeLiveBytes(const std::string& scope)
+    {
+        for(const mo::ScopeAllocationStatistics& stats : mo::ScopeSampler::GetScopeTotals())
+            if(stats.scope == scope)
+                return stats.live_bytes;
+        return 0;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_scope_sampler)
+{
+    mo::Allocator* allocator = mo::Allocator::GetThreadSpecificAllocator();
+    const std::string previous = mo::GetScopeName();
+    // With a one byte interval every allocation is sampled with its own size as weight
+    mo::ScopeSampler::SetSampleInterval(1);
+    mo::SetScopeName("test_scope_sampler");
+    {
+        cv::Mat mat;
+        mat.allocator = allocator;
+        mat.create(64, 64, CV_32F);
+        uchar* ptr = allocator->allocateCpu(4096);
+        BOOST_REQUIRE_EQUAL(ScopeLiveBytes("test_scope_sampler"), 64 * 64 * 4 + 4096);
+        allocator->deallocateCpu(ptr, 4096);
+        BOOST_REQUIRE_EQUAL(ScopeLiveBytes("test_scope_sampler"), 64 * 64 * 4);
+    }
+    BOOST_REQUIRE_EQUAL(ScopeLiveBytes("test_scope_sampler"), 0);
+    mo::ScopeSampler::SetSampleInterval(0);
+    {
+        // Allocations made while sampling is off are not attributed
+        cv::Mat mat;
+        mat.allocator = allocator;
+        mat.create(64, 64, CV_32F);
+        BOOST_REQUIRE_EQUAL(ScopeLiveBytes("test_scope_sampler"), 0);
+    }
+    mo::SetScopeName(previous);
+}
+
+BOOST_AUTO_TEST_CASE(test_cpu_pool_remote_free)
+{
+    mo::CpuPoolPolicy policy;
+    std::vector<uchar*> ptrs;
+    mo::CpuMemoryPool* pool = nullptr;
+    mo::CpuMemoryPoolStatistics stats;
+    boost::barrier allocated(2);
+    boost::barrier freed(2);
+    boost::thread producer([&]()
+    {
+        pool = mo::CpuMemoryPool::ThreadInstance();
+        for(int i = 0; i < 100; ++i)
+            ptrs.push_back(policy.allocate(1024));
+        allocated.wait();
+        freed.wait();
+        // The next allocation returns the queued frees to the pool
+        uchar* ptr = policy.allocate(1024);
+        stats = pool->GetStatistics();
+        policy.deallocate(ptr, 1024);
+    });
+    allocated.wait();
+    for(uchar* ptr : ptrs)
+    {
+        BOOST_REQUIRE_EQUAL(mo::CpuMemoryPool::FindInstance(ptr), pool);
+        policy.deallocate(ptr, 1024);
+    }
+    freed.wait();
+    producer.join();
+    BOOST_REQUIRE_EQUAL(stats.remote_deallocations, 100);
+    BOOST_REQUIRE_EQUAL(stats.remote_drains, 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_cpu_stack_remote_free)
+{
+    const size_t size = 1024 * 1024;
+    std::vector<uchar*> ptrs;
+    mo::CpuMemoryStack* stack = nullptr;
+    mo::CpuMemoryStackStatistics stats;
+    uchar* reused = nullptr;
+    boost::barrier allocated(2);
+    boost::barrier freed(2);
+    boost::thread producer([&]()
+    {
+        stack = mo::CpuMemoryStack::ThreadInstance();
+        for(int i = 0; i < 4; ++i)
+            ptrs.push_back(stack->allocate(size));
+        allocated.wait();
+        freed.wait();
+        // The blocks freed by the consumer are cached on the producer's stack
+        stats = stack->GetStatistics();
+        reused = stack->allocate(size);
+        stack->deallocate(reused, size);
+        // Left in use when the thread exits
+        ptrs.assign(1, stack->allocate(size));
+    });
+    allocated.wait();
+    const std::vector<uchar*> remote = ptrs;
+    mo::CpuMemoryStack* consumer = mo::CpuMemoryStack::ThreadInstance();
+    for(uchar* ptr : remote)
+        BOOST_REQUIRE(consumer->deallocate(ptr, size));
+    freed.wait();
+    producer.join();
+    BOOST_REQUIRE_EQUAL(stats.remote_deallocations, 4);
+    BOOST_REQUIRE(stats.cached_bytes >= 4 * size);
+    BOOST_REQUIRE(std::find(remote.begin(), remote.end(), reused) != remote.end());
+    // The block of the exited thread was handed to the global stack
+    BOOST_REQUIRE(consumer->deallocate(ptrs[0], size));
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_resource)
+{
+    mo::Context* ctx = mo::Context::GetDefaultThreadContext();
+    boost::container::pmr::memory_resource* original = ctx->memory_resource;
+    {
+        // Defaults to the thread's pool
+        mo::pmr::vector<float> vec;
+        for(int i = 0; i < 10000; ++i)
+            vec.push_back(static_cast<float>(i));
+        BOOST_REQUIRE(vec.get_allocator().resource() == mo::PoolMemoryResource::ThreadInstance());
+        BOOST_REQUIRE(mo::CpuMemoryPool::FindInstance(vec.data()) != nullptr);
+    }
+    {
+        mo::Arena arena(64 * 1024);
+        mo::ArenaMemoryResource resource(&arena);
+        ctx->memory_resource = &resource;
+        {
+            mo::pmr::vector<float> vec(1000, 1.0f);
+            BOOST_REQUIRE_GE(arena.GetUsedBytes(), 1000 * sizeof(float));
+            // Copies pick up the resource of the current context, not the source container
+            mo::pmr::vector<float> copy(vec);
+            BOOST_REQUIRE(copy.get_allocator().resource() == &resource);
+            mo::pmr::string str("a string that is too long for the small string optimization");
+            BOOST_REQUIRE(str.get_allocator().resource() == &resource);
+        }
+        arena.Reset();
+        BOOST_REQUIRE_EQUAL(arena.GetUsedBytes(), 0);
+    }
+    {
+        ctx->memory_resource = mo::StackMemoryResource::ThreadInstance();
+        for(int i = 0; i < 10; ++i)
+        {
+            mo::pmr::vector<float> vec(1024 * 1024);
+            vec[0] = 1.0f;
+        }
+    }
+    ctx->memory_resource = original;
+    mo::pmr::vector<float> vec(10);
+    BOOST_REQUIRE(vec.get_allocator().resource() == original);
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_budget)
+{
+    mo::Context* ctx = mo::Context::GetDefaultThreadContext();
+    mo::Allocator* allocator = ctx->allocator;
+    const size_t small = 300 * 1024;
+    const size_t large = 3 * 1024 * 1024;
+    {
+        auto budget = std::make_shared<mo::MemoryBudget>(4 * 1024 * 1024);
+        ctx->SetMemoryBudget(budget);
+        uchar* ptr = allocator->allocateCpu(large);
+        BOOST_REQUIRE_EQUAL(budget->GetUsage(), large);
+        BOOST_REQUIRE_THROW(allocator->allocateCpu(large), mo::ExceptionWithCallStack<std::string>);
+        BOOST_REQUIRE_EQUAL(budget->GetStatistics().rejected, 1);
+        allocator->deallocateCpu(ptr, large);
+        BOOST_REQUIRE_EQUAL(budget->GetUsage(), 0);
+    }
+    {
+        // Pool memory may be freed on any thread, which unblocks the allocation
+        auto budget = std::make_shared<mo::MemoryBudget>(1024 * 1024, mo::MemoryBudget::Block_e,
+                                                         std::chrono::milliseconds(5000));
+        ctx->SetMemoryBudget(budget);
+        std::vector<uchar*> ptrs;
+        for(int i = 0; i < 3; ++i)
+            ptrs.push_back(allocator->allocateCpu(small));
+        boost::thread consumer([&]()
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+            allocator->deallocateCpu(ptrs[0], small);
+        });
+        ptrs[0] = allocator->allocateCpu(small);
+        consumer.join();
+        BOOST_REQUIRE_EQUAL(budget->GetStatistics().blocked, 1);
+        BOOST_REQUIRE_EQUAL(budget->GetUsage(), 3 * small);
+        for(uchar* ptr : ptrs)
+            allocator->deallocateCpu(ptr, small);
+    }
+    {
+        // Memory allocated before another context of the thread replaced the budget
+        // is released to the budget it was charged to
+        auto first = std::make_shared<mo::MemoryBudget>(4 * 1024 * 1024);
+        ctx->SetMemoryBudget(first);
+        uchar* ptr = allocator->allocateCpu(large);
+        auto second = std::make_shared<mo::MemoryBudget>(4 * 1024 * 1024);
+        {
+            mo::Context other;
+            BOOST_REQUIRE(other.allocator == allocator);
+            other.SetMemoryBudget(second);
+        }
+        BOOST_REQUIRE(ctx->GetCpuMemoryBudget() == second);
+        uchar* other_ptr = allocator->allocateCpu(small);
+        allocator->deallocateCpu(ptr, large);
+        BOOST_REQUIRE_EQUAL(first->GetUsage(), 0);
+        BOOST_REQUIRE_EQUAL(second->GetUsage(), small);
+        // Reinstalling the first budget does not see stale usage
+        ctx->SetMemoryBudget(first);
+        ptr = allocator->allocateCpu(large);
+        BOOST_REQUIRE_EQUAL(first->GetUsage(), large);
+        allocator->deallocateCpu(ptr, large);
+        ctx->SetMemoryBudget(nullptr);
+        BOOST_REQUIRE(!ctx->GetCpuMemoryBudget());
+        allocator->deallocateCpu(other_ptr, small);
+        BOOST_REQUIRE_EQUAL(second->GetUsage(), 0);
+        BOOST_REQUIRE_EQUAL(first->GetUsage(), 0);
+    }
+    {
+        // Leave two cached blocks on the stack, one is reused and one evicted
+        ctx->SetMemoryBudget(nullptr);
+        uchar* first = allocator->allocateCpu(large);
+        uchar* second = allocator->allocateCpu(large);
+        allocator->deallocateCpu(first, large);
+        allocator->deallocateCpu(second, large);
+        auto budget = std::make_shared<mo::MemoryBudget>(4 * 1024 * 1024, mo::MemoryBudget::Evict_e);
+        ctx->SetMemoryBudget(budget);
+        uchar* ptr = allocator->allocateCpu(large);
+        uchar* over = allocator->allocateCpu(large);
+        BOOST_REQUIRE_GE(budget->GetStatistics().evicted_bytes, large - 1024 * 1024);
+        BOOST_REQUIRE_EQUAL(budget->GetUsage(), 2 * large);
+        allocator->deallocateCpu(over, large);
+        allocator->deallocateCpu(ptr, large);
+        // Nothing left to evict
+        mo::CpuMemoryStack::ThreadInstance()->Evict(std::numeric_limits<size_t>::max());
+        mo::CpuMemoryStack::GlobalInstance()->Evict(std::numeric_limits<size_t>::max());
+        ptr = allocator->allocateCpu(large);
+        BOOST_REQUIRE_THROW(allocator->allocateCpu(large), mo::ExceptionWithCallStack<std::string>);
+        allocator->deallocateCpu(ptr, large);
+    }
+    ctx->SetMemoryBudget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_file_mapped_allocator)
+{
+    mo::FileMappedAllocator* allocator = mo::FileMappedAllocator::Instance();
+    const size_t before = allocator->GetMappedBytes();
+    {
+        cv::Mat mat;
+        mat.allocator = allocator;
+        mat.create(1024, 1024, CV_32F);
+        BOOST_REQUIRE_GE(allocator->GetMappedBytes() - before, 1024 * 1024 * sizeof(float));
+        for(int i = 0; i < mat.rows; ++i)
+            mat.at<float>(i, i) = static_cast<float>(i);
+        // Dropped pages are read back from the file
+        mo::FileMappedAllocator::PageOut(mat);
+        for(int i = 0; i < mat.rows; ++i)
+            BOOST_REQUIRE_EQUAL(mat.at<float>(i, i), static_cast<float>(i));
+
+        // Buffers deep copy into the selected allocator
+        cv::Mat entry;
+        mo::Buffer::StoreBufferValue(entry, mat, allocator);
+        BOOST_REQUIRE(entry.u->currAllocator == allocator);
+        BOOST_REQUIRE(entry.data != mat.data);
+        BOOST_REQUIRE_EQUAL(entry.at<float>(10, 10), 10.0f);
+        cv::Mat shallow;
+        mo::Buffer::StoreBufferValue(shallow, mat, nullptr);
+        BOOST_REQUIRE(shallow.data == mat.data);
+    }
+    BOOST_REQUIRE_EQUAL(allocator->GetMappedBytes(), before);
+
+    // A history of frames shares one chunk file instead of a file and a mapping per frame
+    mo::FileMappedAllocator local;
+    {
+        std::vector<cv::Mat> history(256);
+        for(size_t i = 0; i < history.size(); ++i)
+        {
+            history[i].allocator = &local;
+            history[i].create(480, 640, CV_8UC3);
+            history[i].data[0] = static_cast<uchar>(i);
+            history[i].data[history[i].total() * history[i].elemSize() - 1] = static_cast<uchar>(i);
+        }
+        BOOST_REQUIRE_EQUAL(local.GetChunkCount(), 1);
+        for(size_t i = 0; i < history.size(); ++i)
+        {
+            BOOST_REQUIRE_EQUAL(history[i].data[0], static_cast<uchar>(i));
+            BOOST_REQUIRE_EQUAL(history[i].data[history[i].total() * history[i].elemSize() - 1], static_cast<uchar>(i));
+        }
+        // Larger than a chunk gets a file of its own, which is unmapped once freed
+        cv::Mat large;
+        large.allocator = &local;
+        large.create(1, static_cast<int>(mo::FileMappedAllocator::ChunkSize + 1), CV_8U);
+        BOOST_REQUIRE_EQUAL(local.GetChunkCount(), 2);
+    }
+    BOOST_REQUIRE_EQUAL(local.GetMappedBytes(), 0);
+    BOOST_REQUIRE_EQUAL(local.GetChunkCount(), 1);
+}
+
 BOOST_AUTO_TEST_CASE(test_cpu_combined_allocation)
 {
     cv::Mat::setDefaultAllocator(mo::Allocator::GetThreadSpecificAllocator());
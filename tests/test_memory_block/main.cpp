@@ -0,0 +1,185 @@
+#define BOOST_TEST_MAIN
+#include "MetaObject/Detail/MemoryBlock.h"
+#include "MetaObject/Detail/AllocatorImpl.hpp"
+#include "MetaObject/Detail/HostMemoryBackend.hpp"
+
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#ifdef _MSC_VER
+#include <boost/test/unit_test.hpp>
+#else
+#define BOOST_TEST_MODULE "MetaObjectMemoryBlock"
+#include <boost/test/included/unit_test.hpp>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace mo;
+
+// Previous MemoryBlock allocation strategy, a linear scan over every live
+// allocation with no coalescing, kept here as a baseline for the benchmark.
+class LegacyMemoryBlock
+{
+public:
+    LegacyMemoryBlock(size_t size_):
+        buffer(size_), begin(buffer.data()), end(buffer.data() + size_), size(size_)
+    {
+    }
+    unsigned char* allocate(size_t size_, size_t elemSize_)
+    {
+        if (size_ > size)
+            return nullptr;
+        std::vector<std::pair<size_t, unsigned char*>> candidates;
+        unsigned char* prevEnd = begin;
+        for (auto itr : allocatedBlocks)
+        {
+            if (static_cast<size_t>(itr.first - prevEnd) > size_)
+            {
+                auto alignment = alignmentOffset(prevEnd, elemSize_);
+                if (static_cast<size_t>(itr.first - prevEnd + alignment) >= size_)
+                {
+                    candidates.push_back(std::make_pair(size_t(itr.first - prevEnd + alignment), prevEnd + alignment));
+                }
+            }
+            prevEnd = itr.second;
+        }
+        if (static_cast<size_t>(end - prevEnd) >= size_)
+        {
+            auto alignment = alignmentOffset(prevEnd, elemSize_);
+            candidates.push_back(std::make_pair(size_t(end - prevEnd + alignment), prevEnd + alignment));
+        }
+        auto min = std::min_element(candidates.begin(), candidates.end(),
+            [](const std::pair<size_t, unsigned char*>& first, const std::pair<size_t, unsigned char*>& second)
+        {
+            return first.first < second.first;
+        });
+        if (min != candidates.end() && min->first > size_)
+        {
+            allocatedBlocks[min->second] = min->second + size_;
+            return min->second;
+        }
+        return nullptr;
+    }
+    bool deAllocate(unsigned char* ptr)
+    {
+        allocatedBlocks.erase(ptr);
+        return true;
+    }
+private:
+    std::vector<unsigned char> buffer;
+    unsigned char* begin;
+    unsigned char* end;
+    size_t size;
+    std::map<unsigned char*, unsigned char*> allocatedBlocks;
+};
+
+BOOST_AUTO_TEST_CASE(initialize)
+{
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+}
+
+BOOST_AUTO_TEST_CASE(memory_block_coalescing)
+{
+    CpuMemoryBlock block(1024 * 1024);
+    std::vector<unsigned char*> ptrs;
+    for (int i = 0; i < 256; ++i)
+    {
+        unsigned char* ptr = block.allocate(4096, 16);
+        BOOST_REQUIRE(ptr);
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<size_t>(ptr) % 16, 0);
+        ptrs.push_back(ptr);
+    }
+    BOOST_REQUIRE(block.allocate(4096, 16) == nullptr);
+    // Free every other allocation, no 8 KB range is available
+    for (size_t i = 0; i < ptrs.size(); i += 2)
+    {
+        BOOST_REQUIRE(block.deAllocate(ptrs[i]));
+    }
+    BOOST_REQUIRE(block.allocate(8192, 1) == nullptr);
+    BOOST_REQUIRE_GT(block.Fragmentation(), 0.9);
+    // Freeing the rest must merge everything back into one range
+    for (size_t i = 1; i < ptrs.size(); i += 2)
+    {
+        BOOST_REQUIRE(block.deAllocate(ptrs[i]));
+    }
+    BOOST_REQUIRE_EQUAL(block.FreeBytes(), block.Size());
+    BOOST_REQUIRE_EQUAL(block.LargestFreeRange(), block.Size());
+    BOOST_REQUIRE_EQUAL(block.Fragmentation(), 0.0);
+    BOOST_REQUIRE(block.allocate(block.Size(), 1));
+    BOOST_REQUIRE(!block.deAllocate(block.Begin() + 1));
+}
+
+BOOST_AUTO_TEST_CASE(host_memory_backends)
+{
+    for (auto type : {HostMemoryBackend::Mapped_e, HostMemoryBackend::HugePage_e})
+    {
+        HostMemoryBackend* backend = HostMemoryBackend::Get(type);
+        BOOST_REQUIRE_EQUAL(backend->GetType(), type);
+        unsigned char* ptr = backend->allocate(3 * 1024 * 1024 + 7);
+        BOOST_REQUIRE(ptr);
+        memset(ptr, 1, 3 * 1024 * 1024 + 7);
+        backend->deallocate(ptr, 3 * 1024 * 1024 + 7);
+    }
+    // Without a device pinned memory can not be allocated, so the default falls back to mapped
+    if (cv::cuda::getCudaEnabledDeviceCount() <= 0 && std::getenv("MO_HOST_MEMORY") == nullptr)
+        BOOST_REQUIRE_EQUAL(HostMemoryBackend::GetDefault()->GetType(), HostMemoryBackend::Mapped_e);
+    // Blocks keep the backend they were created with
+    HostMemoryBackend* previous = HostMemoryBackend::GetDefault();
+    HostMemoryBackend::SetDefault(HostMemoryBackend::Mapped_e);
+    {
+        CpuMemoryBlock block(1024 * 1024);
+        HostMemoryBackend::SetDefault(previous->GetType());
+        unsigned char* ptr = block.allocate(1024, 4);
+        BOOST_REQUIRE(ptr);
+        memset(ptr, 1, 1024);
+    }
+}
+
+template<class Block>
+double run_random_pattern(Block& block, int iterations, int live_allocations, std::vector<unsigned char*>& live)
+{
+    srand(1);
+    auto start = boost::posix_time::microsec_clock::local_time();
+    for (int i = 0; i < iterations; ++i)
+    {
+        if (unsigned char* ptr = block.allocate(64 + rand() % 4096, 4))
+            live.push_back(ptr);
+        if (static_cast<int>(live.size()) > live_allocations)
+        {
+            size_t idx = rand() % live.size();
+            block.deAllocate(live[idx]);
+            live[idx] = live.back();
+            live.pop_back();
+        }
+    }
+    auto end = boost::posix_time::microsec_clock::local_time();
+    return static_cast<double>(boost::posix_time::time_duration(end - start).total_microseconds()) / iterations;
+}
+
+BOOST_AUTO_TEST_CASE(memory_block_benchmark)
+{
+    std::cout << "\n ======================================================================== \n";
+    std::cout << " MemoryBlock random allocation pattern (us per allocate + free)\n";
+    for (int live : {16, 256, 4096})
+    {
+        LegacyMemoryBlock legacy(100 * 1024 * 1024);
+        CpuMemoryBlock block(100 * 1024 * 1024);
+        std::vector<unsigned char*> legacy_ptrs, block_ptrs;
+        double legacy_time = run_random_pattern(legacy, 20000, live, legacy_ptrs);
+        double block_time = run_random_pattern(block, 20000, live, block_ptrs);
+        std::cout << " Live allocations: " << live
+                  << " Linear scan: " << legacy_time
+                  << " Free list: " << block_time
+                  << " Fragmentation: " << block.Fragmentation() << "\n";
+        for (auto ptr : block_ptrs)
+            block.deAllocate(ptr);
+        BOOST_REQUIRE_EQUAL(block.FreeBytes(), block.Size());
+    }
+}
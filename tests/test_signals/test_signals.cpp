@@ -10,6 +10,8 @@
 #include "MetaObject/Parameters//ParameterMacros.hpp"
 #include "MetaObject/Parameters/TypedParameterPtr.hpp"
 #include "MetaObject/Parameters/TypedInputParameter.hpp"
+#include "MetaObject/Thread/ThreadHandle.hpp"
+#include "MetaObject/Thread/ThreadPool.hpp"
 
 #include "RuntimeObjectSystem.h"
 #include "IObjectFactorySystem.h"
@@ -22,6 +24,8 @@
 #include <boost/test/included/unit_test.hpp>
 #endif
 #include <boost/thread.hpp>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 
 using namespace mo;
@@ -73,6 +77,500 @@ BOOST_AUTO_TEST_CASE(threaded_signal)
     thread.join();
 }
 
+BOOST_AUTO_TEST_CASE(null_context_emit)
+{
+    mo::Context slot_ctx;
+    int calls = 0;
+    TypedSlot<void(int)> slot([&calls](int value)
+    {
+        calls += value;
+    });
+    TypedSignal<void(int)> signal;
+    auto connection = slot.Connect(&signal);
+    // Without an emitting context slots are compared to the calling thread
+    signal(static_cast<mo::Context*>(nullptr), 5);
+    BOOST_REQUIRE_EQUAL(calls, 5);
+    slot.SetContext(&slot_ctx);
+    signal(static_cast<mo::Context*>(nullptr), 5);
+    BOOST_REQUIRE_EQUAL(calls, 10);
+    signal(5);
+    BOOST_REQUIRE_EQUAL(calls, 15);
+
+    // Both overloads queue the call of a slot on another thread
+    std::atomic<size_t> called_from(0);
+    TypedSlot<void(int)> remote_slot([&called_from](int)
+    {
+        called_from = mo::GetThisThread();
+    });
+    mo::Context thread_ctx;
+    std::atomic<bool> running(false);
+    boost::thread thread = boost::thread([&thread_ctx, &running]()->void
+    {
+        thread_ctx.thread_id = mo::GetThisThread();
+        running = true;
+        while(!boost::this_thread::interruption_requested())
+        {
+            ThreadSpecificQueue::Run(thread_ctx.thread_id);
+        }
+    });
+    while(!running)
+        boost::this_thread::yield();
+    remote_slot.SetContext(&thread_ctx);
+    auto remote_connection = remote_slot.Connect(&signal);
+    for(int emit = 0; emit < 2; ++emit)
+    {
+        called_from = 0;
+        if(emit == 0)
+            signal(static_cast<mo::Context*>(nullptr), 5);
+        else
+            signal(5);
+        for(int i = 0; i < 1000 && called_from == 0; ++i)
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        BOOST_REQUIRE_EQUAL(called_from, thread_ctx.thread_id);
+    }
+    thread.interrupt();
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(slot_context_change)
+{
+    mo::Context ctx;
+    mo::Context thread_ctx;
+    std::atomic<size_t> called_from(0);
+    TypedSlot<void(int)> slot([&called_from](int)
+    {
+        called_from = mo::GetThisThread();
+    });
+    TypedSignal<void(int)> signal;
+    auto connection = slot.Connect(&signal);
+
+    // Without a context the slot is called directly
+    signal(&ctx, 5);
+    BOOST_REQUIRE_EQUAL(called_from, mo::GetThisThread());
+    called_from = 0;
+
+    std::atomic<bool> running(false);
+    boost::thread thread = boost::thread([&thread_ctx, &running]()->void
+    {
+        thread_ctx.thread_id = mo::GetThisThread();
+        running = true;
+        while(!boost::this_thread::interruption_requested())
+        {
+            ThreadSpecificQueue::Run(thread_ctx.thread_id);
+        }
+    });
+    while(!running)
+        boost::this_thread::yield();
+
+    // The relay notices the new context of the connected slot and queues the call to its thread
+    slot.SetContext(&thread_ctx);
+    signal(&ctx, 5);
+    for(int i = 0; i < 1000 && called_from == 0; ++i)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    BOOST_REQUIRE_EQUAL(called_from, thread_ctx.thread_id);
+    thread.interrupt();
+    thread.join();
+}
+
+namespace
+{
+    std::atomic<int> g_payload_copies(0);
+    struct Payload
+    {
+        Payload() {}
+        Payload(const Payload&) { ++g_payload_copies; }
+        Payload(Payload&&) {}
+        int value = 5;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(threaded_fan_out)
+{
+    mo::Context ctx;
+    mo::Context thread_ctx[2];
+    std::atomic<int> calls(0);
+    std::vector<std::unique_ptr<TypedSlot<void(const Payload&)>>> slots;
+    TypedSignal<void(const Payload&)> signal;
+    std::vector<std::shared_ptr<Connection>> connections;
+    for(int i = 0; i < 6; ++i)
+    {
+        mo::Context* slot_ctx = &thread_ctx[i % 2];
+        slots.emplace_back(new TypedSlot<void(const Payload&)>([slot_ctx, &calls](const Payload& payload)
+        {
+            BOOST_REQUIRE_EQUAL(slot_ctx->thread_id, mo::GetThisThread());
+            BOOST_REQUIRE_EQUAL(payload.value, 5);
+            ++calls;
+        }));
+        slots.back()->SetContext(slot_ctx);
+        connections.push_back(slots.back()->Connect(&signal));
+    }
+    std::atomic<int> running(0);
+    std::vector<boost::thread> threads;
+    for(int i = 0; i < 2; ++i)
+    {
+        mo::Context* worker_ctx = &thread_ctx[i];
+        threads.emplace_back([worker_ctx, &running]()->void
+        {
+            worker_ctx->thread_id = mo::GetThisThread();
+            ++running;
+            while(!boost::this_thread::interruption_requested())
+            {
+                ThreadSpecificQueue::Run(worker_ctx->thread_id);
+            }
+        });
+    }
+    while(running != 2)
+        boost::this_thread::yield();
+
+    // Every thread gets one call that shares a single copy of the arguments
+    Payload payload;
+    signal(&ctx, payload);
+    for(int i = 0; i < 1000 && calls != 6; ++i)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    BOOST_REQUIRE_EQUAL(calls, 6);
+    BOOST_REQUIRE_EQUAL(g_payload_copies, 1);
+    for(boost::thread& thread : threads)
+    {
+        thread.interrupt();
+        thread.join();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(delivery_policy)
+{
+    mo::Context ctx;
+    mo::Context thread_ctx;
+    std::vector<int> all, latest, dropped;
+    TypedSlot<void(int)> all_slot([&all](int value) { all.push_back(value); });
+    TypedSlot<void(int)> latest_slot([&latest](int value) { latest.push_back(value); });
+    TypedSlot<void(int)> drop_slot([&dropped](int value) { dropped.push_back(value); });
+    latest_slot.SetDeliveryPolicy(Latest_e);
+    drop_slot.SetDeliveryPolicy(DropWhenBusy_e);
+    TypedSignal<void(int)> signal;
+    std::vector<std::shared_ptr<Connection>> connections;
+    for(TypedSlot<void(int)>* slot : {&all_slot, &latest_slot, &drop_slot})
+    {
+        slot->SetContext(&thread_ctx);
+        connections.push_back(slot->Connect(&signal));
+    }
+
+    std::atomic<bool> running(false);
+    std::atomic<bool> consume(false);
+    boost::thread thread = boost::thread([&thread_ctx, &running, &consume]()->void
+    {
+        thread_ctx.thread_id = mo::GetThisThread();
+        running = true;
+        while(!consume)
+            boost::this_thread::yield();
+        while(!boost::this_thread::interruption_requested())
+        {
+            ThreadSpecificQueue::Run(thread_ctx.thread_id);
+        }
+    });
+    while(!running)
+        boost::this_thread::yield();
+
+    // The consumer is busy while all emissions are queued
+    for(int i = 0; i < 10; ++i)
+        signal(&ctx, i);
+    consume = true;
+    for(int i = 0; i < 1000 && all.size() != 10; ++i)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    thread.interrupt();
+    thread.join();
+    BOOST_REQUIRE_EQUAL(all.size(), 10);
+    BOOST_REQUIRE_EQUAL(latest.size(), 1);
+    BOOST_REQUIRE_EQUAL(latest[0], 9);
+    BOOST_REQUIRE_EQUAL(dropped.size(), 1);
+    BOOST_REQUIRE_EQUAL(dropped[0], 0);
+}
+
+namespace
+{
+    struct Accumulator
+    {
+        void Add(int value) { sum += value; }
+        int sum = 0;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(inline_delegate)
+{
+    Accumulator accumulator;
+    TypedSlot<void(int)> bound;
+    BOOST_REQUIRE(!bound);
+    bound = std::bind(&Accumulator::Add, &accumulator, std::placeholders::_1);
+    BOOST_REQUIRE(bound.IsInline());
+    TypedSlot<void(int)> member(&accumulator, &Accumulator::Add);
+    BOOST_REQUIRE(member.IsInline());
+    TypedSignal<void(int)> signal;
+    auto bound_connection = bound.Connect(&signal);
+    auto member_connection = member.Connect(&signal);
+    signal(2);
+    BOOST_REQUIRE_EQUAL(accumulator.sum, 4);
+
+    // Empty std::function objects still produce an empty slot
+    TypedSlot<void(int)> empty = std::function<void(int)>();
+    BOOST_REQUIRE(!empty);
+    BOOST_REQUIRE_THROW(empty(1), std::bad_function_call);
+}
+
+BOOST_AUTO_TEST_CASE(reentrant_signal)
+{
+    TypedSignal<void(int)> signal;
+    int sum = 0;
+    TypedSlot<void(int)> slot([&signal, &sum](int value)
+    {
+        sum += value;
+        if(value > 1)
+            signal(value - 1);
+    });
+    auto connection = slot.Connect(&signal);
+    signal(3);
+    BOOST_REQUIRE_EQUAL(sum, 6);
+
+    // A slot may disconnect and destroy itself while it is being called
+    int calls = 0;
+    TypedSlot<void(int)>* self = nullptr;
+    self = new TypedSlot<void(int)>([&calls, &self](int)
+    {
+        ++calls;
+        delete self;
+    });
+    auto self_connection = self->Connect(&signal);
+    signal(1);
+    signal(1);
+    BOOST_REQUIRE_EQUAL(calls, 1);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_connect_disconnect)
+{
+    TypedSignal<void(int)> signal;
+    std::atomic<int> calls(0);
+    std::atomic<bool> running(true);
+    boost::thread emitter([&signal, &running]()
+    {
+        while(running)
+            signal(1);
+    });
+    // Disconnect waits for the emitter to leave the slot before it is destroyed
+    for(int i = 0; i < 1000; ++i)
+    {
+        TypedSlot<void(int)> slot([&calls](int value)
+        {
+            calls += value;
+        });
+        auto connection = slot.Connect(&signal);
+        boost::this_thread::yield();
+    }
+    running = false;
+    emitter.join();
+    TypedSlot<void(int)> slot([&calls](int value)
+    {
+        calls += value;
+    });
+    auto connection = slot.Connect(&signal);
+    const int before = calls;
+    signal(1);
+    BOOST_REQUIRE_EQUAL(calls, before + 1);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_waiting_remove)
+{
+    // Writers that wait for emissions must not wait on each other
+    SnapshotList<int> list;
+    std::atomic<bool> running(true);
+    boost::thread emitter([&list, &running]()
+    {
+        while(running)
+        {
+            auto snapshot = list.Get();
+            SignalDispatch dispatch(snapshot.get());
+            boost::this_thread::yield();
+        }
+    });
+    std::atomic<int> failures(0);
+    std::vector<boost::thread> writers;
+    for(int i = 0; i < 4; ++i)
+    {
+        writers.emplace_back([&list, &failures, i]()
+        {
+            for(int j = 0; j < 2000; ++j)
+            {
+                if(!list.Insert(i) || !list.Remove(i, true))
+                    ++failures;
+            }
+        });
+    }
+    for(boost::thread& writer : writers)
+        writer.join();
+    running = false;
+    emitter.join();
+    BOOST_REQUIRE_EQUAL(failures, 0);
+    BOOST_REQUIRE(list.Empty());
+}
+
+BOOST_AUTO_TEST_CASE(async_call)
+{
+    mo::Context ctx;
+    mo::Context thread_ctx;
+    std::atomic<bool> running(false);
+    boost::thread thread = boost::thread([&thread_ctx, &running]()->void
+    {
+        thread_ctx.thread_id = mo::GetThisThread();
+        running = true;
+        while(!boost::this_thread::interruption_requested())
+        {
+            ThreadSpecificQueue::Run(thread_ctx.thread_id);
+        }
+    });
+    while(!running)
+        boost::this_thread::yield();
+
+    TypedSlot<size_t(int)> remote_slot([](int value)
+    {
+        if(value < 0)
+            throw std::runtime_error("negative");
+        return mo::GetThisThread() + value;
+    });
+    remote_slot.SetContext(&thread_ctx);
+    TypedSlot<size_t(int)> local_slot([](int value)
+    {
+        return mo::GetThisThread() + value;
+    });
+    local_slot.SetContext(&ctx);
+    TypedSignal<size_t(int)> remote_signal;
+    TypedSignal<size_t(int)> local_signal;
+    auto remote_connection = remote_slot.Connect(&remote_signal);
+    auto local_connection = local_slot.Connect(&local_signal);
+
+    // The result is computed on the thread of the slot's context
+    std::future<size_t> result = remote_signal.AsyncCall(&ctx, 1);
+    BOOST_REQUIRE_EQUAL(result.get(), thread_ctx.thread_id + 1);
+    result = remote_signal.AsyncCall(&ctx, -1);
+    BOOST_CHECK_THROW(result.get(), std::runtime_error);
+    // Slots on the calling thread are called before AsyncCall returns
+    result = local_signal.AsyncCall(&ctx, 2);
+    BOOST_REQUIRE(result.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    BOOST_REQUIRE_EQUAL(result.get(), mo::GetThisThread() + 2);
+
+    std::vector<TypedSignal<size_t(int)>*> signals;
+    signals.push_back(&remote_signal);
+    signals.push_back(&local_signal);
+    std::vector<std::future<size_t>> results = TypedSignal<size_t(int)>::AsyncCallAll(signals, &ctx, 3);
+    BOOST_REQUIRE_EQUAL(results.size(), 2);
+    BOOST_REQUIRE_EQUAL(results[0].get(), thread_ctx.thread_id + 3);
+    BOOST_REQUIRE_EQUAL(results[1].get(), mo::GetThisThread() + 3);
+
+    TypedSignal<size_t(int)> unconnected;
+    signals.push_back(&unconnected);
+    BOOST_CHECK_THROW(TypedSignal<size_t(int)>::AsyncCallAll(signals, &ctx, 3), std::string);
+    thread.interrupt();
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(queue_priority)
+{
+    std::atomic<size_t> thread_id(0);
+    std::atomic<bool> start(false);
+    std::vector<int> order;
+    boost::thread thread = boost::thread([&thread_id, &start]()->void
+    {
+        thread_id = mo::GetThisThread();
+        while(!start)
+            boost::this_thread::yield();
+        ThreadSpecificQueue::Run();
+    });
+    while(thread_id == 0)
+        boost::this_thread::yield();
+
+    // Control calls pushed behind a backlog of data calls run first
+    const int num_data = 40;
+    ThreadSpecificQueue::Push([&order]() { order.push_back(-1); }, thread_id, nullptr, LowPriority_e);
+    for(int i = 0; i < num_data; ++i)
+        ThreadSpecificQueue::Push([&order, i]() { order.push_back(i); }, thread_id);
+    ThreadSpecificQueue::Push([&order]() { order.push_back(100); }, thread_id, nullptr, HighPriority_e);
+    start = true;
+    thread.join();
+
+    BOOST_REQUIRE_EQUAL(order.size(), num_data + 2);
+    BOOST_REQUIRE_EQUAL(order[0], 100);
+    // The low priority call only waits for a bounded number of calls
+    const auto low = std::find(order.begin(), order.end(), -1);
+    BOOST_REQUIRE(low != order.end());
+    const size_t limit = ThreadSpecificQueue::StarvationLimit;
+    BOOST_REQUIRE_EQUAL(static_cast<size_t>(low - order.begin()), limit);
+    // Calls of a lane run in the order they were pushed
+    order.erase(low);
+    for(int i = 0; i < num_data; ++i)
+        BOOST_REQUIRE_EQUAL(order[i + 1], i);
+}
+
+BOOST_AUTO_TEST_CASE(thread_control_priority)
+{
+    {
+        mo::ThreadHandle handle = mo::ThreadPool::Instance()->RequestThread();
+        const size_t thread_id = handle.GetId();
+        // Hold the thread in a queued call, the following calls are pushed while it drains its queue
+        std::atomic<bool> draining(false);
+        std::atomic<bool> release(false);
+        ThreadSpecificQueue::Push([&draining, &release]()
+        {
+            draining = true;
+            while(!release)
+                boost::this_thread::yield();
+        }, thread_id);
+        while(!draining)
+            boost::this_thread::yield();
+
+        // Pushes do not wait for the running call, release it once every call is queued
+        const int num_data = 40;
+        std::atomic<bool> queued(false);
+        boost::thread releaser([&release, &queued, thread_id, num_data]()
+        {
+            for(int i = 0; i < 2000 && !queued; ++i)
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+            release = true;
+        });
+
+        boost::mutex mtx;
+        std::vector<int> order;
+        auto record = [&mtx, &order](int value)
+        {
+            boost::mutex::scoped_lock lock(mtx);
+            order.push_back(value);
+        };
+        ThreadSpecificQueue::Push(std::bind(record, -1), thread_id, nullptr, LowPriority_e);
+        for(int i = 0; i < num_data; ++i)
+            ThreadSpecificQueue::Push(std::bind(record, i), thread_id);
+        handle.PushEventQueue(std::bind(record, 100));
+        const bool pushed_while_draining = !release;
+        queued = true;
+        releaser.join();
+        BOOST_REQUIRE(pushed_while_draining);
+        for(int i = 0; i < 1000; ++i)
+        {
+            {
+                boost::mutex::scoped_lock lock(mtx);
+                if(order.size() == num_data + 2)
+                    break;
+            }
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+        }
+
+        boost::mutex::scoped_lock lock(mtx);
+        BOOST_REQUIRE_EQUAL(order.size(), num_data + 2);
+        // The control action overtakes the queued data
+        BOOST_REQUIRE_EQUAL(order[0], 100);
+        // The background call still drains within the starvation limit
+        const auto low = std::find(order.begin(), order.end(), -1);
+        BOOST_REQUIRE(low != order.end());
+        const size_t limit = ThreadSpecificQueue::StarvationLimit;
+        BOOST_REQUIRE_LE(static_cast<size_t>(low - order.begin()), limit);
+    }
+    mo::ThreadPool::Instance()->Cleanup();
+}
+
 BOOST_AUTO_TEST_CASE(relay_manager)
 {
     mo::Context ctx;
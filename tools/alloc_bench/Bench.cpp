@@ -0,0 +1,190 @@
+#include "Bench.hpp"
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    typedef std::chrono::steady_clock clock_type;
+
+    const size_t page_size = 4096;
+
+    struct ThreadState
+    {
+        std::vector<uint64_t> latencies;
+    };
+
+    void RunThread(const Benchmark& benchmark, const SizeDistribution& distribution,
+                   const BenchmarkSettings& settings, int index,
+                   boost::barrier& start, boost::barrier& stop, ThreadState& state)
+    {
+        std::unique_ptr<Target> target = benchmark.create();
+        std::mt19937_64 rng(settings.seed + static_cast<uint64_t>(index) * 7919);
+        // Draw everything up front so that the timed loop only measures the allocator
+        const size_t iterations = settings.ops_per_thread / 2;
+        std::vector<size_t> sizes(iterations);
+        std::vector<uint32_t> slots(iterations);
+        std::uniform_int_distribution<uint32_t> slot_dist(0, static_cast<uint32_t>(settings.live - 1));
+        for(size_t i = 0; i < iterations; ++i)
+        {
+            sizes[i] = distribution.Draw(rng);
+            slots[i] = slot_dist(rng);
+        }
+        std::vector<void*> handles(settings.live, nullptr);
+        std::vector<size_t> handle_sizes(settings.live, 0);
+        for(size_t i = 0; i < settings.live; ++i)
+        {
+            handle_sizes[i] = distribution.Draw(rng);
+            handles[i] = target->Allocate(handle_sizes[i]);
+        }
+        state.latencies.resize(iterations * 2);
+        const bool touch = !benchmark.gpu;
+
+        start.wait();
+        for(size_t i = 0; i < iterations; ++i)
+        {
+            const uint32_t slot = slots[i];
+            clock_type::time_point t0 = clock_type::now();
+            target->Deallocate(handles[slot], handle_sizes[slot]);
+            clock_type::time_point t1 = clock_type::now();
+            handles[slot] = target->Allocate(sizes[i]);
+            clock_type::time_point t2 = clock_type::now();
+            handle_sizes[slot] = sizes[i];
+            if(touch)
+            {
+                unsigned char* data = target->Data(handles[slot]);
+                for(size_t offset = 0; offset < sizes[i]; offset += page_size)
+                    data[offset] = static_cast<unsigned char>(offset);
+            }
+            state.latencies[2 * i] = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            state.latencies[2 * i + 1] = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+        }
+        stop.wait();
+
+        for(size_t i = 0; i < settings.live; ++i)
+            target->Deallocate(handles[i], handle_sizes[i]);
+    }
+
+    double Percentile(std::vector<uint64_t>& values, double percentile)
+    {
+        if(values.empty())
+            return 0.0;
+        const size_t index = std::min(values.size() - 1,
+                                      static_cast<size_t>(percentile * static_cast<double>(values.size())));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return static_cast<double>(values[index]);
+    }
+}
+
+size_t SizeDistribution::Draw(std::mt19937_64& rng) const
+{
+    if(!sizes.empty())
+        return sizes[std::uniform_int_distribution<size_t>(0, sizes.size() - 1)(rng)];
+    std::uniform_real_distribution<double> dist(std::log(static_cast<double>(min_bytes)),
+                                                std::log(static_cast<double>(max_bytes)));
+    return static_cast<size_t>(std::exp(dist(rng)));
+}
+
+std::vector<SizeDistribution> DefaultDistributions()
+{
+    std::vector<SizeDistribution> output(5);
+    output[0].name = "small";
+    output[0].min_bytes = 16;
+    output[0].max_bytes = 4 * 1024;
+    output[1].name = "medium";
+    output[1].min_bytes = 4 * 1024;
+    output[1].max_bytes = 256 * 1024;
+    output[2].name = "large";
+    output[2].min_bytes = 256 * 1024;
+    output[2].max_bytes = 16 * 1024 * 1024;
+    output[3].name = "mixed";
+    output[3].min_bytes = 16;
+    output[3].max_bytes = 16 * 1024 * 1024;
+    // Image sizes of a typical pipeline: VGA and HD gray, color and float frames
+    output[4].name = "frames";
+    output[4].sizes = {640 * 480, 640 * 480 * 3, 1280 * 720 * 3, 1920 * 1080, 1920 * 1080 * 3, 1920 * 1080 * 4};
+    return output;
+}
+
+BenchmarkResult Run(const Benchmark& benchmark, const SizeDistribution& distribution,
+                    const BenchmarkSettings& settings)
+{
+    BenchmarkResult result;
+    result.name = benchmark.name;
+    result.distribution = distribution.name;
+    result.threads = settings.threads;
+
+    std::vector<ThreadState> states(settings.threads);
+    boost::barrier start(static_cast<unsigned int>(settings.threads + 1));
+    boost::barrier stop(static_cast<unsigned int>(settings.threads + 1));
+    const size_t base_rss = CurrentRss();
+    std::atomic<size_t> peak_rss(base_rss);
+    std::atomic<bool> running(true);
+    boost::thread monitor([&]()
+    {
+        while(running)
+        {
+            const size_t rss = CurrentRss();
+            if(rss > peak_rss)
+                peak_rss = rss;
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        }
+    });
+    std::vector<boost::thread> threads;
+    for(int i = 0; i < settings.threads; ++i)
+    {
+        threads.emplace_back(&RunThread, std::cref(benchmark), std::cref(distribution), std::cref(settings), i,
+                             std::ref(start), std::ref(stop), std::ref(states[i]));
+    }
+    start.wait();
+    const clock_type::time_point begin = clock_type::now();
+    stop.wait();
+    const clock_type::time_point end = clock_type::now();
+    for(boost::thread& thread : threads)
+        thread.join();
+    running = false;
+    monitor.join();
+
+    std::vector<uint64_t> latencies;
+    for(ThreadState& state : states)
+        latencies.insert(latencies.end(), state.latencies.begin(), state.latencies.end());
+    result.ops = latencies.size();
+    result.seconds = std::chrono::duration<double>(end - begin).count();
+    result.ops_per_second = result.seconds > 0.0 ? result.ops / result.seconds : 0.0;
+    result.p50_ns = Percentile(latencies, 0.5);
+    result.p99_ns = Percentile(latencies, 0.99);
+    result.max_ns = latencies.empty() ? 0.0 : static_cast<double>(*std::max_element(latencies.begin(), latencies.end()));
+    result.peak_rss_bytes = peak_rss > base_rss ? peak_rss - base_rss : 0;
+    return result;
+}
+
+size_t CurrentRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.WorkingSetSize;
+    return 0;
+#else
+    FILE* file = fopen("/proc/self/statm", "r");
+    if(file == nullptr)
+        return 0;
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    const int read = fscanf(file, "%lu %lu", &size, &resident);
+    fclose(file);
+    if(read != 2)
+        return 0;
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief The Target class is the allocator under test as seen by one
+ *        benchmark thread.  Allocate returns an opaque handle that is passed
+ *        back to Deallocate along with the size.
+ */
+class Target
+{
+public:
+    virtual ~Target() {}
+    virtual void* Allocate(size_t num_bytes) = 0;
+    virtual void Deallocate(void* handle, size_t num_bytes) = 0;
+    // Host memory is touched after allocating so that first touch page faults are measured
+    virtual unsigned char* Data(void* handle) = 0;
+};
+
+/*!
+ * \brief The Benchmark struct names an allocator composition.  Create is
+ *        called on every benchmark thread, compositions that are shared
+ *        between threads capture the shared instance.
+ */
+struct Benchmark
+{
+    std::string name;
+    bool gpu = false;
+    std::function<std::unique_ptr<Target>()> create;
+};
+
+/*!
+ * \brief The SizeDistribution struct draws allocation sizes, either log
+ *        uniformly from [min_bytes, max_bytes] or from a fixed set of sizes.
+ */
+struct SizeDistribution
+{
+    std::string name;
+    size_t min_bytes = 0;
+    size_t max_bytes = 0;
+    std::vector<size_t> sizes;
+
+    size_t Draw(std::mt19937_64& rng) const;
+};
+
+std::vector<SizeDistribution> DefaultDistributions();
+
+struct BenchmarkSettings
+{
+    int threads = 1;
+    size_t ops_per_thread = 100000;
+    // Allocations each thread keeps alive, every op frees a random one and replaces it
+    size_t live = 64;
+    uint64_t seed = 1;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    std::string distribution;
+    int threads = 0;
+    size_t ops = 0;            // allocations plus deallocations
+    double seconds = 0.0;
+    double ops_per_second = 0.0;
+    double p50_ns = 0.0;
+    double p99_ns = 0.0;
+    double max_ns = 0.0;
+    size_t peak_rss_bytes = 0; // above the resident set size at the start of the run
+};
+
+BenchmarkResult Run(const Benchmark& benchmark, const SizeDistribution& distribution,
+                    const BenchmarkSettings& settings);
+
+// Every composition that is benchmarked, the GPU ones are only included if gpu is set
+std::vector<Benchmark> CreateBenchmarks(bool gpu);
+
+// Resident set size of the process in bytes, 0 if it is not available
+size_t CurrentRss();
@@ -0,0 +1,263 @@
+#include "Bench.hpp"
+#include <MetaObject/Detail/AllocatorImpl.hpp>
+#include <cstdlib>
+
+namespace
+{
+    class MallocTarget: public Target
+    {
+    public:
+        void* Allocate(size_t num_bytes) { return std::malloc(num_bytes); }
+        void Deallocate(void* handle, size_t) { std::free(handle); }
+        unsigned char* Data(void* handle) { return static_cast<unsigned char*>(handle); }
+    };
+
+    // Raw memory interface shared by the policies
+    template<class Policy>
+    class PolicyTarget: public Target
+    {
+    public:
+        PolicyTarget(const std::shared_ptr<Policy>& policy_): policy(policy_) {}
+        void* Allocate(size_t num_bytes) { return policy->allocate(num_bytes); }
+        void Deallocate(void* handle, size_t num_bytes)
+        {
+            policy->deallocate(static_cast<unsigned char*>(handle), num_bytes);
+        }
+        unsigned char* Data(void* handle) { return static_cast<unsigned char*>(handle); }
+    private:
+        std::shared_ptr<Policy> policy;
+    };
+
+    // Mat header path, as taken by cv::Mat::create and release
+    class MatTarget: public Target
+    {
+    public:
+        MatTarget(cv::MatAllocator* allocator_): allocator(allocator_) {}
+        void* Allocate(size_t num_bytes)
+        {
+            const int size = static_cast<int>(num_bytes);
+            size_t step = CV_AUTOSTEP;
+            return allocator->allocate(1, &size, CV_8U, nullptr, &step, 0, cv::USAGE_DEFAULT);
+        }
+        void Deallocate(void* handle, size_t)
+        {
+            cv::UMatData* u = static_cast<cv::UMatData*>(handle);
+            u->currAllocator->deallocate(u);
+        }
+        unsigned char* Data(void* handle) { return static_cast<cv::UMatData*>(handle)->data; }
+    private:
+        cv::MatAllocator* allocator;
+    };
+
+    class MoAllocatorTarget: public Target
+    {
+    public:
+        MoAllocatorTarget(mo::Allocator* allocator_, bool gpu_): allocator(allocator_), gpu(gpu_) {}
+        void* Allocate(size_t num_bytes)
+        {
+            return gpu ? allocator->allocateGpu(num_bytes) : allocator->allocateCpu(num_bytes);
+        }
+        void Deallocate(void* handle, size_t num_bytes)
+        {
+            if(gpu)
+                allocator->deallocateGpu(static_cast<unsigned char*>(handle), num_bytes);
+            else
+                allocator->deallocateCpu(static_cast<unsigned char*>(handle), num_bytes);
+        }
+        unsigned char* Data(void* handle) { return static_cast<unsigned char*>(handle); }
+    private:
+        mo::Allocator* allocator;
+        bool gpu;
+    };
+
+    class CudaMallocTarget: public Target
+    {
+    public:
+        void* Allocate(size_t num_bytes)
+        {
+            void* ptr = nullptr;
+            cudaMalloc(&ptr, num_bytes);
+            return ptr;
+        }
+        void Deallocate(void* handle, size_t) { cudaFree(handle); }
+        unsigned char* Data(void* handle) { return static_cast<unsigned char*>(handle); }
+    };
+
+    // GpuMat path, headers are recycled so only the allocator is measured
+    class GpuMatTarget: public Target
+    {
+    public:
+        GpuMatTarget(cv::cuda::GpuMat::Allocator* allocator_): allocator(allocator_) {}
+        ~GpuMatTarget()
+        {
+            for(cv::cuda::GpuMat* mat : headers)
+                delete mat;
+        }
+        void* Allocate(size_t num_bytes)
+        {
+            cv::cuda::GpuMat* mat;
+            if(headers.empty())
+            {
+                mat = new cv::cuda::GpuMat();
+            }else
+            {
+                mat = headers.back();
+                headers.pop_back();
+            }
+            mat->allocator = allocator;
+            allocator->allocate(mat, 1, static_cast<int>(num_bytes), 1);
+            return mat;
+        }
+        void Deallocate(void* handle, size_t)
+        {
+            cv::cuda::GpuMat* mat = static_cast<cv::cuda::GpuMat*>(handle);
+            allocator->free(mat);
+            // Same as GpuMat::release, so the recycled header does not refer to the freed memory
+            mat->data = mat->datastart = mat->dataend = nullptr;
+            mat->refcount = nullptr;
+            headers.push_back(mat);
+        }
+        unsigned char* Data(void* handle) { return static_cast<cv::cuda::GpuMat*>(handle)->data; }
+    private:
+        cv::cuda::GpuMat::Allocator* allocator;
+        std::vector<cv::cuda::GpuMat*> headers;
+    };
+
+    // Every thread creates its own instance, as with the thread specific allocator
+    template<class Policy>
+    Benchmark PerThread(const std::string& name, bool gpu = false)
+    {
+        Benchmark benchmark;
+        benchmark.name = name;
+        benchmark.gpu = gpu;
+        benchmark.create = []()
+        {
+            return std::unique_ptr<Target>(new PolicyTarget<Policy>(std::make_shared<Policy>()));
+        };
+        return benchmark;
+    }
+
+    // One instance is used by all threads, as with the thread safe allocator
+    template<class Policy>
+    Benchmark Shared(const std::string& name, bool gpu = false)
+    {
+        Benchmark benchmark;
+        benchmark.name = name;
+        benchmark.gpu = gpu;
+        std::shared_ptr<Policy> policy = std::make_shared<Policy>();
+        benchmark.create = [policy]()
+        {
+            return std::unique_ptr<Target>(new PolicyTarget<Policy>(policy));
+        };
+        return benchmark;
+    }
+
+    template<class T>
+    Benchmark Simple(const std::string& name, bool gpu = false)
+    {
+        Benchmark benchmark;
+        benchmark.name = name;
+        benchmark.gpu = gpu;
+        benchmark.create = []()
+        {
+            return std::unique_ptr<Target>(new T());
+        };
+        return benchmark;
+    }
+}
+
+std::vector<Benchmark> CreateBenchmarks(bool gpu)
+{
+    std::vector<Benchmark> output;
+    output.push_back(Simple<MallocTarget>("malloc"));
+    output.push_back(PerThread<mo::CpuPoolPolicy>("CpuPoolPolicy"));
+    output.push_back(Shared<mo::mt_CpuPoolPolicy>("mt_CpuPoolPolicy"));
+    output.push_back(PerThread<mo::CpuStackPolicy>("CpuStackPolicy"));
+    output.push_back(Shared<mo::mt_CpuStackPolicy>("mt_CpuStackPolicy"));
+    output.push_back(PerThread<mo::h_CombinedAllocator_t>("CombinedPolicy<CpuPool,CpuStack>"));
+    output.push_back(Shared<mo::LockPolicy<mo::h_CombinedAllocator_t>>("LockPolicy<CombinedPolicy<CpuPool,CpuStack>>"));
+    {
+        Benchmark benchmark;
+        benchmark.name = "Allocator::GetThreadSpecificAllocator";
+        benchmark.create = []()
+        {
+            return std::unique_ptr<Target>(new MoAllocatorTarget(mo::Allocator::GetThreadSpecificAllocator(), false));
+        };
+        output.push_back(benchmark);
+    }
+    {
+        Benchmark benchmark;
+        benchmark.name = "Allocator::GetThreadSafeAllocator";
+        benchmark.create = []()
+        {
+            return std::unique_ptr<Target>(new MoAllocatorTarget(mo::Allocator::GetThreadSafeAllocator(), false));
+        };
+        output.push_back(benchmark);
+    }
+    {
+        Benchmark benchmark;
+        benchmark.name = "cv::Mat std allocator";
+        benchmark.create = []()
+        {
+            return std::unique_ptr<Target>(new MatTarget(cv::Mat::getStdAllocator()));
+        };
+        output.push_back(benchmark);
+    }
+    {
+        // Each thread routes to its thread specific allocator
+        Benchmark benchmark;
+        benchmark.name = "CpuAllocatorThreadAdapter(thread)";
+        std::shared_ptr<mo::CpuAllocatorThreadAdapter> adapter = std::make_shared<mo::CpuAllocatorThreadAdapter>();
+        benchmark.create = [adapter]()
+        {
+            mo::CpuAllocatorThreadAdapter::SetThreadAllocator(mo::Allocator::GetThreadSpecificAllocator());
+            return std::unique_ptr<Target>(new MatTarget(adapter.get()));
+        };
+        output.push_back(benchmark);
+    }
+    {
+        // Without a thread allocator the adapter falls back to the thread safe allocator
+        Benchmark benchmark;
+        benchmark.name = "CpuAllocatorThreadAdapter(global)";
+        std::shared_ptr<mo::CpuAllocatorThreadAdapter> adapter = std::make_shared<mo::CpuAllocatorThreadAdapter>();
+        benchmark.create = [adapter]()
+        {
+            mo::CpuAllocatorThreadAdapter::SetThreadAllocator(nullptr);
+            return std::unique_ptr<Target>(new MatTarget(adapter.get()));
+        };
+        output.push_back(benchmark);
+    }
+    if(!gpu)
+        return output;
+
+    output.push_back(Simple<CudaMallocTarget>("cudaMalloc", true));
+    output.push_back(PerThread<mo::d_TensorPoolAllocator_t>("PoolPolicy<GpuMat>", true));
+    output.push_back(Shared<mo::d_mt_TensorPoolAllocator_t>("LockPolicy<PoolPolicy<GpuMat>>", true));
+    output.push_back(PerThread<mo::d_TextureAllocator_t>("StackPolicy<GpuMat>", true));
+    output.push_back(Shared<mo::d_mt_TextureAllocator_t>("LockPolicy<StackPolicy<GpuMat>>", true));
+    output.push_back(PerThread<mo::CombinedPolicy<mo::d_TensorPoolAllocator_t, mo::d_TextureAllocator_t>>(
+        "CombinedPolicy<PoolPolicy,StackPolicy>", true));
+    {
+        Benchmark benchmark;
+        benchmark.name = "Allocator::GetThreadSpecificAllocator(gpu)";
+        benchmark.gpu = true;
+        benchmark.create = []()
+        {
+            return std::unique_ptr<Target>(new MoAllocatorTarget(mo::Allocator::GetThreadSpecificAllocator(), true));
+        };
+        output.push_back(benchmark);
+    }
+    {
+        Benchmark benchmark;
+        benchmark.name = "GpuAllocatorThreadAdapter(thread)";
+        benchmark.gpu = true;
+        std::shared_ptr<mo::GpuAllocatorThreadAdapter> adapter = std::make_shared<mo::GpuAllocatorThreadAdapter>();
+        benchmark.create = [adapter]()
+        {
+            mo::GpuAllocatorThreadAdapter::SetThreadAllocator(mo::Allocator::GetThreadSpecificAllocator());
+            return std::unique_ptr<Target>(new GpuMatTarget(adapter.get()));
+        };
+        output.push_back(benchmark);
+    }
+    return output;
+}
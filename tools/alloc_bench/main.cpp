@@ -0,0 +1,213 @@
+#include "Bench.hpp"
+#include "MetaObject/Detail/HostMemoryBackend.hpp"
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/thread/thread.hpp>
+#include <opencv2/core/cuda.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Measures allocate/deallocate throughput, latency percentiles and peak
+ * resident memory of the allocator policy compositions against the system
+ * allocator.  Every thread keeps a set of live allocations and repeatedly
+ * frees a random one and allocates a replacement drawn from a size
+ * distribution.  GPU compositions are only measured with --gpu and a CUDA
+ * device, and host memory is mapped instead of pinned without a device, so
+ * the CPU results are available on any machine.
+ */
+
+namespace
+{
+    void PrintUsage()
+    {
+        std::cout <<
+            "Usage: alloc_bench [options]\n"
+            "  --threads <a,b,...>         thread counts (default 1,2,4,... up to the hardware concurrency)\n"
+            "  --ops <n>                   allocations plus deallocations per thread (default 100000)\n"
+            "  --live <n>                  live allocations per thread (default 64)\n"
+            "  --distributions <a,b,...>   small, medium, large, mixed, frames (default all)\n"
+            "  --filter <text>             only run compositions whose name contains text\n"
+            "  --seed <n>                  random seed (default 1)\n"
+            "  --gpu                       also measure the GpuMat policies if a CUDA device is present\n"
+            "  --host-memory <type>        pinned, mapped or hugepage (default pinned, mapped without a CUDA device)\n"
+            "  --list                      print the compositions and exit\n"
+            "  --csv                       machine readable output\n";
+    }
+
+    std::vector<std::string> ParseList(const char* arg)
+    {
+        std::vector<std::string> output;
+        std::stringstream ss(arg);
+        std::string item;
+        while(std::getline(ss, item, ','))
+        {
+            if(item.size())
+                output.push_back(item);
+        }
+        return output;
+    }
+
+    const char* HostMemoryName(mo::HostMemoryBackend::Type type)
+    {
+        switch(type)
+        {
+        case mo::HostMemoryBackend::Mapped_e: return "mapped";
+        case mo::HostMemoryBackend::HugePage_e: return "hugepage";
+        default: return "pinned";
+        }
+    }
+
+    std::string Megabytes(size_t bytes)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.1f", bytes / (1024.0 * 1024.0));
+        return buf;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    std::vector<int> thread_counts;
+    std::vector<std::string> distribution_names;
+    std::string filter;
+    std::string host_memory;
+    bool gpu = false;
+    bool list = false;
+    bool csv = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if(arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else if(arg == "--csv")
+            csv = true;
+        else if(arg == "--gpu")
+            gpu = true;
+        else if(arg == "--list")
+            list = true;
+        else if(arg == "--threads" && has_value)
+        {
+            for(const std::string& count : ParseList(argv[++i]))
+                thread_counts.push_back(std::max(1, atoi(count.c_str())));
+        }
+        else if(arg == "--ops" && has_value)
+            settings.ops_per_thread = static_cast<size_t>(std::strtod(argv[++i], nullptr));
+        else if(arg == "--live" && has_value)
+            settings.live = std::max<size_t>(1, static_cast<size_t>(atoi(argv[++i])));
+        else if(arg == "--distributions" && has_value)
+            distribution_names = ParseList(argv[++i]);
+        else if(arg == "--filter" && has_value)
+            filter = argv[++i];
+        else if(arg == "--host-memory" && has_value)
+            host_memory = argv[++i];
+        else if(arg == "--seed" && has_value)
+            settings.seed = static_cast<uint64_t>(std::strtoull(argv[++i], nullptr, 10));
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+    const bool has_device = cv::cuda::getCudaEnabledDeviceCount() > 0;
+    if(gpu && !has_device)
+    {
+        std::cerr << "No CUDA device found, only measuring host allocators" << std::endl;
+        gpu = false;
+    }
+    // Set before any pool or stack is created, they keep the backend they were created with
+    if(host_memory == "pinned" && !has_device)
+    {
+        std::cerr << "Pinned host memory needs a CUDA device, using mapped host memory" << std::endl;
+        host_memory = "mapped";
+    }
+    if(host_memory == "pinned")
+        mo::HostMemoryBackend::SetDefault(mo::HostMemoryBackend::Pinned_e);
+    else if(host_memory == "mapped" || (host_memory.empty() && !has_device))
+        mo::HostMemoryBackend::SetDefault(mo::HostMemoryBackend::Mapped_e);
+    else if(host_memory == "hugepage")
+        mo::HostMemoryBackend::SetDefault(mo::HostMemoryBackend::HugePage_e);
+    else if(host_memory.size())
+    {
+        std::cerr << "Unknown host memory type " << host_memory << std::endl;
+        PrintUsage();
+        return 1;
+    }
+    const char* host_memory_name = HostMemoryName(mo::HostMemoryBackend::GetDefault()->GetType());
+    if(thread_counts.empty())
+    {
+        const int max_threads = std::max(1, static_cast<int>(boost::thread::hardware_concurrency()));
+        for(int count = 1; count < max_threads; count *= 2)
+            thread_counts.push_back(count);
+        thread_counts.push_back(max_threads);
+    }
+    std::vector<SizeDistribution> distributions;
+    for(const SizeDistribution& distribution : DefaultDistributions())
+    {
+        if(distribution_names.empty() ||
+           std::find(distribution_names.begin(), distribution_names.end(), distribution.name) != distribution_names.end())
+            distributions.push_back(distribution);
+    }
+    std::vector<Benchmark> benchmarks;
+    for(const Benchmark& benchmark : CreateBenchmarks(gpu))
+    {
+        if(filter.empty() || benchmark.name.find(filter) != std::string::npos)
+            benchmarks.push_back(benchmark);
+    }
+    if(list)
+    {
+        for(const Benchmark& benchmark : benchmarks)
+            std::cout << benchmark.name << (benchmark.gpu ? " (gpu)" : "") << std::endl;
+        return 0;
+    }
+
+    if(csv)
+    {
+        std::cout << "policy,device,host_memory,distribution,threads,ops,seconds,ops_per_sec,"
+                     "p50_latency_ns,p99_latency_ns,max_latency_ns,peak_rss_bytes\n";
+    }else
+    {
+        std::cout << "Host memory: " << host_memory_name << std::endl;
+        std::cout << "=============================================================" << std::endl;
+        printf("%-48s %-8s %8s %14s %10s %10s %12s\n", "Policy", "Sizes", "Threads", "Ops/sec",
+               "p50 ns", "p99 ns", "Peak RSS MB");
+    }
+    for(const SizeDistribution& distribution : distributions)
+    {
+        for(int threads : thread_counts)
+        {
+            settings.threads = threads;
+            for(const Benchmark& benchmark : benchmarks)
+            {
+                const BenchmarkResult result = Run(benchmark, distribution, settings);
+                if(csv)
+                {
+                    std::cout << '"' << result.name << "\"," << (benchmark.gpu ? "gpu" : "cpu") << ','
+                              << host_memory_name << ',' << result.distribution << ',' << result.threads << ',' << result.ops << ','
+                              << result.seconds << ',' << result.ops_per_second << ',' << result.p50_ns << ','
+                              << result.p99_ns << ',' << result.max_ns << ',' << result.peak_rss_bytes << std::endl;
+                }else
+                {
+                    printf("%-48s %-8s %8d %14.0f %10.0f %10.0f %12s\n", result.name.c_str(),
+                           result.distribution.c_str(), result.threads, result.ops_per_second,
+                           result.p50_ns, result.p99_ns, Megabytes(result.peak_rss_bytes).c_str());
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,310 @@
+#include "Simulator.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    double SearchSteps(size_t entries)
+    {
+        return 1.0 + std::log2(static_cast<double>(entries) + 1.0);
+    }
+}
+
+/// ==========================================================
+/// SimNonCaching
+SimNonCaching::SimNonCaching(const LatencyModel& model):
+    SimPolicy(model)
+{
+}
+
+double SimNonCaching::Allocate(uint64_t id, size_t size, double now)
+{
+    allocations[id] = size;
+    reserved += size;
+    ++misses;
+    return systemAlloc(size);
+}
+
+double SimNonCaching::Free(uint64_t id, double now)
+{
+    auto itr = allocations.find(id);
+    if(itr == allocations.end())
+        return 0;
+    reserved -= itr->second;
+    allocations.erase(itr);
+    return model.system_free;
+}
+
+size_t SimNonCaching::Reserved() const
+{
+    return reserved;
+}
+
+/// ==========================================================
+/// SimPool
+void SimPool::Block::insert(size_t offset, size_t size_)
+{
+    if(size_ == 0)
+        return;
+    free_ranges[offset] = size_;
+    free_sizes.insert(std::make_pair(size_, offset));
+}
+
+void SimPool::Block::erase(std::map<size_t, size_t>::iterator itr)
+{
+    auto range = free_sizes.equal_range(itr->second);
+    for(auto size_itr = range.first; size_itr != range.second; ++size_itr)
+    {
+        if(size_itr->second == itr->first)
+        {
+            free_sizes.erase(size_itr);
+            break;
+        }
+    }
+    free_ranges.erase(itr);
+}
+
+SimPool::SimPool(const LatencyModel& model, size_t initial_block_size_):
+    SimPolicy(model),
+    initial_block_size(initial_block_size_)
+{
+    // PoolPolicy reserves its first block on construction
+    addBlock(initial_block_size);
+}
+
+void SimPool::addBlock(size_t size)
+{
+    Block block;
+    block.size = size;
+    block.insert(0, size);
+    blocks.push_back(block);
+    reserved += size;
+}
+
+bool SimPool::allocateFrom(size_t idx, uint64_t id, size_t size, double& cost)
+{
+    Block& block = blocks[idx];
+    cost += model.search * SearchSteps(block.free_sizes.size());
+    auto candidate = block.free_sizes.lower_bound(size);
+    if(candidate == block.free_sizes.end())
+        return false;
+    const size_t offset = candidate->second;
+    const size_t range_size = candidate->first;
+    block.erase(block.free_ranges.find(offset));
+    block.insert(offset + size, range_size - size);
+    Location location;
+    location.block = idx;
+    location.offset = offset;
+    location.size = size;
+    allocations[id] = location;
+    return true;
+}
+
+double SimPool::Allocate(uint64_t id, size_t size, double now)
+{
+    double cost = 0;
+    for(size_t i = 0; i < blocks.size(); ++i)
+    {
+        if(allocateFrom(i, id, size, cost))
+        {
+            ++hits;
+            return cost;
+        }
+    }
+    ++misses;
+    const size_t block_size = std::max(initial_block_size / 2, size);
+    cost += systemAlloc(block_size);
+    addBlock(block_size);
+    allocateFrom(blocks.size() - 1, id, size, cost);
+    return cost;
+}
+
+double SimPool::Free(uint64_t id, double now)
+{
+    auto itr = allocations.find(id);
+    if(itr == allocations.end())
+        return 0;
+    Block& block = blocks[itr->second.block];
+    size_t begin = itr->second.offset;
+    size_t end = begin + itr->second.size;
+    allocations.erase(itr);
+    double cost = model.search * SearchSteps(block.free_ranges.size());
+    auto next = block.free_ranges.find(end);
+    if(next != block.free_ranges.end())
+    {
+        end += next->second;
+        block.erase(next);
+    }
+    auto prev = block.free_ranges.lower_bound(begin);
+    if(prev != block.free_ranges.begin())
+    {
+        --prev;
+        if(prev->first + prev->second == begin)
+        {
+            begin = prev->first;
+            block.erase(prev);
+        }
+    }
+    block.insert(begin, end - begin);
+    return cost;
+}
+
+size_t SimPool::Reserved() const
+{
+    return reserved;
+}
+
+/// ==========================================================
+/// SimStack
+SimStack::SimStack(const LatencyModel& model, double max_age_ms):
+    SimPolicy(model),
+    max_age(max_age_ms * 1e6)
+{
+}
+
+double SimStack::Allocate(uint64_t id, size_t size, double now)
+{
+    double cost = 0;
+    for(auto itr = free_list.begin(); itr != free_list.end(); ++itr)
+    {
+        cost += model.search;
+        if(itr->size == size)
+        {
+            free_list.erase(itr);
+            allocations[id] = size;
+            ++hits;
+            return cost;
+        }
+    }
+    ++misses;
+    allocations[id] = size;
+    reserved += size;
+    return cost + systemAlloc(size);
+}
+
+double SimStack::Free(uint64_t id, double now)
+{
+    auto itr = allocations.find(id);
+    if(itr == allocations.end())
+        return 0;
+    FreeBlock block;
+    block.size = itr->second;
+    block.free_time = now;
+    free_list.push_back(block);
+    allocations.erase(itr);
+    return model.search;
+}
+
+void SimStack::Tick(double now)
+{
+    // The free list is in release order, so the front is the oldest block
+    while(!free_list.empty() && now - free_list.front().free_time > max_age)
+    {
+        reserved -= free_list.front().size;
+        background += model.system_free;
+        free_list.pop_front();
+    }
+}
+
+size_t SimStack::Reserved() const
+{
+    return reserved;
+}
+
+/// ==========================================================
+/// SimCombined
+SimCombined::SimCombined(const LatencyModel& model, size_t threshold_,
+                         std::unique_ptr<SimPolicy>&& small_, std::unique_ptr<SimPolicy>&& large_):
+    SimPolicy(model),
+    threshold(threshold_),
+    small(std::move(small_)),
+    large(std::move(large_))
+{
+}
+
+double SimCombined::Allocate(uint64_t id, size_t size, double now)
+{
+    const bool use_small = size < threshold;
+    is_small[id] = use_small;
+    const double cost = use_small ? small->Allocate(id, size, now) : large->Allocate(id, size, now);
+    collect();
+    return cost;
+}
+
+double SimCombined::Free(uint64_t id, double now)
+{
+    auto itr = is_small.find(id);
+    if(itr == is_small.end())
+        return 0;
+    const bool use_small = itr->second;
+    is_small.erase(itr);
+    return use_small ? small->Free(id, now) : large->Free(id, now);
+}
+
+void SimCombined::Tick(double now)
+{
+    small->Tick(now);
+    large->Tick(now);
+    collect();
+}
+
+size_t SimCombined::Reserved() const
+{
+    return small->Reserved() + large->Reserved();
+}
+
+void SimCombined::collect()
+{
+    hits = small->hits + large->hits;
+    misses = small->misses + large->misses;
+    background = small->background + large->background;
+}
+
+/// ==========================================================
+/// Replay
+ReplayResult Replay(const std::string& name, SimPolicy& policy, const std::vector<ReplayEvent>& events)
+{
+    ReplayResult result;
+    result.name = name;
+    std::vector<double> latencies;
+    latencies.reserve(events.size());
+    size_t in_use = 0;
+    for(const ReplayEvent& event : events)
+    {
+        policy.Tick(event.time);
+        double cost;
+        if(event.allocate)
+        {
+            cost = policy.Allocate(event.id, event.size, event.time);
+            in_use += event.size;
+            latencies.push_back(cost);
+        }
+        else
+        {
+            cost = policy.Free(event.id, event.time);
+            in_use -= std::min(in_use, event.size);
+        }
+        result.total_latency += cost;
+        result.peak_in_use = std::max(result.peak_in_use, in_use);
+        const size_t reserved = policy.Reserved();
+        if(reserved > result.peak_reserved)
+        {
+            result.peak_reserved = reserved;
+            result.fragmentation = 1.0 - static_cast<double>(in_use) / reserved;
+        }
+    }
+    result.hits = policy.hits;
+    result.misses = policy.misses;
+    result.background_latency = policy.background;
+    if(!latencies.empty())
+    {
+        double sum = 0;
+        for(double latency : latencies)
+            sum += latency;
+        result.mean_latency = sum / latencies.size();
+        const size_t p99 = std::min(latencies.size() - 1, latencies.size() * 99 / 100);
+        std::nth_element(latencies.begin(), latencies.begin() + p99, latencies.end());
+        result.p99_latency = latencies[p99];
+    }
+    return result;
+}
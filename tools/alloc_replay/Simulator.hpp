@@ -0,0 +1,162 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*!
+ * \brief Cost of the operations a simulated policy performs, in nanoseconds.
+ *        The defaults are in the range of cudaMalloc / cudaFree on a desktop
+ *        GPU and should be calibrated for the machine the trace came from.
+ */
+struct LatencyModel
+{
+    double system_alloc = 50000;
+    double system_alloc_per_mb = 200;
+    double system_free = 20000;
+    // one step of a free list search
+    double search = 20;
+};
+
+/*!
+ * \brief The SimPolicy class models the bookkeeping of one of the
+ *        allocation policies from MetaObject/Detail/AllocatorImpl.hpp
+ *        without touching memory.  Allocations are identified by the id the
+ *        replay assigns them.
+ */
+class SimPolicy
+{
+public:
+    SimPolicy(const LatencyModel& model_) : model(model_) {}
+    virtual ~SimPolicy() {}
+    // Return the simulated latency of the call
+    virtual double Allocate(uint64_t id, size_t size, double now) = 0;
+    virtual double Free(uint64_t id, double now) = 0;
+    // Called before every event, used to model background trimming
+    virtual void Tick(double now) {}
+    virtual size_t Reserved() const = 0;
+
+    size_t hits = 0;
+    size_t misses = 0;
+    // Latency spent on the MemoryTrimmer thread instead of the caller
+    double background = 0;
+protected:
+    double systemAlloc(size_t size) const
+    {
+        return model.system_alloc + model.system_alloc_per_mb * size / (1024.0 * 1024.0);
+    }
+    LatencyModel model;
+};
+
+// NonCachingPolicy
+class SimNonCaching : public SimPolicy
+{
+public:
+    SimNonCaching(const LatencyModel& model);
+    double Allocate(uint64_t id, size_t size, double now);
+    double Free(uint64_t id, double now);
+    size_t Reserved() const;
+private:
+    std::unordered_map<uint64_t, size_t> allocations;
+    size_t reserved = 0;
+};
+
+// PoolPolicy, best fit inside blocks that are never released
+class SimPool : public SimPolicy
+{
+public:
+    SimPool(const LatencyModel& model, size_t initial_block_size);
+    double Allocate(uint64_t id, size_t size, double now);
+    double Free(uint64_t id, double now);
+    size_t Reserved() const;
+private:
+    struct Block
+    {
+        size_t size;
+        std::map<size_t, size_t> free_ranges;
+        std::multimap<size_t, size_t> free_sizes;
+        void insert(size_t offset, size_t size);
+        void erase(std::map<size_t, size_t>::iterator itr);
+    };
+    struct Location
+    {
+        size_t block;
+        size_t offset;
+        size_t size;
+    };
+    void addBlock(size_t size);
+    bool allocateFrom(size_t block, uint64_t id, size_t size, double& cost);
+
+    size_t initial_block_size;
+    std::vector<Block> blocks;
+    std::unordered_map<uint64_t, Location> allocations;
+    size_t reserved = 0;
+};
+
+// StackPolicy, exact size reuse with cached blocks released after max_age
+class SimStack : public SimPolicy
+{
+public:
+    SimStack(const LatencyModel& model, double max_age_ms);
+    double Allocate(uint64_t id, size_t size, double now);
+    double Free(uint64_t id, double now);
+    void Tick(double now);
+    size_t Reserved() const;
+private:
+    struct FreeBlock
+    {
+        size_t size;
+        double free_time;
+    };
+    double max_age;
+    std::deque<FreeBlock> free_list;
+    std::unordered_map<uint64_t, size_t> allocations;
+    size_t reserved = 0;
+};
+
+// CombinedPolicy, routes allocations smaller than threshold to small
+class SimCombined : public SimPolicy
+{
+public:
+    SimCombined(const LatencyModel& model, size_t threshold,
+                std::unique_ptr<SimPolicy>&& small, std::unique_ptr<SimPolicy>&& large);
+    double Allocate(uint64_t id, size_t size, double now);
+    double Free(uint64_t id, double now);
+    void Tick(double now);
+    size_t Reserved() const;
+private:
+    void collect();
+    size_t threshold;
+    std::unique_ptr<SimPolicy> small;
+    std::unique_ptr<SimPolicy> large;
+    std::unordered_map<uint64_t, bool> is_small;
+};
+
+struct ReplayEvent
+{
+    double time;
+    uint64_t id;
+    size_t size;
+    bool allocate;
+};
+
+struct ReplayResult
+{
+    std::string name;
+    size_t peak_reserved = 0;
+    size_t peak_in_use = 0;
+    // 1 - in use / reserved, at the point of peak reservation
+    double fragmentation = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+    double mean_latency = 0;
+    double p99_latency = 0;
+    double total_latency = 0;
+    double background_latency = 0;
+};
+
+ReplayResult Replay(const std::string& name, SimPolicy& policy, const std::vector<ReplayEvent>& events);
@@ -0,0 +1,205 @@
+#include "Simulator.hpp"
+#include <MetaObject/Detail/AllocationTrace.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Replays an allocation trace recorded with mo::AllocationTrace (set
+ * MO_ALLOCATION_TRACE=<file> when running the workload) against simulated
+ * PoolPolicy, StackPolicy and CombinedPolicy settings and reports peak
+ * footprint, fragmentation and simulated allocation latency for each.
+ */
+
+namespace
+{
+    void PrintUsage()
+    {
+        std::cout <<
+            "Usage: alloc_replay <trace> [options]\n"
+            "  --device cpu|gpu|all        events to replay (default gpu)\n"
+            "  --allocator <id>            only replay one allocator\n"
+            "  --thresholds <a,b,...>      CombinedPolicy thresholds in bytes (default 65536,262144,524288,2097152)\n"
+            "  --pool-blocks <a,b,...>     PoolPolicy initial block sizes in bytes (default 10000000)\n"
+            "  --max-age <ms>              StackPolicy cache lifetime, as set on the MemoryTrimmer (default 1000)\n"
+            "  --alloc-ns <ns>             simulated cost of a system allocation (default 50000)\n"
+            "  --alloc-ns-per-mb <ns>      additional cost per MB of a system allocation (default 200)\n"
+            "  --free-ns <ns>              simulated cost of a system free (default 20000)\n"
+            "  --search-ns <ns>            simulated cost of one free list search step (default 20)\n"
+            "  --csv                       machine readable output\n";
+    }
+
+    std::vector<size_t> ParseList(const char* arg)
+    {
+        std::vector<size_t> output;
+        std::stringstream ss(arg);
+        std::string item;
+        while(std::getline(ss, item, ','))
+        {
+            if(item.size())
+                output.push_back(static_cast<size_t>(std::strtod(item.c_str(), nullptr)));
+        }
+        return output;
+    }
+
+    std::string Megabytes(size_t bytes)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.1f", bytes / (1024.0 * 1024.0));
+        return buf;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2 || strcmp(argv[1], "--help") == 0)
+    {
+        PrintUsage();
+        return argc < 2 ? 1 : 0;
+    }
+    std::string device = "gpu";
+    int allocator = -1;
+    std::vector<size_t> thresholds = {64 * 1024, 256 * 1024, 512 * 1024, 2 * 1024 * 1024};
+    std::vector<size_t> pool_blocks = {10000000};
+    double max_age = 1000;
+    bool csv = false;
+    LatencyModel model;
+    for(int i = 2; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if(arg == "--csv")
+            csv = true;
+        else if(arg == "--device" && has_value)
+            device = argv[++i];
+        else if(arg == "--allocator" && has_value)
+            allocator = atoi(argv[++i]);
+        else if(arg == "--thresholds" && has_value)
+            thresholds = ParseList(argv[++i]);
+        else if(arg == "--pool-blocks" && has_value)
+            pool_blocks = ParseList(argv[++i]);
+        else if(arg == "--max-age" && has_value)
+            max_age = atof(argv[++i]);
+        else if(arg == "--alloc-ns" && has_value)
+            model.system_alloc = atof(argv[++i]);
+        else if(arg == "--alloc-ns-per-mb" && has_value)
+            model.system_alloc_per_mb = atof(argv[++i]);
+        else if(arg == "--free-ns" && has_value)
+            model.system_free = atof(argv[++i]);
+        else if(arg == "--search-ns" && has_value)
+            model.search = atof(argv[++i]);
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::vector<mo::AllocationTraceEvent> trace;
+    std::vector<std::string> names;
+    if(!mo::AllocationTrace::Read(argv[1], trace, &names))
+    {
+        std::cerr << "Unable to read allocation trace " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // Pointers are reused after a free, so every allocation gets its own id
+    std::vector<ReplayEvent> events;
+    events.reserve(trace.size());
+    std::map<std::pair<int, uint64_t>, ReplayEvent> live;
+    uint64_t next_id = 0;
+    for(const mo::AllocationTraceEvent& event : trace)
+    {
+        if(device == "cpu" && event.device != mo::AllocationTraceEvent::Cpu_e)
+            continue;
+        if(device == "gpu" && event.device != mo::AllocationTraceEvent::Gpu_e)
+            continue;
+        if(allocator >= 0 && event.allocator != allocator)
+            continue;
+        const std::pair<int, uint64_t> key(event.device, event.ptr);
+        ReplayEvent replay;
+        replay.time = static_cast<double>(event.time);
+        if(event.op == mo::AllocationTraceEvent::Allocate_e)
+        {
+            replay.id = next_id++;
+            replay.size = static_cast<size_t>(event.size);
+            replay.allocate = true;
+            live[key] = replay;
+            events.push_back(replay);
+        }
+        else if(event.op == mo::AllocationTraceEvent::Free_e)
+        {
+            auto itr = live.find(key);
+            // Allocated before the trace started
+            if(itr == live.end())
+                continue;
+            replay.id = itr->second.id;
+            replay.size = itr->second.size;
+            replay.allocate = false;
+            live.erase(itr);
+            events.push_back(replay);
+        }
+    }
+    if(!csv)
+    {
+        std::cout << "Replaying " << events.size() << " " << device << " events, "
+                  << live.size() << " allocations are never freed" << std::endl;
+        for(size_t i = 0; i < names.size(); ++i)
+            std::cout << "  allocator " << i << ": " << names[i] << std::endl;
+    }
+
+    std::vector<ReplayResult> results;
+    {
+        SimNonCaching policy(model);
+        results.push_back(Replay("NonCachingPolicy", policy, events));
+    }
+    {
+        SimStack policy(model, max_age);
+        results.push_back(Replay("StackPolicy", policy, events));
+    }
+    for(size_t block : pool_blocks)
+    {
+        SimPool policy(model, block);
+        results.push_back(Replay("PoolPolicy(" + std::to_string(block) + ")", policy, events));
+        for(size_t threshold : thresholds)
+        {
+            SimCombined combined(model, threshold,
+                                 std::unique_ptr<SimPolicy>(new SimPool(model, block)),
+                                 std::unique_ptr<SimPolicy>(new SimStack(model, max_age)));
+            results.push_back(Replay("CombinedPolicy(" + std::to_string(threshold) + ", " + std::to_string(block) + ")",
+                                     combined, events));
+        }
+    }
+
+    if(csv)
+    {
+        std::cout << "policy,peak_reserved_bytes,peak_in_use_bytes,fragmentation,hits,misses,"
+                     "mean_latency_ns,p99_latency_ns,total_latency_ns,background_latency_ns\n";
+        for(const ReplayResult& result : results)
+        {
+            std::cout << '"' << result.name << "\"," << result.peak_reserved << ',' << result.peak_in_use << ','
+                      << result.fragmentation << ',' << result.hits << ',' << result.misses << ','
+                      << result.mean_latency << ',' << result.p99_latency << ','
+                      << result.total_latency << ',' << result.background_latency << '\n';
+        }
+        return 0;
+    }
+    std::cout << "=============================================================" << std::endl;
+    printf("%-40s %12s %12s %8s %10s %12s %12s %12s\n", "Policy", "Reserved MB", "In use MB", "Frag %",
+           "Hit %", "Mean ns", "p99 ns", "Total ms");
+    for(const ReplayResult& result : results)
+    {
+        const size_t total = result.hits + result.misses;
+        printf("%-40s %12s %12s %8.1f %10.1f %12.0f %12.0f %12.2f\n", result.name.c_str(),
+               Megabytes(result.peak_reserved).c_str(), Megabytes(result.peak_in_use).c_str(),
+               result.fragmentation * 100.0, total ? 100.0 * result.hits / total : 0.0,
+               result.mean_latency, result.p99_latency, result.total_latency / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "Bench.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+/*
+ * Every allocation of the process is counted so that allocations per
+ * emission can be reported, including those made on the threads that
+ * receive queued calls.
+ */
+namespace
+{
+    std::atomic<size_t> g_allocations(0);
+
+    void* CountedAllocate(size_t size)
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        void* ptr = std::malloc(size ? size : 1);
+        if(ptr == nullptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+}
+
+void* operator new(size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+size_t AllocationCount()
+{
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+double Percentile(std::vector<uint64_t>& values, double percentile)
+{
+    if(values.empty())
+        return 0.0;
+    const size_t index = std::min(values.size() - 1,
+                                  static_cast<size_t>(percentile * static_cast<double>(values.size())));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return static_cast<double>(values[index]);
+}
+
+int64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
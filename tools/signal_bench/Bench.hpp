@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchmarkSettings
+{
+    size_t emits = 200000;
+    // Cross thread emissions wait for delivery after every burst so that queues stay bounded
+    size_t burst = 16;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    size_t slots = 0;
+    size_t emits = 0;
+    double seconds = 0.0;
+    double ns_per_emit = 0.0;
+    double p50_ns = 0.0;           // end to end, from emission until the last slot returned
+    double p99_ns = 0.0;
+    double allocs_per_emit = 0.0;  // operator new calls of all threads
+    double connects_per_second = 0.0; // connect plus disconnect pairs, only measured by churn
+};
+
+/*!
+ * \brief The Scenario struct names a way of emitting a signal, run is called
+ *        once per slot count.
+ */
+struct Scenario
+{
+    std::string name;
+    std::function<BenchmarkResult(size_t slots, const BenchmarkSettings& settings)> run;
+};
+
+std::vector<Scenario> CreateScenarios();
+
+struct CallableResult
+{
+    std::string name;
+    double ns_per_create = 0.0;
+    double ns_per_call = 0.0;
+};
+
+// Cost of creating and calling the callable behind a slot, std::function against mo::Delegate
+std::vector<CallableResult> RunCallables(size_t calls);
+
+// Number of operator new calls made by the process so far
+size_t AllocationCount();
+
+double Percentile(std::vector<uint64_t>& values, double percentile);
+
+// Nanoseconds on the steady clock, used to timestamp emissions
+int64_t Now();
@@ -0,0 +1,76 @@
+#include "Bench.hpp"
+#include <MetaObject/Signals/Delegate.hpp>
+#include <algorithm>
+#include <chrono>
+
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+namespace
+{
+    typedef std::chrono::steady_clock clock_type;
+
+    struct Receiver
+    {
+        BENCH_NOINLINE void Add(int value) { sum += value; }
+        int sum = 0;
+    };
+
+    // make creates the callable, the pointer is laundered so the call can not be inlined
+    template<class F, class Make>
+    CallableResult TimeCallable(const std::string& name, Make make, size_t calls)
+    {
+        CallableResult result;
+        result.name = name;
+        const size_t creates = std::max<size_t>(1, calls / 10);
+        clock_type::time_point begin = clock_type::now();
+        for(size_t i = 0; i < creates; ++i)
+        {
+            F f = make();
+            F* volatile escape = &f;
+            (void)escape;
+        }
+        clock_type::time_point end = clock_type::now();
+        result.ns_per_create = std::chrono::duration<double, std::nano>(end - begin).count() / creates;
+
+        F f = make();
+        F* volatile laundered = &f;
+        begin = clock_type::now();
+        for(size_t i = 0; i < calls; ++i)
+            (*laundered)(static_cast<int>(i));
+        end = clock_type::now();
+        result.ns_per_call = std::chrono::duration<double, std::nano>(end - begin).count() / calls;
+        return result;
+    }
+}
+
+std::vector<CallableResult> RunCallables(size_t calls)
+{
+    Receiver receiver;
+    Receiver* target = &receiver;
+    std::vector<CallableResult> output;
+    output.push_back(TimeCallable<std::function<void(int)>>("std::function(std::bind)", [target]()
+    {
+        return std::function<void(int)>(std::bind(&Receiver::Add, target, std::placeholders::_1));
+    }, calls));
+    output.push_back(TimeCallable<mo::Delegate<void(int)>>("Delegate(std::bind)", [target]()
+    {
+        return mo::Delegate<void(int)>(std::bind(&Receiver::Add, target, std::placeholders::_1));
+    }, calls));
+    output.push_back(TimeCallable<mo::Delegate<void(int)>>("Delegate(object, method)", [target]()
+    {
+        return mo::Delegate<void(int)>(target, &Receiver::Add);
+    }, calls));
+    output.push_back(TimeCallable<std::function<void(int)>>("std::function(lambda)", [target]()
+    {
+        return std::function<void(int)>([target](int value) { target->Add(value); });
+    }, calls));
+    output.push_back(TimeCallable<mo::Delegate<void(int)>>("Delegate(lambda)", [target]()
+    {
+        return mo::Delegate<void(int)>([target](int value) { target->Add(value); });
+    }, calls));
+    return output;
+}
@@ -0,0 +1,258 @@
+#include "Bench.hpp"
+#include <MetaObject/Context.hpp>
+#include <MetaObject/Signals/Connection.hpp>
+#include <MetaObject/Signals/RelayManager.hpp>
+#include <MetaObject/Signals/TypedSignal.hpp>
+#include <MetaObject/Signals/TypedSlot.hpp>
+#include <MetaObject/Thread/InterThread.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <memory>
+
+namespace
+{
+    typedef mo::TypedSignal<void(int64_t)> Signal;
+    typedef mo::TypedSlot<void(int64_t)> Slot;
+
+    // Runs the queue of a thread with its own context until it is interrupted
+    class Worker
+    {
+    public:
+        Worker():
+            ctx(nullptr)
+        {
+            thread = boost::thread([this]()
+            {
+                mo::Context thread_ctx;
+                ctx = &thread_ctx;
+                while(!boost::this_thread::interruption_requested())
+                    mo::ThreadSpecificQueue::Run(thread_ctx.thread_id);
+                // Not leaving calls queued for a thread id that may be reused
+                mo::ThreadSpecificQueue::Run(thread_ctx.thread_id);
+            });
+            while(ctx == nullptr)
+                boost::this_thread::yield();
+        }
+        ~Worker()
+        {
+            thread.interrupt();
+            thread.join();
+        }
+        mo::Context* Context() const { return ctx; }
+    private:
+        std::atomic<mo::Context*> ctx;
+        boost::thread thread;
+    };
+
+    struct EmissionOptions
+    {
+        bool cross_thread = false;
+        bool named_relay = false;
+    };
+
+    BenchmarkResult RunEmission(const std::string& name, size_t num_slots, const BenchmarkSettings& settings,
+                                EmissionOptions options)
+    {
+        BenchmarkResult result;
+        result.name = name;
+        result.slots = num_slots;
+        result.emits = settings.emits;
+
+        mo::Context ctx;
+        std::unique_ptr<Worker> worker;
+        if(options.cross_thread)
+            worker.reset(new Worker());
+        mo::RelayManager manager;
+        Signal signal;
+        std::vector<std::shared_ptr<mo::Connection>> connections;
+        if(options.named_relay)
+            connections.push_back(manager.Connect(&signal, "bench"));
+
+        // The last slot reports delivery of the whole emission
+        std::atomic<size_t> delivered(0);
+        std::vector<uint64_t> latencies;
+        std::atomic<bool> recording(false);
+        volatile int64_t sink = 0;
+        std::vector<std::unique_ptr<Slot>> slots;
+        for(size_t i = 0; i < num_slots; ++i)
+        {
+            const bool last = i + 1 == num_slots;
+            if(last && options.cross_thread)
+            {
+                slots.emplace_back(new Slot([&delivered, &latencies, &recording](int64_t emitted)
+                {
+                    if(recording)
+                        latencies.push_back(static_cast<uint64_t>(Now() - emitted));
+                    delivered.fetch_add(1, std::memory_order_release);
+                }));
+            }else
+            {
+                slots.emplace_back(new Slot([&sink](int64_t emitted)
+                {
+                    sink = sink + emitted;
+                }));
+            }
+            slots.back()->SetContext(worker ? worker->Context() : &ctx);
+            if(options.named_relay)
+                connections.push_back(manager.Connect(slots.back().get(), "bench"));
+            else
+                connections.push_back(slots.back()->Connect(&signal));
+        }
+
+        const bool wait = options.cross_thread && num_slots > 0;
+        size_t emitted = 0;
+        auto emit = [&]()
+        {
+            signal(&ctx, Now());
+            ++emitted;
+            if(wait && emitted % settings.burst == 0)
+            {
+                while(delivered.load(std::memory_order_acquire) != emitted)
+                    boost::this_thread::yield();
+            }
+        };
+        auto drain = [&]()
+        {
+            while(wait && delivered.load(std::memory_order_acquire) != emitted)
+                boost::this_thread::yield();
+        };
+        // Warm up, this also lets relays refresh cached slot contexts
+        for(size_t i = 0; i < settings.burst * 4; ++i)
+            emit();
+        drain();
+
+        // Throughput and allocations, without timing individual emissions
+        const size_t allocations = AllocationCount();
+        const int64_t begin = Now();
+        for(size_t i = 0; i < settings.emits; ++i)
+            emit();
+        drain();
+        const int64_t end = Now();
+        result.allocs_per_emit = static_cast<double>(AllocationCount() - allocations) / settings.emits;
+        result.seconds = (end - begin) * 1e-9;
+        result.ns_per_emit = static_cast<double>(end - begin) / settings.emits;
+
+        // Latency
+        if(wait)
+        {
+            latencies.reserve(settings.emits);
+            drain();
+            recording = true;
+            for(size_t i = 0; i < settings.emits; ++i)
+                emit();
+            drain();
+            recording = false;
+        }else
+        {
+            latencies.resize(settings.emits);
+            for(size_t i = 0; i < settings.emits; ++i)
+            {
+                const int64_t start = Now();
+                signal(&ctx, start);
+                latencies[i] = static_cast<uint64_t>(Now() - start);
+            }
+        }
+        result.p50_ns = Percentile(latencies, 0.5);
+        result.p99_ns = Percentile(latencies, 0.99);
+        connections.clear();
+        slots.clear();
+        return result;
+    }
+
+    // Emission while another thread keeps connecting and disconnecting slots
+    BenchmarkResult RunChurn(size_t num_slots, const BenchmarkSettings& settings)
+    {
+        BenchmarkResult result;
+        result.name = "churn";
+        result.slots = num_slots;
+        result.emits = settings.emits;
+
+        mo::Context ctx;
+        Signal signal;
+        volatile int64_t sink = 0;
+        std::vector<std::unique_ptr<Slot>> slots;
+        std::vector<std::shared_ptr<mo::Connection>> connections;
+        for(size_t i = 0; i < num_slots; ++i)
+        {
+            slots.emplace_back(new Slot([&sink](int64_t emitted)
+            {
+                sink = sink + emitted;
+            }));
+            slots.back()->SetContext(&ctx);
+            connections.push_back(slots.back()->Connect(&signal));
+        }
+
+        std::atomic<bool> running(true);
+        std::atomic<size_t> churned(0);
+        boost::thread churn([&]()
+        {
+            while(running)
+            {
+                Slot slot([&sink](int64_t emitted)
+                {
+                    sink = sink - emitted;
+                });
+                slot.SetContext(&ctx);
+                std::shared_ptr<mo::Connection> connection = slot.Connect(&signal);
+                connection.reset();
+                churned.fetch_add(1, std::memory_order_relaxed);
+                // The slot disconnects as it is destroyed, then let the emitter run
+                // so that on few cores the churn does not starve it
+                boost::this_thread::yield();
+            }
+        });
+
+        std::vector<uint64_t> latencies(settings.emits);
+        const size_t allocations = AllocationCount();
+        const size_t churned_begin = churned;
+        const int64_t begin = Now();
+        for(size_t i = 0; i < settings.emits; ++i)
+        {
+            const int64_t start = Now();
+            signal(&ctx, start);
+            latencies[i] = static_cast<uint64_t>(Now() - start);
+        }
+        const int64_t end = Now();
+        const size_t churned_end = churned;
+        const size_t total_allocations = AllocationCount() - allocations;
+        running = false;
+        churn.join();
+
+        result.seconds = (end - begin) * 1e-9;
+        result.ns_per_emit = static_cast<double>(end - begin) / settings.emits;
+        result.p50_ns = Percentile(latencies, 0.5);
+        result.p99_ns = Percentile(latencies, 0.99);
+        // Includes the allocations of connecting, which run concurrently
+        result.allocs_per_emit = static_cast<double>(total_allocations) / settings.emits;
+        result.connects_per_second = result.seconds > 0.0 ? (churned_end - churned_begin) / result.seconds : 0.0;
+        return result;
+    }
+
+    Scenario Emission(const std::string& name, bool cross_thread, bool named_relay)
+    {
+        Scenario scenario;
+        scenario.name = name;
+        EmissionOptions options;
+        options.cross_thread = cross_thread;
+        options.named_relay = named_relay;
+        scenario.run = [name, options](size_t slots, const BenchmarkSettings& settings)
+        {
+            return RunEmission(name, slots, settings, options);
+        };
+        return scenario;
+    }
+}
+
+std::vector<Scenario> CreateScenarios()
+{
+    std::vector<Scenario> output;
+    output.push_back(Emission("same_thread", false, false));
+    output.push_back(Emission("same_thread_named_relay", false, true));
+    output.push_back(Emission("cross_thread", true, false));
+    output.push_back(Emission("cross_thread_named_relay", true, true));
+    Scenario churn;
+    churn.name = "churn";
+    churn.run = &RunChurn;
+    output.push_back(churn);
+    return output;
+}
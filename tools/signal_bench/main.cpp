@@ -0,0 +1,159 @@
+#include "Bench.hpp"
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Baseline for the signal path.  Every scenario emits a TypedSignal to 0 to
+ * 64 slots and reports the cost per emission, the end to end latency from
+ * emission until the last slot returned and the allocations per emission:
+ *   same_thread               slots with the emitting context, called directly
+ *   cross_thread              slots with the context of another thread, called
+ *                             through ThreadSpecificQueue
+ *   *_named_relay             slots and signal connected through one RelayManager
+ *                             relay instead of a relay per connection
+ *   churn                     same_thread while another thread keeps connecting
+ *                             and disconnecting a slot
+ * The cost of creating and calling the callable behind a slot is measured
+ * for std::function and mo::Delegate.
+ */
+
+namespace
+{
+    void PrintUsage()
+    {
+        std::cout <<
+            "Usage: signal_bench [options]\n"
+            "  --slots <a,b,...>   slot counts (default 0,1,2,4,8,16,32,64)\n"
+            "  --emits <n>         emissions per scenario and slot count (default 200000)\n"
+            "  --burst <n>         cross thread emissions between waits for delivery (default 16)\n"
+            "  --calls <n>         calls per callable, 0 skips the callables (default 10000000)\n"
+            "  --filter <text>     only run scenarios whose name contains text\n"
+            "  --list              print the scenarios and exit\n"
+            "  --csv               machine readable output\n";
+    }
+
+    std::vector<size_t> ParseList(const char* arg)
+    {
+        std::vector<size_t> output;
+        std::stringstream ss(arg);
+        std::string item;
+        while(std::getline(ss, item, ','))
+        {
+            if(item.size())
+                output.push_back(static_cast<size_t>(atoi(item.c_str())));
+        }
+        return output;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    std::vector<size_t> slot_counts;
+    size_t calls = 10000000;
+    std::string filter;
+    bool list = false;
+    bool csv = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if(arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else if(arg == "--csv")
+            csv = true;
+        else if(arg == "--list")
+            list = true;
+        else if(arg == "--slots" && has_value)
+            slot_counts = ParseList(argv[++i]);
+        else if(arg == "--emits" && has_value)
+            settings.emits = std::max<size_t>(1, static_cast<size_t>(std::strtod(argv[++i], nullptr)));
+        else if(arg == "--burst" && has_value)
+            settings.burst = std::max<size_t>(1, static_cast<size_t>(atoi(argv[++i])));
+        else if(arg == "--calls" && has_value)
+            calls = static_cast<size_t>(std::strtod(argv[++i], nullptr));
+        else if(arg == "--filter" && has_value)
+            filter = argv[++i];
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+    if(slot_counts.empty())
+        slot_counts = {0, 1, 2, 4, 8, 16, 32, 64};
+
+    std::vector<Scenario> scenarios;
+    for(const Scenario& scenario : CreateScenarios())
+    {
+        if(filter.empty() || scenario.name.find(filter) != std::string::npos)
+            scenarios.push_back(scenario);
+    }
+    if(list)
+    {
+        for(const Scenario& scenario : scenarios)
+            std::cout << scenario.name << std::endl;
+        return 0;
+    }
+
+    if(csv)
+    {
+        std::cout << "scenario,slots,emits,seconds,ns_per_emit,p50_latency_ns,p99_latency_ns,"
+                     "allocs_per_emit,connects_per_sec\n";
+    }else
+    {
+        std::cout << "=============================================================" << std::endl;
+        printf("%-26s %6s %10s %10s %10s %10s %12s %12s\n", "Scenario", "Slots", "Emits", "ns/emit",
+               "p50 ns", "p99 ns", "Allocs/emit", "Connects/s");
+    }
+    for(const Scenario& scenario : scenarios)
+    {
+        for(size_t count : slot_counts)
+        {
+            const BenchmarkResult result = scenario.run(count, settings);
+            if(csv)
+            {
+                std::cout << result.name << ',' << result.slots << ',' << result.emits << ',' << result.seconds << ','
+                          << result.ns_per_emit << ',' << result.p50_ns << ',' << result.p99_ns << ','
+                          << result.allocs_per_emit << ',' << result.connects_per_second << std::endl;
+            }else
+            {
+                printf("%-26s %6zu %10zu %10.1f %10.0f %10.0f %12.2f %12.0f\n", result.name.c_str(), result.slots,
+                       result.emits, result.ns_per_emit, result.p50_ns, result.p99_ns, result.allocs_per_emit,
+                       result.connects_per_second);
+            }
+        }
+    }
+
+    if(calls == 0)
+        return 0;
+    if(csv)
+    {
+        std::cout << "callable,ns_per_create,ns_per_call\n";
+    }else
+    {
+        std::cout << "=============================================================" << std::endl;
+        printf("%-28s %14s %12s\n", "Callable", "ns/create", "ns/call");
+    }
+    for(const CallableResult& result : RunCallables(calls))
+    {
+        if(csv)
+            std::cout << '"' << result.name << "\"," << result.ns_per_create << ',' << result.ns_per_call << std::endl;
+        else
+            printf("%-28s %14.2f %12.2f\n", result.name.c_str(), result.ns_per_create, result.ns_per_call);
+    }
+    return 0;
+}